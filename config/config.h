@@ -79,12 +79,24 @@ multi-homing either.) -wm 05/08/2000 */
 #define MEMORY_DEBUG_FILE "./logs/malloc-debug.log"
 #define MEMORY_DEBUG_SIZE 128
 #endif
+
+/* Define whether SAFE_MALLOC/SAFE_FREE record every block in the allocation
+ * tracking table.  Tracking provides double-free detection and file/line
+ * leak attribution at a small constant cost per call.  Undefine it on
+ * production servers to make safe_malloc()/safe_free() plain wrappers
+ * around malloc()/free().  MEMORY_DEBUG_LOG needs tracking and turns it
+ * back on if it is enabled.                                                 */
+#define MEMORY_TRACKING
+#if defined(MEMORY_DEBUG_LOG) && !defined(MEMORY_TRACKING)
+#define MEMORY_TRACKING
+#endif
 /* END memory debug section */
 
-/* define whether or not you want reverse DNS.  This option is fine on most
- * systems, however, if your server has a slow DNS server or just does not 
- * reverse resolve, Reverse DNS lookups will be really slow.  If, when someone 
- * connects, the entire MUSE lags for 2 minutes, try turning this option off.  */
+/* define whether or not you want reverse DNS.  Lookups run on the resolver
+ * threads (io/resolver.c) and answers are cached for dns_cache_ttl seconds,
+ * so a slow DNS server only delays the hostname shown for a connection;
+ * it no longer lags the game.  Turn this off if your server does not
+ * reverse resolve at all.  */
 #define HOST_LOOKUPS 
 
 
@@ -175,6 +187,10 @@ multi-homing either.) -wm 05/08/2000 */
 /* Universe mods - always enabled (see comments at top of file) */
 /* #define USE_UNIV */
 
+/* define this to make the main loop use select() even where epoll is
+ * available (Linux). */
+/* #define NO_EPOLL */
+
 /* defines this if you are using the /proc filesystem. */
 #define USE_PROC
 
@@ -95,6 +95,14 @@ INSERT INTO config (config_key, config_value, config_type) VALUES
 ('queue_cost', '100', 'NUM'),
 ('queue_loss', '150', 'NUM'),
 ('max_queue', '1000', 'NUM'),
+('queue_budget_msec', '20', 'NUM'),
+('queue_fair', '1', 'NUM'),
+('queue_quantum_usec', '1000', 'NUM'),
+('dns_cache_ttl', '3600', 'NUM'),
+('ident_lookups', '1', 'NUM'),
+('mccp_compression', '1', 'NUM'),
+('queue_owner_cmds', '500', 'NUM'),
+('max_pids', '65536', 'NUM'),
 ('channel_name_limit', '32', 'NUM'),
 ('player_name_limit', '32', 'NUM'),
 ('player_reference_limit', '5', 'NUM'),
@@ -187,6 +187,7 @@ void do_wall(dbref player, const char *message)
 {
     dbref zone;
     struct descriptor_data *d;
+    struct render_cache rc;
     char buf[BUFFER_LEN];
     
     /* Validate inputs */
@@ -217,6 +218,7 @@ void do_wall(dbref player, const char *message)
             db[player].cname, message);
     
     /* Send to all players in same zone */
+    render_begin(&rc, buf, 1);
     for (d = descriptor_list; d; d = d->next) {
         if (d->state == CONNECTED && 
             GoodObject(d->player) &&
@@ -225,6 +227,7 @@ void do_wall(dbref player, const char *message)
             notify(d->player, buf);
         }
     }
+    render_end(&rc);
 }
 
 /**
@@ -299,6 +302,7 @@ void do_shout(dbref player, const char *message)
 void system_announce(const char *message, dbref except, int obey_walls)
 {
     struct descriptor_data *d;
+    struct render_cache rc;
     char buf[BUFFER_LEN];
     
     if (!message) {
@@ -309,6 +313,7 @@ void system_announce(const char *message, dbref except, int obey_walls)
     snprintf(buf, sizeof(buf), "GAME: %s", message);
     
     /* Send to all connected players */
+    render_begin(&rc, buf, 1);
     for (d = descriptor_list; d; d = d->next) {
         if (d->state != CONNECTED) {
             continue;
@@ -328,6 +333,7 @@ void system_announce(const char *message, dbref except, int obey_walls)
         
         notify(d->player, buf);
     }
+    render_end(&rc);
 }
 
 /**
@@ -141,11 +141,25 @@ void com_send_as_hidden(char *channel, char *message, dbref player)
   com_send_int(channel, message, player, 1);
 }
 
+/**
+ * Render a channel line for one recipient: prefix/suffix, then the
+ * recipient's color and beep filtering.
+ */
+static char *com_render(dbref recipient, char *text, int pueblo)
+{
+  text = add_pre_suf(recipient, 1, text, pueblo);
+  return color_string(text, color_mode(recipient, pueblo));
+}
+
 /**
  * Internal channel message sending with full options
  *
- * Uses the in-memory cache for O(1) membership and mute checks.
+ * Walks the channel's online list, which holds only the connected,
+ * unmuted, unbanned members, and each of their descriptors.
  * Each player sees their own personalized color_name for the channel.
+ * Members whose color_name is the channel's own (and who have no
+ * prefix, suffix or puppet tag) all see the same line, so it is
+ * rendered once per notify_class() and the copy shared between them.
  *
  * @param channel Channel name (plain, no prefix)
  * @param message Message to send
@@ -155,7 +169,9 @@ void com_send_as_hidden(char *channel, char *message, dbref player)
 void com_send_int(char *channel, char *message, dbref player, int hidden)
 {
   struct descriptor_data *d;
-  char *output_str, *output_str2;
+  channel_member_t *m;
+  char *output_str, *base_str;
+  char *shared[RENDER_CLASSES];
   channel_cache_t *chan;
 
   /* Validate input */
@@ -169,72 +185,69 @@ void com_send_int(char *channel, char *message, dbref player, int hidden)
     return;
   }
 
-  /* Loop through all descriptors */
-  for (d = descriptor_list; d; d = d->next) {
-    channel_member_t *m;
+  base_str = tprintf("[%s] %s", chan->cname, message);
+  memset(shared, 0, sizeof(shared));
 
-    /* Check if descriptor is valid and connected */
-    if (!d || d->state != CONNECTED || !GoodObject(d->player)) {
-      continue;
-    }
+  /* Loop through the members who are listening */
+  for (m = chan->online; m; m = m->onext) {
+    int personal, puppet, cls;
 
-    /* Check membership and mute status via cache */
-    m = channel_cache_get_member(d->player, chan->channel_id);
-    if (!m || m->is_banned || m->muted) {
+    if (!GoodObject(m->player)) {
       continue;
     }
 
-    /* Format the message with player's personalized color name */
-    output_str = tprintf("[%s] %s",
-                        m->color_name ? m->color_name : chan->cname,
-                        message);
-
     /* Check visibility permissions */
-    if (hidden && !could_doit(real_owner(d->player), real_owner(player), A_LHIDE)) {
+    if (hidden && !could_doit(real_owner(m->player), real_owner(player), A_LHIDE)) {
       continue;
     }
 
     /* Check blacklist - both players must have each other blacklisted */
     if (player > 0) {
-      char *p_blacklist = atr_get(real_owner(d->player), A_BLACKLIST);
+      char *p_blacklist = atr_get(real_owner(m->player), A_BLACKLIST);
       char *sender_blacklist = atr_get(real_owner(player), A_BLACKLIST);
 
       if ((p_blacklist && *p_blacklist) || (sender_blacklist && *sender_blacklist)) {
-        if (could_doit(real_owner(player), real_owner(d->player), A_BLACKLIST) &&
-            could_doit(real_owner(d->player), real_owner(player), A_BLACKLIST)) {
+        if (blacklist_check(real_owner(player), real_owner(m->player)) &&
+            blacklist_check(real_owner(m->player), real_owner(player))) {
           continue;
         }
       }
     }
 
-    /* Add puppet indicator if needed */
-    if ((db[d->player].flags & PUPPET) && GoodObject(player) && (player != d->player)) {
-      output_str2 = tprintf("%s  [#%" DBREF_FMT "/%s]", output_str, db[player].owner,
-                           atr_get(db[player].owner, A_ALIAS));
-      output_str = output_str2;
+    /* Puppets get a tag naming the sender's owner */
+    puppet = (db[m->player].flags & PUPPET) && GoodObject(player) &&
+             (player != m->player);
+    personal = puppet || !notify_shareable(m->player) ||
+               (m->color_name && strcmp(m->color_name, chan->cname));
+
+    if (personal) {
+      /* Format the message with player's personalized color name */
+      output_str = m->color_name ?
+                   tprintf("[%s] %s", m->color_name, message) : base_str;
+
+      /* Add puppet indicator if needed */
+      if (puppet) {
+        output_str = tprintf("%s  [#%" DBREF_FMT "/%s]", output_str,
+                             db[player].owner, atr_get(db[player].owner, A_ALIAS));
+      }
     }
 
-    /* Add prefix/suffix */
-    output_str2 = add_pre_suf(d->player, 1, output_str, d->pueblo);
-    output_str = output_str2;
-
-    /* Apply color/beep filtering based on player preferences */
-    if (db[d->player].flags & PLAYER_NOBEEP) {
-      if (db[d->player].flags & PLAYER_ANSI) {
-        queue_string(d, parse_color_nobeep(output_str, d->pueblo));
-      } else {
-        queue_string(d, strip_color_nobeep(output_str));
-      }
-    } else {
-      if (db[d->player].flags & PLAYER_ANSI) {
-        queue_string(d, parse_color(output_str, d->pueblo));
+    for (d = player_descriptors(m->player); d; d = d->pnext) {
+      if (personal) {
+        queue_string(d, com_render(m->player, output_str, d->pueblo));
       } else {
-        queue_string(d, strip_color(output_str));
+        cls = notify_class(m->player, d->pueblo);
+        if (shared[cls]) {
+          render_cache_hits++;
+        } else {
+          shared[cls] = com_render(m->player, base_str, d->pueblo);
+          render_cache_misses++;
+        }
+        queue_string(d, shared[cls]);
       }
+      queue_string(d, "\n");
     }
-
-    queue_string(d, "\n");
-  } /* end for loop through descriptors */
+  } /* end for loop through listeners */
 } /* end com_send_int */
 
 /* ===================================================================
@@ -286,8 +299,8 @@ static void channel_who(dbref player, const char *channel)
     if ((could_doit(real_owner(d->player), real_owner(player), A_LHIDE))
         && (((!strlen(atr_get(real_owner(d->player), A_BLACKLIST))) &&
              (!strlen(atr_get(real_owner(player), A_BLACKLIST)))) ||
-            (!((could_doit(real_owner(player), real_owner(d->player), A_BLACKLIST)) &&
-               (could_doit(real_owner(d->player), real_owner(player), A_BLACKLIST)))))
+            (!((blacklist_check(real_owner(player), real_owner(d->player))) &&
+               (blacklist_check(real_owner(d->player), real_owner(player))))))
        ) {
       notify(player, tprintf("%s is on channel %s.",
                             unparse_object(player, d->player), channel));
@@ -1128,7 +1141,7 @@ void channel_owner(dbref player, char *arg2)
 
   /* Non-admin owners must pass the recipient's blacklist check */
   if (db[player].pows[0] < CLASS_DIR && !power(player, POW_CHANNEL)) {
-    if (!could_doit(real_owner(player), real_owner(target), A_BLACKLIST)) {
+    if (!blacklist_check(real_owner(player), real_owner(target))) {
       notify(player, "+channel: That player has blacklisted you.");
       return;
     }
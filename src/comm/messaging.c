@@ -1093,8 +1093,8 @@ void do_mail(dbref player, char *arg1, char *arg2)
             notify(player, "+mail: That player is page-locked against you.");
             return;
         }
-        if (!could_doit(real_owner(player), real_owner(recip), A_BLACKLIST) ||
-            !could_doit(real_owner(recip), real_owner(player), A_BLACKLIST)) {
+        if (!blacklist_check(real_owner(player), real_owner(recip)) ||
+            !blacklist_check(real_owner(recip), real_owner(player))) {
             notify(player, "+mail: There's a blacklist in effect.");
             return;
         }
@@ -52,7 +52,6 @@ static void send_idle_notification(dbref pager, dbref target)
     const char *idle_msg;
     const char *idle_cur;
     time_t idle_time;
-    int iterations = 0;
     
     /* Validate parameters */
     if (!GoodObject(pager) || !GoodObject(target)) {
@@ -67,13 +66,9 @@ static void send_idle_notification(dbref pager, dbref target)
         return;  /* No idle messages configured */
     }
     
-    /* Find target's descriptor to get idle time - with loop protection */
-    for (d = descriptor_list; d && (d->player != target) && (iterations < 1000); 
-         d = d->next, iterations++)
-        ;
-    
-    if (!d || iterations >= 1000) {
-        return;  /* Not connected or list corrupted */
+    /* Find target's descriptor to get idle time */
+    if (!(d = player_descriptors(target))) {
+        return;  /* Not connected */
     }
     
     /* Only send if player is actually idle */
@@ -412,8 +407,8 @@ int page_check(dbref receiver, dbref sender)
     }
 
     /* Check blacklist */
-    if (!could_doit(real_owner(sender), real_owner(receiver), A_BLACKLIST) ||
-        !could_doit(real_owner(receiver), real_owner(sender), A_BLACKLIST)) {
+    if (!blacklist_check(real_owner(sender), real_owner(receiver)) ||
+        !blacklist_check(real_owner(receiver), real_owner(sender))) {
         return 0;
     }
 
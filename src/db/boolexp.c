@@ -23,23 +23,25 @@
  * - More descriptive function and variable names
  *
  * MEMORY MANAGEMENT:
- * - Uses static buffers with proper bounds checking
- * - No dynamic allocations (all stack-based)
+ * - Locks are compiled once into a single allocation and cached by text
+ *   (see COMPILED LOCKS); locks with [functions] are compiled per use
+ * - Plain #dbref blacklists become sorted sets (see BLACKLIST SETS)
  * - Clear buffer size limits documented
  *
  * SECURITY NOTES:
- * - Lock evaluation is recursive - bool_depth limits recursion to 10
+ * - A single evaluation enters at most 10 lock levels
  * - All object references validated before access
  * - String buffers sized to BUFFER_LEN (from config.h)
- * - Pattern matching in test_atr() uses wild_match() which is safe
+ * - Attribute patterns are matched with wild_match()
  *
  * KNOWN LIMITATIONS:
  * - Maximum lock depth is 10 (prevents stack overflow)
  * - Lock strings limited to BUFFER_LEN (typically 8192 bytes)
- * - Static buffers mean functions are not thread-safe
+ * - Evaluation is reentrant; the lock cache itself is not thread-safe
  */
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "db.h"
@@ -83,36 +85,12 @@
 #define CARRY_TYPE 1  /* Possession: player must be carrying the object */
 #define _TYPE      2  /* Any: player is object, carries it, or in same zone */
 
-/* ===================================================================
- * STATIC VARIABLES
- * =================================================================== */
-
-/*
- * Lock evaluation context
- * 
- * These static variables maintain state during lock evaluation.
- * They are set by eval_boolexp() and used by recursive helper functions.
- * 
- * THREAD SAFETY: These static variables make this code not thread-safe.
- */
-static dbref parse_player;  /* Player being evaluated against the lock */
-static dbref parse_object;  /* Object whose lock is being evaluated */
-static dbref parse_zone;    /* Zone context for evaluation */
-static int bool_depth;      /* Recursion depth counter (max 10) */
-
 /* ===================================================================
  * FORWARD DECLARATIONS
  * =================================================================== */
 
-static int eval_boolexp1(dbref object, char *key, dbref zone);
-static int eval_boolexp_OR(char **buf);
-static int eval_boolexp_AND(char **buf);
-static int eval_boolexp_REF(char **buf);
 static int get_word(char *d, char **s);
 static dbref match_dbref(dbref player, char *name);
-static int test_atr(char **buf, dbref player, int ind);
-static int grab_num(char **buf);
-static dbref get_dbref(char **buf);
 static void eval_fun(char *buffer, char *str, dbref doer, dbref privs);
 
 /* ===================================================================
@@ -511,6 +489,592 @@ static void eval_fun(char *buffer, char *str, dbref doer, dbref privs)
   *buffer = '\0';
 }
 
+/* ===================================================================
+ * COMPILED LOCKS
+ * ===================================================================
+ *
+ * A lock is parsed once into a small tree (struct lock_node) and the
+ * tree is evaluated, instead of copying the key and re-running the
+ * recursive-descent parser on every check.  Compiled locks are kept in
+ * a direct-mapped cache keyed by the lock text, so a lock shared by many
+ * objects (inherited from a parent, say) is compiled once, and changing
+ * the attribute simply stops finding the old entry.  Keys containing
+ * [functions] still have to be expanded per evaluation; the expansion is
+ * compiled into a throwaway tree.
+ *
+ * The tree reproduces the old parser exactly, including its quirks:
+ * - '&' and '|' evaluate left first, then right, no short-circuit,
+ *   returning 0/1.
+ * - When an attribute test names an attribute that does not exist, is
+ *   dark, or cannot be seen, the old parser had already cut the text at
+ *   the ':'.  It then read the name as an object and ignored the rest of
+ *   the lock.  A failed @(obj=attr:pat) with a bad object or attribute
+ *   likewise ended the parse.  Nodes that can do this set ctx->stop,
+ *   and binary nodes return their left side without evaluating the
+ *   right.
+ *
+ * All evaluation state lives in a struct lock_ctx on the caller's stack,
+ * so a lock that runs softcode which evaluates another lock is safe.
+ */
+
+#define LOCK_CACHE_SIZE 1024    /* power of two */
+
+enum lock_op {
+  LK_CONST,                     /* Numeric literal */
+  LK_NOT,                       /* !a */
+  LK_AND,                       /* a & b */
+  LK_OR,                        /* a | b */
+  LK_REF,                       /* [=+]object */
+  LK_ATR,                       /* [=+]attr:pattern on the player */
+  LK_LOCK,                      /* @object or @(object) */
+  LK_INDATR                     /* @(object=attr:pattern) */
+};
+
+struct lock_node {
+  enum lock_op op;
+  int type;                     /* IS_TYPE/CARRY_TYPE/_TYPE (LK_REF/LK_ATR) */
+  int value;                    /* LK_CONST value; LK_LOCK: check visibility */
+  int a, b;                     /* Child node indexes */
+  size_t name;                  /* Object name (pool offset) */
+  dbref num;                    /* name as a plain #dbref, else NOTHING */
+  size_t atr;                   /* Attribute name (pool offset), or NOPOOL */
+  ATTR *builtin;                /* Resolved builtin attribute, if no '.' */
+  size_t pat;                   /* Pattern (pool offset) */
+};
+
+#define NOPOOL ((size_t)-1)
+
+struct lock_prog {
+  unsigned long hash;           /* Hash of text (cached locks) */
+  size_t len;                   /* strlen(text) */
+  char *text;                   /* Lock text this was compiled from */
+  unsigned int busy;            /* Evaluations in progress */
+  int orphaned;                 /* Evicted while busy: free on release */
+  int root;                     /* Root node index */
+  struct lock_node *nodes;
+  char *pool;                   /* NUL-terminated names and patterns */
+};
+
+/* Compiler state: counts on the first pass, fills on the second */
+struct lock_build {
+  const char *buf;              /* Parse position */
+  struct lock_node *nodes;      /* NULL while counting */
+  char *pool;
+  int nnodes;
+  size_t npool;
+};
+
+struct lock_ctx {
+  dbref player;                 /* Player being evaluated against the lock */
+  dbref object;                 /* Object whose lock is being evaluated */
+  dbref zone;                   /* Zone for evaluation context */
+  int depth;                    /* Lock levels entered (max 10) */
+  int stop;                     /* Old parser would have stopped reading */
+};
+
+static struct lock_prog *lock_cache[LOCK_CACHE_SIZE];
+unsigned long lock_cache_hits = 0;
+unsigned long lock_cache_misses = 0;
+
+static int lock_compile_OR(struct lock_build *b);
+static int lock_eval(struct lock_ctx *ctx, struct lock_prog *lp, int n);
+static int lock_eval_key(struct lock_ctx *ctx, dbref object, char *key);
+
+static int lock_new_node(struct lock_build *b, enum lock_op op)
+{
+  int n = b->nnodes++;
+
+  if (b->nodes) {
+    memset(&b->nodes[n], 0, sizeof(struct lock_node));
+    b->nodes[n].op = op;
+    b->nodes[n].a = b->nodes[n].b = -1;
+    b->nodes[n].num = NOTHING;
+    b->nodes[n].atr = NOPOOL;
+  }
+  return n;
+}
+
+/* Copy len bytes of s into the pool; returns its offset */
+static size_t lock_string(struct lock_build *b, const char *s, size_t len)
+{
+  size_t off = b->npool;
+
+  if (b->pool) {
+    memcpy(b->pool + off, s, len);
+    b->pool[off + len] = '\0';
+  }
+  b->npool += len + 1;
+  return off;
+}
+
+/* Object name up to the next delimiter (the old get_dbref() scan) */
+static void lock_name(struct lock_build *b, int n)
+{
+  const char *s;
+  size_t len;
+
+  for (s = b->buf; !RIGHT_DELIMITER(*s) && (*s != '='); s++)
+    ;
+  len = (size_t)(s - b->buf);
+  if (b->nodes) {
+    b->nodes[n].name = lock_string(b, b->buf, len);
+    if (*b->buf == NUMBER_TOKEN && len > 1 &&
+        strspn(b->buf + 1, "0123456789") == len - 1) {
+      b->nodes[n].num = parse_dbref(b->pool + b->nodes[n].name + 1);
+    }
+  } else {
+    lock_string(b, b->buf, len);
+  }
+  b->buf = s;
+}
+
+/*
+ * Attribute test text at b->buf: "attr:pattern".  Returns 0 with
+ * b->buf untouched if there is no ':' (not an attribute test).
+ */
+static int lock_attr(struct lock_build *b, int n)
+{
+  const char *s, *colon;
+
+  for (s = b->buf; !RIGHT_DELIMITER(*s) || (*s == '.'); s++)
+    ;
+  if (*s != ':') {
+    return 0;
+  }
+  colon = s;
+
+  if (b->nodes) {
+    b->nodes[n].atr = lock_string(b, b->buf, (size_t)(colon - b->buf));
+    if (!memchr(b->buf, '.', (size_t)(colon - b->buf))) {
+      b->nodes[n].builtin = builtin_atr_str(b->pool + b->nodes[n].atr);
+    }
+  } else {
+    lock_string(b, b->buf, (size_t)(colon - b->buf));
+  }
+
+  for (s = colon + 1; *s && (*s != AND_TOKEN) && (*s != OR_TOKEN) &&
+       (*s != ')'); s++)
+    ;
+  if (b->nodes) {
+    b->nodes[n].pat = lock_string(b, colon + 1, (size_t)(s - colon - 1));
+  } else {
+    lock_string(b, colon + 1, (size_t)(s - colon - 1));
+  }
+  b->buf = s;
+  return 1;
+}
+
+static int lock_compile_REF(struct lock_build *b)
+{
+  int n, type;
+  const char *s, *start;
+
+  switch (*b->buf)
+  {
+  case '(':
+    b->buf++;
+    n = lock_compile_OR(b);
+    if (*b->buf == ')')
+      b->buf++;
+    return n;
+
+  case NOT_TOKEN:
+    b->buf++;
+    n = lock_new_node(b, LK_NOT);
+    type = lock_compile_REF(b);
+    if (b->nodes)
+      b->nodes[n].a = type;
+    return n;
+
+  case AT_TOKEN:
+    b->buf++;
+    if (*b->buf == '(')
+    {
+      b->buf++;
+      start = b->buf;
+      for (s = start; !RIGHT_DELIMITER(*s) && (*s != '='); s++)
+        ;
+      if (*s != '=') {
+        /* @(obj): obj's lock, no visibility check; ')' is left unread */
+        n = lock_new_node(b, LK_LOCK);
+        lock_name(b, n);
+        return n;
+      }
+      n = lock_new_node(b, LK_INDATR);
+      lock_name(b, n);
+      b->buf++;                           /* '=' */
+      if (!lock_attr(b, n)) {
+        /* No ':' -- always false, the text is read again as operators */
+        if (b->nodes)
+          b->nodes[n].pat = NOPOOL;
+      }
+      if (*b->buf == ')')
+        b->buf++;
+      return n;
+    }
+    n = lock_new_node(b, LK_LOCK);
+    if (b->nodes)
+      b->nodes[n].value = 1;
+    lock_name(b, n);
+    return n;
+
+  default:
+    switch (*b->buf)
+    {
+    case IS_TOKEN:
+      type = IS_TYPE;
+      b->buf++;
+      break;
+    case CARRY_TOKEN:
+      type = CARRY_TYPE;
+      b->buf++;
+      break;
+    default:
+      type = _TYPE;
+    }
+
+    if (isdigit((unsigned char)*b->buf)) {
+      n = lock_new_node(b, LK_CONST);
+      if (b->nodes)
+        b->nodes[n].value = (int)strtol(b->buf, NULL, 10);
+      while (isdigit((unsigned char)*b->buf))
+        b->buf++;
+      return n;
+    }
+
+    n = lock_new_node(b, LK_REF);
+    if (b->nodes)
+      b->nodes[n].type = type;
+
+    start = b->buf;
+    if (lock_attr(b, n)) {
+      /* If the attribute turns out bad, the old parser read the part
+       * before ':' as an object name instead (see lock_eval()). */
+      const char *after = b->buf;
+
+      b->buf = start;
+      lock_name(b, n);
+      b->buf = after;
+      if (b->nodes)
+        b->nodes[n].op = LK_ATR;
+      return n;
+    }
+    lock_name(b, n);
+    return n;
+  }
+}
+
+static int lock_compile_AND(struct lock_build *b)
+{
+  int left, n;
+
+  left = lock_compile_REF(b);
+  if (*b->buf != AND_TOKEN)
+    return left;
+  b->buf++;
+  n = lock_new_node(b, LK_AND);
+  if (b->nodes)
+    b->nodes[n].a = left;
+  left = lock_compile_AND(b);
+  if (b->nodes)
+    b->nodes[n].b = left;
+  return n;
+}
+
+static int lock_compile_OR(struct lock_build *b)
+{
+  int left, n;
+
+  left = lock_compile_AND(b);
+  if (*b->buf != OR_TOKEN)
+    return left;
+  b->buf++;
+  n = lock_new_node(b, LK_OR);
+  if (b->nodes)
+    b->nodes[n].a = left;
+  left = lock_compile_OR(b);
+  if (b->nodes)
+    b->nodes[n].b = left;
+  return n;
+}
+
+/**
+ * lock_compile - Compile lock text into a single allocation
+ *
+ * @param key Lock text (not modified)
+ * Runs the parser twice: once to size the nodes and string pool, then
+ * again to fill them in.  The caller owns the result (see lock_release()).
+ *
+ * @param key Lock text
+ * @return Compiled lock
+ */
+static struct lock_prog *lock_compile(const char *key)
+{
+  struct lock_build b;
+  struct lock_prog *lp;
+  size_t len = strlen(key);
+  char *temp;
+
+  memset(&b, 0, sizeof(b));
+  b.buf = key;
+  lock_compile_OR(&b);
+
+  SAFE_MALLOC(temp, char, sizeof(struct lock_prog) +
+              (size_t)b.nnodes * sizeof(struct lock_node) + b.npool + len + 1);
+  lp = (struct lock_prog *)temp;
+  lp->nodes = (struct lock_node *)(temp + sizeof(struct lock_prog));
+  lp->pool = (char *)&lp->nodes[b.nnodes];
+  lp->text = lp->pool + b.npool;
+  memcpy(lp->text, key, len + 1);
+  lp->len = len;
+  lp->hash = 0;
+  lp->busy = 0;
+  lp->orphaned = 0;
+
+  b.buf = key;
+  b.nodes = lp->nodes;
+  b.pool = lp->pool;
+  b.nnodes = 0;
+  b.npool = 0;
+  lp->root = lock_compile_OR(&b);
+
+  return lp;
+}
+
+/* Drop one pin; an evicted or throwaway lock is freed with its last pin */
+static void lock_release(struct lock_prog *lp)
+{
+  if (lp->busy) {
+    lp->busy--;
+  }
+  if (!lp->busy && lp->orphaned) {
+    SAFE_FREE(lp);
+  }
+}
+
+static unsigned long lock_hash(const char *s, size_t *len)
+{
+  unsigned long h = 2166136261UL;
+  const char *p;
+
+  for (p = s; *p; p++) {
+    h = (h ^ (unsigned char)*p) * 16777619UL;
+  }
+  *len = (size_t)(p - s);
+  return h;
+}
+
+/**
+ * lock_lookup - Cached compiled form of key, compiling on a miss
+ *
+ * The result is pinned; release it with lock_release().
+ */
+static struct lock_prog *lock_lookup(const char *key)
+{
+  struct lock_prog *lp, **slot;
+  unsigned long h;
+  size_t len;
+
+  h = lock_hash(key, &len);
+  slot = &lock_cache[(h ^ (h >> 15)) & (LOCK_CACHE_SIZE - 1)];
+  lp = *slot;
+  if (lp && lp->hash == h && lp->len == len && !memcmp(lp->text, key, len)) {
+    lock_cache_hits++;
+    lp->busy++;
+    return lp;
+  }
+
+  lock_cache_misses++;
+  if (lp) {
+    /* Evict; a lock still being evaluated is freed when it finishes */
+    lp->orphaned = 1;
+    lp->busy++;
+    lock_release(lp);
+  }
+  lp = lock_compile(key);
+  lp->hash = h;
+  *slot = lp;
+  lp->busy++;
+  return lp;
+}
+
+/* ===================================================================
+ * COMPILED LOCK EVALUATION
+ * =================================================================== */
+
+/**
+ * lock_object - Resolve an object name in a lock
+ *
+ * Plain #dbrefs skip the matcher; anything else is matched from the
+ * point of view of the object carrying the lock.
+ */
+static dbref lock_object(struct lock_ctx *ctx, struct lock_prog *lp,
+                         struct lock_node *node)
+{
+  if (!GoodObject(ctx->object))
+    return NOTHING;
+  if (node->num != NOTHING && GoodObject(node->num))
+    return node->num;
+
+  init_match(ctx->object, lp->pool + node->name, NOTYPE);
+  match_everything();
+  return match_result();
+}
+
+/**
+ * lock_attr_test - attr:pattern against thing
+ *
+ * @param ind Indirect (@(obj=...)) test: also requires can_see_atr()
+ * @return -1 if the attribute is missing, dark or hidden; else 0/1
+ */
+static int lock_attr_test(struct lock_ctx *ctx, struct lock_prog *lp,
+                          struct lock_node *node, dbref thing, int ind)
+{
+  ATTR *attr;
+
+  if (!GoodObject(thing))
+    return -1;
+
+  attr = node->builtin;
+  if (!attr && memchr(lp->pool + node->atr, '.',
+                      strlen(lp->pool + node->atr)))
+    attr = atr_str(thing, NOTHING, lp->pool + node->atr);
+
+  if (!attr || (attr->flags & AF_DARK) ||
+      (ind && !can_see_atr(ctx->object, thing, attr)))
+    return -1;
+
+  return wild_match(lp->pool + node->pat, atr_get(thing, attr)) ? 1 : 0;
+}
+
+static int lock_eval(struct lock_ctx *ctx, struct lock_prog *lp, int n)
+{
+  struct lock_node *node = &lp->nodes[n];
+  dbref thing;
+  int left, right;
+
+  switch (node->op)
+  {
+  case LK_CONST:
+    return node->value;
+
+  case LK_NOT:
+    return !lock_eval(ctx, lp, node->a);
+
+  case LK_AND:
+  case LK_OR:
+    left = lock_eval(ctx, lp, node->a);
+    if (ctx->stop)
+      return left;
+    right = lock_eval(ctx, lp, node->b);
+    if (node->op == LK_AND)
+      return (right && left);
+    return (right || left);
+
+  case LK_LOCK:
+    thing = lock_object(ctx, lp, node);
+    if (!GoodObject(thing))
+      return 0;
+    if (node->value && !can_see_atr(ctx->object, thing, A_LOCK))
+      return 0;
+    return lock_eval_key(ctx, thing, atr_get(thing, A_LOCK));
+
+  case LK_INDATR:
+    thing = lock_object(ctx, lp, node);
+    if (!GoodObject(thing)) {
+      ctx->stop = 1;
+      return 0;
+    }
+    if (node->pat == NOPOOL)
+      return 0;
+    if ((left = lock_attr_test(ctx, lp, node, thing, 1)) == -1) {
+      ctx->stop = 1;
+      return 0;
+    }
+    return left;
+
+  case LK_ATR:
+    if ((left = lock_attr_test(ctx, lp, node, ctx->player, 0)) != -1)
+      return left;
+    /* Bad attribute: the text before ':' names an object, and the
+     * rest of the lock is never read. */
+    ctx->stop = 1;
+    /* FALLTHROUGH */
+
+  case LK_REF:
+    if ((thing = lock_object(ctx, lp, node)) < (dbref) 0)
+      return 0;
+    if (!GoodObject(thing))
+      return 0;
+
+    switch (node->type)
+    {
+    case IS_TYPE:
+      return (ctx->player == thing) ? 1 : 0;
+
+    case CARRY_TYPE:
+      if (!GoodObject(ctx->player))
+        return 0;
+      return member(thing, db[ctx->player].contents);
+
+    case _TYPE:
+      if (!GoodObject(ctx->player))
+        return 0;
+      return ((ctx->player == thing) ||
+              (member(thing, db[ctx->player].contents)) ||
+              (ctx->zone == thing));
+
+    default:
+      return 0;
+    }
+  }
+  return 0;
+}
+
+/**
+ * lock_eval_key - Evaluate one lock level (the old eval_boolexp1)
+ *
+ * @param object Object whose lock text key is (privileges for [functions])
+ * @return Lock result
+ */
+static int lock_eval_key(struct lock_ctx *ctx, dbref object, char *key)
+{
+  char buffer[BUFFER_LEN];
+  struct lock_prog *lp;
+  int result, stop;
+
+  if (!key || !*key)
+    return 1;
+
+  if (ctx->depth++ >= 10)
+  {
+    if (GoodObject(ctx->object) && GoodObject(db[ctx->object].owner)) {
+      notify(db[ctx->object].owner,
+             tprintf("Warning: recursion detected in %s lock.",
+                     unparse_object(db[ctx->object].owner, object)));
+    }
+    return 0;
+  }
+
+  stop = ctx->stop;
+  ctx->stop = 0;
+  if (strchr(key, '['))
+  {
+    /* Functions make the text differ per evaluation: don't cache */
+    eval_fun(buffer, key, ctx->player, object);
+    lp = lock_compile(buffer);
+    lp->busy++;
+    lp->orphaned = 1;
+  }
+  else
+    lp = lock_lookup(key);
+
+  result = lock_eval(ctx, lp, lp->root);
+  lock_release(lp);
+  ctx->stop = stop;
+  return result;
+}
+
 /* ===================================================================
  * BOOLEAN EXPRESSION EVALUATION
  * =================================================================== */
@@ -529,11 +1093,10 @@ static void eval_fun(char *buffer, char *str, dbref doer, dbref privs)
  * 
  * SECURITY:
  * - Validates player, object, and zone with GoodObject()
- * - Limits recursion to 10 levels (bool_depth)
+ * - Limits recursion to 10 levels
  * - Checks lock length against BUFFER_LEN
- * - Copies lock to local buffer to prevent modification
  * 
- * THREAD SAFETY: Uses static variables, not thread-safe
+ * Reentrant: all evaluation state is local to this call.
  * 
  * @param player Player being evaluated against the lock
  * @param object Object with the lock
@@ -543,17 +1106,8 @@ static void eval_fun(char *buffer, char *str, dbref doer, dbref privs)
  */
 int eval_boolexp(dbref player, dbref object, char *key, dbref zone)
 {
-  static char keybuf[BUFFER_LEN];
-  size_t keylen;
+  struct lock_ctx ctx;
 
-  /* Initialize recursion counter */
-  bool_depth = 0;
-  
-  /* Set up evaluation context */
-  parse_player = player;
-  parse_object = object;
-  parse_zone = zone;
-  
   /* Validate object */
   if (!GoodObject(object)) {
     log_error(tprintf("eval_boolexp: Invalid object %" DBREF_FMT, object));
@@ -565,10 +1119,9 @@ int eval_boolexp(dbref player, dbref object, char *key, dbref zone)
     return 1;
   
   /* Check lock length */
-  keylen = strlen(key);
-  if (keylen >= BUFFER_LEN)
+  if (strlen(key) >= BUFFER_LEN)
   {
-    if (GoodObject(object) && GoodObject(db[object].owner)) {
+    if (GoodObject(db[object].owner)) {
       notify(db[object].owner,
              tprintf("Warning: lock too long on %s", 
                      unparse_object(db[object].owner, object)));
@@ -576,400 +1129,230 @@ int eval_boolexp(dbref player, dbref object, char *key, dbref zone)
     return 0;
   }
   
-  /* Copy lock to local buffer */
-  strncpy(keybuf, key, sizeof(keybuf) - 1);
-  keybuf[sizeof(keybuf) - 1] = '\0';
+  /* Set up evaluation context */
+  ctx.player = player;
+  ctx.object = object;
+  ctx.zone = zone;
+  ctx.depth = 0;
+  ctx.stop = 0;
   
-  /* Evaluate the lock */
-  return eval_boolexp1(object, keybuf, zone);
+  return lock_eval_key(&ctx, object, key);
 }
 
-/**
- * eval_boolexp1 - Internal recursive boolean expression evaluator
- * 
- * Handles one level of lock evaluation, including function expansion
- * and recursion control.
- * 
- * SECURITY:
- * - Limits recursion to 10 levels to prevent stack overflow
- * - Validates object with GoodObject()
- * - Uses local buffer for function evaluation
- * 
- * @param object Object with the lock
- * @param key Lock string to evaluate (modifiable buffer)
- * @param zone Zone for evaluation
- * @return 1 if lock passes, 0 if it fails
+/* ===================================================================
+ * BLACKLIST SETS
+ * ===================================================================
+ *
+ * A_BLACKLIST is consulted for every message a player might receive,
+ * and in practice it is almost always a list of players: "!#12&!#34"
+ * (everyone but these) or "#12|#34" (only these).  Such a lock is
+ * turned into a sorted array of dbrefs the first time it is checked,
+ * hung off the player, and answered with a binary search from then on.
+ * Anything else -- attribute tests, indirect locks, [functions], names
+ * instead of #dbrefs, mixed forms -- is remembered as such and goes to
+ * could_doit() as before.
+ *
+ * The set keeps a copy of the text it was built from and is rebuilt
+ * when atr_get() (inheritance included) returns something different.
  */
-static int eval_boolexp1(dbref object, char *key, dbref zone)
+
+#define BL_EVAL  0              /* Not a plain list: use the lock engine */
+#define BL_ALLOW 1              /* Passes if any entry matches */
+#define BL_DENY  2              /* Passes unless an entry matches */
+
+struct blacklist_set {
+  char *text;                   /* A_BLACKLIST value this was built from */
+  int kind;                     /* BL_* */
+  int type;                     /* IS_TYPE/CARRY_TYPE/_TYPE of every entry */
+  size_t count;                 /* Entries in ent[] */
+  dbref ent[];                  /* Sorted; followed by the text */
+};
+
+unsigned long blacklist_builds = 0;
+
+/*
+ * blacklist_walk - Collect the #dbrefs of lock node n
+ *
+ * Succeeds if the subtree, read with polarity neg, is an OR of entries
+ * (*deny 0) or an AND of negated entries (*deny 1).  An OR node
+ * (or AND under a NOT) joins alternatives; an entry must appear with the
+ * same polarity as the join.  *deny and *type start at -1 and are fixed
+ * by the first node that decides them.
+ */
+static int blacklist_walk(struct lock_prog *lp, int n, int neg, int *deny,
+                          int *type, struct blacklist_set *bs)
 {
-  char buffer[BUFFER_LEN];
-  char *buf;
+  struct lock_node *node = &lp->nodes[n];
+  int want;
 
-  /* Empty key always passes */
-  if (!*key)
-    return 1;
-  
-  /* Check recursion depth */
-  if (++bool_depth > 10)
+  switch (node->op)
   {
-    if (GoodObject(parse_object) && GoodObject(db[parse_object].owner)) {
-      notify(db[parse_object].owner,
-             tprintf("Warning: recursion detected in %s lock.",
-                     unparse_object(db[parse_object].owner, object)));
-    }
+  case LK_NOT:
+    return blacklist_walk(lp, node->a, !neg, deny, type, bs);
+
+  case LK_OR:
+  case LK_AND:
+    want = (node->op == LK_OR) ? neg : !neg;
+    if (*deny == -1)
+      *deny = want;
+    if (*deny != want)
+      return 0;
+    return blacklist_walk(lp, node->a, neg, deny, type, bs) &&
+           blacklist_walk(lp, node->b, neg, deny, type, bs);
+
+  case LK_REF:
+    if (node->num == NOTHING)
+      return 0;
+    if (*deny == -1)
+      *deny = neg;
+    if (*type == -1)
+      *type = node->type;
+    if (*deny != neg || *type != node->type)
+      return 0;
+    bs->ent[bs->count++] = node->num;
+    return 1;
+
+  default:
     return 0;
   }
-  
-  /* Evaluate any functions in the key */
-  eval_fun(buffer, key, parse_player, object);
-  buf = buffer;
-  
-  /* Evaluate the boolean expression */
-  return eval_boolexp_OR(&buf);
 }
 
-/**
- * eval_boolexp_OR - Evaluate OR operations in boolean expression
- * 
- * Handles the | (OR) operator. OR expressions are left-associative
- * and short-circuit (if left is true, right is not evaluated).
- * 
- * Grammar: OR_expr := AND_expr ('|' OR_expr)?
- * 
- * @param buf Pointer to buffer pointer (advanced by function)
- * @return Boolean result (1 = true, 0 = false)
+static int blacklist_cmp(const void *a, const void *b)
+{
+  dbref x = *(const dbref *)a, y = *(const dbref *)b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * blacklist_build - Compile text into a set (or a BL_EVAL marker)
  */
-static int eval_boolexp_OR(char **buf)
+static struct blacklist_set *blacklist_build(const char *text)
 {
-  int left;
+  struct blacklist_set *bs;
+  struct lock_prog *lp;
+  size_t len = strlen(text), max = len / 2 + 1;
+  int deny = -1, type = -1;
+  char *temp;
 
-  /* Evaluate the left side (AND expression) */
-  left = eval_boolexp_AND(buf);
-  
-  /* Check for OR operator */
-  if (**buf == OR_TOKEN)
-  {
-    (*buf)++;
-    /* Short-circuit OR: if left is true, return true without evaluating right */
-    /* Note: This implementation evaluates right anyway for historical reasons */
-    return (eval_boolexp_OR(buf) || left);
+  /* Every entry takes at least two characters ("#1") */
+  SAFE_MALLOC(temp, char, sizeof(struct blacklist_set) +
+              max * sizeof(dbref) + len + 1);
+  bs = (struct blacklist_set *)temp;
+  bs->text = (char *)&bs->ent[max];
+  memcpy(bs->text, text, len + 1);
+  bs->kind = BL_EVAL;
+  bs->type = _TYPE;
+  bs->count = 0;
+  blacklist_builds++;
+
+  if (len >= BUFFER_LEN || strchr(text, '['))
+    return bs;
+
+  lp = lock_lookup(text);
+  if (blacklist_walk(lp, lp->root, 0, &deny, &type, bs)) {
+    bs->kind = deny ? BL_DENY : BL_ALLOW;
+    bs->type = type;
+    qsort(bs->ent, bs->count, sizeof(dbref), blacklist_cmp);
   }
-  else
-    return left;
+  lock_release(lp);
+  return bs;
 }
 
-/**
- * eval_boolexp_AND - Evaluate AND operations in boolean expression
- * 
- * Handles the & (AND) operator. AND expressions are left-associative
- * and short-circuit (if left is false, right is not evaluated).
- * 
- * Grammar: AND_expr := REF_expr ('&' AND_expr)?
- * 
- * @param buf Pointer to buffer pointer (advanced by function)
- * @return Boolean result (1 = true, 0 = false)
- */
-static int eval_boolexp_AND(char **buf)
+static int blacklist_has(struct blacklist_set *bs, dbref x)
 {
-  int left;
+  size_t lo = 0, hi = bs->count, mid;
 
-  /* Evaluate the left side (reference/atom) */
-  left = eval_boolexp_REF(buf);
-  
-  /* Check for AND operator */
-  if (**buf == AND_TOKEN)
-  {
-    (*buf)++;
-    /* Short-circuit AND: if left is false, return false without evaluating right */
-    /* Note: This implementation evaluates right anyway for historical reasons */
-    return (eval_boolexp_AND(buf) && left);
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (bs->ent[mid] == x)
+      return 1;
+    if (bs->ent[mid] < x)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
-  else
-    return left;
+  return 0;
 }
 
-/**
- * test_atr - Test an attribute against a pattern
- * 
- * Checks if an object's attribute matches a given pattern. Used for
- * attribute checks in locks like "name:value" or "#123.attr:value".
- * 
- * SECURITY:
- * - Validates player with GoodObject() (via parse_object)
- * - Respects attribute visibility (AF_DARK flag)
- * - Respects can_see_atr() permissions for indirect checks
- * - Uses wild_match() for safe pattern matching
- * 
- * @param buf Pointer to buffer pointer (advanced by function)
- * @param player Object to check attribute on
- * @param ind Indirect flag (1 = check visibility, 0 = always visible)
- * @return -1 on error, 0 if no match, 1 if match
+/*
+ * blacklist_matches - Does any entry in bs match player?
+ *
+ * Same test as an LK_REF node per entry: being it (IS_TYPE), carrying
+ * it (CARRY_TYPE) or either of those or being zoned to it (_TYPE).
  */
-static int test_atr(char **buf, dbref player, int ind)
+static int blacklist_matches(struct blacklist_set *bs, dbref player)
 {
-  ATTR *attr;
-  int result;
-  char *s;
-  char save;
+  dbref thing;
 
-  /* Validate player */
-  if (!GoodObject(player))
-    return -1;
+  if (bs->type != CARRY_TYPE && blacklist_has(bs, player))
+    return 1;
+  if (bs->type == IS_TYPE)
+    return 0;
 
-  /* Find the colon that separates attribute name from pattern */
-  for (s = *buf; !RIGHT_DELIMITER(*s) || (*s == '.'); s++)
-    ;
-  
-  /* Must have a colon */
-  if (!*s || (*s != ':'))
-    return -1;
-  
-  /* Temporarily null-terminate the attribute name */
-  *s++ = '\0';
-  
-  /* Look up the attribute */
-  if (strchr(*buf, '.'))
-    attr = atr_str(player, NOTHING, *buf);
-  else
-    attr = builtin_atr_str(*buf);
-  
-  /* Check if attribute exists and is visible */
-  if (!(attr) || (attr->flags & AF_DARK) ||
-      ((ind) && !can_see_atr(parse_object, player, attr)))
-    return -1;
-  
-  /* Find the end of the pattern (next operator) */
-  for (*buf = s; *s && (*s != AND_TOKEN) && (*s != OR_TOKEN) && (*s != ')'); s++)
-    ;
-  
-  /* Temporarily null-terminate the pattern */
-  save = *s;
-  *s = '\0';
-  
-  /* Match the attribute value against the pattern */
-  result = wild_match(*buf, atr_get(player, attr));
-  
-  /* Restore the character */
-  *s = save;
-  *buf = s;
-  
-  return result;
+  DOLIST(thing, db[player].contents) {
+    if (!GoodObject(thing))
+      break;
+    if (blacklist_has(bs, thing))
+      return 1;
+  }
+
+  return bs->type == _TYPE && blacklist_has(bs, get_zone_first(player));
 }
 
 /**
- * grab_num - Extract a number from the buffer
- * 
- * Parses an integer from the current position in the buffer.
- * Used for numeric literal tests in locks.
- * 
- * @param buf Pointer to buffer pointer (advanced by function)
- * @return Extracted integer value
+ * blacklist_free - Drop thing's compiled blacklist
+ *
+ * @param thing Object whose set to free
  */
-static int grab_num(char **buf)
+void blacklist_free(dbref thing)
 {
-  char *s;
-  char save;
-  int num;
-
-  /* Find the end of the number */
-  for (s = *buf; *s && isdigit((unsigned char)*s); s++)
-    ;
-  
-  /* Temporarily null-terminate */
-  save = *s;
-  *s = '\0';
-  
-  /* Convert to integer */
-  num = (int)strtol(*buf, NULL, 10);
-  
-  /* Restore and advance */
-  *s = save;
-  *buf = s;
-  
-  return num;
+  if (!GoodObject(thing) || !db[thing].blacklist)
+    return;
+  SAFE_FREE(db[thing].blacklist);
+  db[thing].blacklist = NULL;
 }
 
 /**
- * get_dbref - Extract a database reference from the buffer
- * 
- * Matches an object name/reference and returns its dbref.
- * Used when a lock references an object.
- * 
- * SECURITY: Uses match_result() which may return NOTHING or AMBIGUOUS
- * 
- * @param buf Pointer to buffer pointer (advanced by function)
- * @return Database reference, NOTHING, or AMBIGUOUS
+ * blacklist_check - could_doit(player, thing, A_BLACKLIST), from the
+ *                   compiled set when thing's blacklist is a plain list
+ *
+ * @param player Player being tested
+ * @param thing Owner of the blacklist
+ * @return 1 if player passes thing's blacklist lock, else 0
  */
-static dbref get_dbref(char **buf)
+int blacklist_check(dbref player, dbref thing)
 {
-  char *s;
-  char save;
-  dbref temp;
+  struct blacklist_set *bs;
+  char *text;
 
-  /* Find the end of the reference */
-  for (s = *buf; !RIGHT_DELIMITER(*s) && (*s != '='); s++)
-    ;
-  
-  /* Temporarily null-terminate */
-  save = *s;
-  *s = '\0';
-  
-  /* Match the object (only if parse_object is valid) */
-  if (GoodObject(parse_object)) {
-    init_match(parse_object, *buf, NOTYPE);
-    match_everything();
-    temp = match_result();
-  } else {
-    temp = NOTHING;
+  if (!GoodObject(player) || !GoodObject(thing) ||
+      Typeof(thing) != TYPE_PLAYER) {
+    return could_doit(player, thing, A_BLACKLIST);
   }
-  
-  /* Restore and advance */
-  *s = save;
-  *buf = s;
-  
-  return temp;
-}
 
-/**
- * eval_boolexp_REF - Evaluate references (atoms) in boolean expressions
- * 
- * Handles the atomic elements of boolean expressions:
- * - Parenthesized sub-expressions: (expr)
- * - NOT operator: !expr
- * - Indirect locks: @obj or @(obj=attr)
- * - Attribute tests: attr:pattern
- * - Object references: #123, player, *wizard
- * - Type prefixes: = (is), + (carries)
- * - Numeric literals: 0, 1, etc.
- * 
- * SECURITY:
- * - Validates all object references with GoodObject()
- * - Checks can_see_atr() for indirect lock visibility
- * - Handles invalid objects gracefully (returns 0)
- * 
- * @param buf Pointer to buffer pointer (advanced by function)
- * @return Boolean result (1 = true, 0 = false)
- */
-static int eval_boolexp_REF(char **buf)
-{
-  dbref thing;
-  int type, t;
+  /* could_doit() fails players who are nowhere */
+  if (db[thing].location == NOTHING)
+    return 0;
+
+  text = atr_get(thing, A_BLACKLIST);
+  if (!*text)
+    return 1;
 
-  switch (**buf)
+  bs = db[thing].blacklist;
+  if (!bs || strcmp(bs->text, text)) {
+    blacklist_free(thing);
+    bs = db[thing].blacklist = blacklist_build(text);
+  }
+
+  switch (bs->kind)
   {
-  case '(':
-    /* Parenthesized sub-expression */
-    (*buf)++;
-    t = eval_boolexp_OR(buf);
-    if (**buf == ')')
-      (*buf)++;
-    return t;
-    
-  case NOT_TOKEN:
-    /* NOT operator */
-    (*buf)++;
-    return !eval_boolexp_REF(buf);
-    
-  case AT_TOKEN:
-    /* Indirect lock: @obj or @(obj=attr) */
-    (*buf)++;
-    if (**buf == '(')
-    {
-      /* @(obj=attr): Indirect attribute test */
-      (*buf)++;
-      thing = get_dbref(buf);
-      
-      if (!GoodObject(thing))
-        return 0;
-      
-      if (**buf != '=') {
-        /* @(obj): Evaluate obj's lock */
-        return eval_boolexp1(thing, atr_get(thing, A_LOCK), parse_zone);
-      }
-      
-      /* @(obj=attr): Test if player passes attribute pattern */
-      (*buf)++;
-      t = test_atr(buf, thing, 1);
-      if (**buf == ')')
-        (*buf)++;
-      return (t == -1) ? 0 : t;
-    }
-    
-    /* @obj: Simple indirect lock */
-    thing = get_dbref(buf);
-    
-    if (!GoodObject(thing))
-      return 0;
-    
-    /* Check if we can see the lock attribute */
-    if (can_see_atr(parse_object, thing, A_LOCK))
-    {
-      return eval_boolexp1(thing, atr_get(thing, A_LOCK), parse_zone);
-    }
-    else
-      return 0;
-      
+  case BL_ALLOW:
+    return blacklist_matches(bs, player);
+  case BL_DENY:
+    return !blacklist_matches(bs, player);
   default:
-    /* Check for type prefix */
-    switch (**buf)
-    {
-    case IS_TOKEN:
-      /* = prefix: exact match (player must be the object) */
-      type = IS_TYPE;
-      (*buf)++;
-      break;
-      
-    case CARRY_TOKEN:
-      /* + prefix: possession (player must carry the object) */
-      type = CARRY_TYPE;
-      (*buf)++;
-      break;
-      
-    default:
-      /* No prefix: any match (player is, carries, or in same zone) */
-      type = _TYPE;
-    }
-    
-    /* Check for numeric literal */
-    if (isdigit((unsigned char)**buf))
-      return grab_num(buf);
-    
-    /* Try attribute test first */
-    if ((t = test_atr(buf, parse_player, 0)) != -1)
-      return t;
-    
-    /* Must be an object reference */
-    if ((thing = get_dbref(buf)) < (dbref) 0)
-      return 0;
-    
-    /* Validate the object exists */
-    if (!GoodObject(thing))
-      return 0;
-    
-    /* Apply the type test */
-    switch (type)
-    {
-    case IS_TYPE:
-      /* = : player must be exactly this object */
-      return (parse_player == thing) ? 1 : 0;
-      
-    case CARRY_TYPE:
-      /* + : player must be carrying this object */
-      if (!GoodObject(parse_player))
-        return 0;
-      return member(thing, db[parse_player].contents);
-      
-    case _TYPE:
-      /* No prefix: player is object, carries it, or in same zone */
-      if (!GoodObject(parse_player))
-        return 0;
-      return ((parse_player == thing) ||
-              (member(thing, db[parse_player].contents)) ||
-              (parse_zone == thing));
-      
-    default:
-      return 0;
-    }
+    return could_doit(player, thing, A_BLACKLIST);
   }
 }
 
@@ -61,6 +61,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #define __DO_DB_C__
 #include "db.h"
@@ -125,6 +126,9 @@ dbref db_size = 100;
 extern char ccom[];
 extern long epoch;
 
+/* Values that game.c compiles into an object's command index */
+#define CMD_VALUE(s) (*(s) == '$' || *(s) == '!' || *(s) == '^')
+
 /* Single attribute cache for performance */
 static dbref atr_obj = -1;
 static ATTR *atr_atr = NULL;
@@ -145,6 +149,11 @@ int dozonetemp;
  * ============================================================================ */
 
 static ALIST *AL_MAKE(ATTR *type, ALIST *next, char *string);
+static ALIST *atr_find(dbref thing, ATTR *atr);
+static void atr_index_drop(dbref thing);
+static void atr_index_put(dbref thing, ALIST *al);
+static void atr_index_del(dbref thing, ATTR *atr);
+static void inh_cache_forget(dbref thing, ATTR *atr, int levels);
 static dbref *getlist(FILE *f);
 static void putlist(FILE *f, dbref *list);
 static int db_read_object(dbref i, FILE *f);
@@ -913,6 +922,7 @@ static int db_read_object(dbref i, FILE *f)
         
         /* Read object data */
         o = db + i;
+        atr_index_drop(i);
         o->list = NULL;
         getstring(f, o->name);
         s_Desc(i, getstring_noalloc(f));
@@ -1006,6 +1016,7 @@ static int db_read_object(dbref i, FILE *f)
             }
         }
         
+        atr_index_drop(i);
         o->list = NULL;
         
         if (db_version <= 8)
@@ -1098,8 +1109,6 @@ static int db_read_object(dbref i, FILE *f)
                 dbref j;
                 char buf[64];
                 
-                atr_add(root, A_QUEUE, "-999999");
-                
                 for (j = 0; j < db_top; j++) {
                     if ((db[j].flags & TYPE_MASK) >= TYPE_PLAYER) {
                         snprintf(buf, sizeof(buf), "#%" DBREF_FMT, j);
@@ -1523,6 +1532,167 @@ static ALIST *AL_MAKE(ATTR *type, ALIST *next, char *string)
     return ptr;
 }
 
+/* ============================================================================
+ * ATTRIBUTE INDEX
+ * ============================================================================
+ * Objects whose list is longer than ATR_INDEX_MIN get a struct atr_index,
+ * built lazily by the first lookup that has to walk that far.  atr_add()
+ * and atr_clr() keep it in step; anything that rebuilds or frees the list
+ * just drops it.
+ */
+
+#define ATR_INDEX_MIN 8
+
+static size_t atr_index_slot(ATTR *atr, size_t mask)
+{
+    uintptr_t key = (uintptr_t)atr >> 3;
+    return (size_t)((key * (uintptr_t)0x9E3779B97F4A7C15ULL) >> 16) & mask;
+}
+
+static struct atr_index *atr_index_alloc(size_t capacity)
+{
+    struct atr_index *idx;
+    char *temp;
+
+    SAFE_MALLOC(temp, char, sizeof(struct atr_index) + capacity * sizeof(ALIST *));
+    idx = (struct atr_index *)temp;
+    idx->mask = capacity - 1;
+    idx->count = 0;
+    memset(idx->slot, 0, capacity * sizeof(ALIST *));
+    return idx;
+}
+
+/* Place al in idx, replacing any entry with the same type. No growth. */
+static void atr_index_store(struct atr_index *idx, ALIST *al)
+{
+    size_t i;
+
+    for (i = atr_index_slot(AL_TYPE(al), idx->mask); idx->slot[i];
+         i = (i + 1) & idx->mask) {
+        if (AL_TYPE(idx->slot[i]) == AL_TYPE(al)) {
+            idx->slot[i] = al;
+            return;
+        }
+    }
+    idx->slot[i] = al;
+    idx->count++;
+}
+
+static void atr_index_drop(dbref thing)
+{
+    if (db[thing].atr_index)
+        SAFE_FREE(db[thing].atr_index);
+}
+
+static void atr_index_build(dbref thing)
+{
+    struct atr_index *idx;
+    ALIST *ptr;
+    size_t n = 0, capacity = 16;
+
+    for (ptr = db[thing].list; ptr; ptr = AL_NEXT(ptr))
+        if (AL_TYPE(ptr))
+            n++;
+    while (capacity < n * 2)
+        capacity *= 2;
+
+    idx = atr_index_alloc(capacity);
+    /* The list head is the newest entry; never let an older one win. */
+    for (ptr = db[thing].list; ptr; ptr = AL_NEXT(ptr)) {
+        size_t i;
+
+        if (!AL_TYPE(ptr))
+            continue;
+        for (i = atr_index_slot(AL_TYPE(ptr), idx->mask); idx->slot[i];
+             i = (i + 1) & idx->mask)
+            if (AL_TYPE(idx->slot[i]) == AL_TYPE(ptr))
+                break;
+        if (!idx->slot[i]) {
+            idx->slot[i] = ptr;
+            idx->count++;
+        }
+    }
+    db[thing].atr_index = idx;
+}
+
+static void atr_index_put(dbref thing, ALIST *al)
+{
+    struct atr_index *idx = db[thing].atr_index;
+
+    if (!idx)
+        return;
+
+    if ((idx->count + 1) * 2 > idx->mask + 1) {
+        struct atr_index *bigger = atr_index_alloc((idx->mask + 1) * 2);
+        size_t i;
+
+        for (i = 0; i <= idx->mask; i++)
+            if (idx->slot[i])
+                atr_index_store(bigger, idx->slot[i]);
+        SAFE_FREE(db[thing].atr_index);
+        db[thing].atr_index = idx = bigger;
+    }
+    atr_index_store(idx, al);
+}
+
+/* Remove atr from the index. Must run before the entry is AL_DISPOSE'd,
+ * since the probe sequence is keyed on AL_TYPE. */
+static void atr_index_del(dbref thing, ATTR *atr)
+{
+    struct atr_index *idx = db[thing].atr_index;
+    size_t i, hole, next;
+
+    if (!idx)
+        return;
+
+    for (i = atr_index_slot(atr, idx->mask); idx->slot[i]; i = (i + 1) & idx->mask) {
+        if (AL_TYPE(idx->slot[i]) != atr)
+            continue;
+        hole = i;
+        for (next = (hole + 1) & idx->mask; idx->slot[next];
+             next = (next + 1) & idx->mask) {
+            size_t home = atr_index_slot(AL_TYPE(idx->slot[next]), idx->mask);
+            if (((next - home) & idx->mask) >= ((next - hole) & idx->mask)) {
+                idx->slot[hole] = idx->slot[next];
+                hole = next;
+            }
+        }
+        idx->slot[hole] = NULL;
+        idx->count--;
+        return;
+    }
+}
+
+/*
+ * atr_find - Find the live list entry for atr on thing itself
+ *
+ * RETURNS: ALIST entry or NULL. Does not look at parents.
+ */
+static ALIST *atr_find(dbref thing, ATTR *atr)
+{
+    struct atr_index *idx = db[thing].atr_index;
+    ALIST *ptr;
+    size_t steps = 0;
+
+    if (idx) {
+        size_t i;
+
+        for (i = atr_index_slot(atr, idx->mask); idx->slot[i]; i = (i + 1) & idx->mask)
+            if (AL_TYPE(idx->slot[i]) == atr)
+                return idx->slot[i];
+        return NULL;
+    }
+
+    for (ptr = db[thing].list; ptr; ptr = AL_NEXT(ptr), steps++)
+        if (AL_TYPE(ptr) == atr)
+            break;
+
+    if (steps >= ATR_INDEX_MIN)
+        atr_index_build(thing);
+
+    return ptr;
+}
+
 /*
  * atr_clr - Clear an attribute from an object
  * 
@@ -1542,15 +1712,12 @@ void atr_clr(dbref thing, ATTR *atr)
     
     atr_obj = -1;  /* Invalidate cache */
     
-    ptr = db[thing].list;
-    while (ptr) {
-        if (AL_TYPE(ptr) == atr) {
-            if (AL_TYPE(ptr))
-                unref_atr(AL_TYPE(ptr));
-            AL_DISPOSE(ptr);
-            return;
-        }
-        ptr = AL_NEXT(ptr);
+    if ((ptr = atr_find(thing, atr))) {
+        atr_commands_changed(thing);  /* may expose an inherited pattern */
+        atr_index_del(thing, atr);
+        inh_cache_forget(thing, atr, MAX_INHERIT_DEPTH);
+        unref_atr(AL_TYPE(ptr));
+        AL_DISPOSE(ptr);
     }
 }
 
@@ -1585,15 +1752,23 @@ void atr_add(dbref thing, ATTR *atr, char *s)
         db[thing].i_flags |= I_UPDATEBYTES;
     
     /* Find existing attribute */
-    for (ptr = db[thing].list; ptr && (AL_TYPE(ptr) != atr); 
-         ptr = AL_NEXT(ptr))
-        ;
+    ptr = atr_find(thing, atr);
+    
+    /* Command/listen patterns are compiled elsewhere; tell them first.
+     * Adding or removing any attribute can shadow or expose an inherited
+     * pattern, so presence changes count as well as pattern values. */
+    if (atr == A_LISTEN || !ptr != !*s || CMD_VALUE(s) ||
+        (ptr && CMD_VALUE(AL_STR(ptr))))
+        atr_commands_changed(thing);
     
     if (!*s) {
         /* Empty string - remove attribute */
         if (ptr) {
+            atr_index_del(thing, atr);
+            inh_cache_forget(thing, atr, MAX_INHERIT_DEPTH);
             unref_atr(AL_TYPE(ptr));
             AL_DISPOSE(ptr);
+            atr_obj = -1;  /* Invalidate cache */
         }
         return;
     }
@@ -1601,12 +1776,16 @@ void atr_add(dbref thing, ATTR *atr, char *s)
     if (!ptr || (strlen(s) > strlen(d = (char *)AL_STR(ptr)))) {
         /* Need new allocation */
         if (ptr) {
+            atr_index_del(thing, atr);
             AL_DISPOSE(ptr);
             db[thing].list = AL_MAKE(atr, db[thing].list, s);
         } else {
             ref_atr(AL_TYPE((db[thing].list = 
                             AL_MAKE(atr, db[thing].list, s))));
+            /* Newly present here: may now shadow what descendants saw. */
+            inh_cache_forget(thing, atr, MAX_INHERIT_DEPTH);
         }
+        atr_index_put(thing, db[thing].list);
     } else {
         /* Reuse existing allocation */
         size_t max_len = strlen(d) + 1;
@@ -1617,36 +1796,179 @@ void atr_add(dbref thing, ATTR *atr, char *s)
     atr_obj = -1;  /* Invalidate cache */
 }
 
+/* ============================================================================
+ * INHERITANCE RESOLUTION CACHE
+ * ============================================================================
+ * Remembers, for (object, inheritable ATTR*), which object actually
+ * supplies the value -- the object itself, some ancestor, or NOTHING.
+ * The value is then one atr_find() on the supplier instead of a
+ * depth-first walk of the parent tree.  Each parent level caches its own
+ * answer, so deep trees are resolved once per level.
+ *
+ * Entries are validated two ways:
+ * - Attribute presence changes (atr_add of a new attribute, atr_clr)
+ *   drop the (object, atr) entry on the changed object and every
+ *   descendant.  Rewriting an existing value changes nothing here, since
+ *   only the supplier is cached.
+ * - Anything that changes which ancestors an object has, or replaces its
+ *   whole attribute list, bumps db[].inh_gen on it and its descendants
+ *   (atr_inherit_changed()), which makes all their entries stale at once.
+ *
+ * The table is direct-mapped: a colliding entry simply evicts the old one.
+ */
+
+#define INH_CACHE_SIZE (1 << 16)   /* power of two */
+
+struct inh_cache_ent {
+    dbref thing;
+    ATTR *atr;
+    dbref supplier;
+    unsigned int gen;
+};
+
+static struct inh_cache_ent *inh_cache = NULL;
+unsigned long inh_cache_hits = 0;
+unsigned long inh_cache_misses = 0;
+
+static struct inh_cache_ent *inh_cache_ent(dbref thing, ATTR *atr)
+{
+    uintptr_t key = ((uintptr_t)atr >> 3) ^ ((uintptr_t)thing * 0x9E3779B1U);
+
+    if (!inh_cache) {
+        SAFE_MALLOC(inh_cache, struct inh_cache_ent, INH_CACHE_SIZE);
+        for (size_t i = 0; i < INH_CACHE_SIZE; i++) {
+            inh_cache[i].thing = NOTHING;
+            inh_cache[i].atr = NULL;
+        }
+    }
+    key ^= key >> 15;
+    return &inh_cache[(size_t)(key * (uintptr_t)0x9E3779B97F4A7C15ULL >> 20) & (INH_CACHE_SIZE - 1)];
+}
+
+/* Drop (thing, atr) on thing and all of its descendants. */
+static void inh_cache_forget(dbref thing, ATTR *atr, int levels)
+{
+    struct inh_cache_ent *e;
+    int i;
+
+    if (!inh_cache || levels < 0)
+        return;
+
+    e = inh_cache_ent(thing, atr);
+    if (e->thing == thing && e->atr == atr)
+        e->thing = NOTHING;
+
+    for (i = 0; db[thing].children && db[thing].children[i] != NOTHING; i++)
+        if (GoodObject(db[thing].children[i]))
+            inh_cache_forget(db[thing].children[i], atr, levels - 1);
+}
+
+static void inh_gen_bump(dbref thing, int levels, int commands_only)
+{
+    int i;
+
+    if (levels < 0)
+        return;
+
+    if (!commands_only)
+        db[thing].inh_gen++;
+    db[thing].cmd_gen++;
+    for (i = 0; db[thing].children && db[thing].children[i] != NOTHING; i++)
+        if (GoodObject(db[thing].children[i]))
+            inh_gen_bump(db[thing].children[i], levels - 1, commands_only);
+}
+
+/*
+ * atr_inherit_changed - Invalidate cached inheritance for thing's subtree
+ *
+ * Call after changing thing's parents, or anything else that alters what
+ * thing and its descendants inherit wholesale.
+ */
+void atr_inherit_changed(dbref thing)
+{
+    if (GoodObject(thing))
+        inh_gen_bump(thing, MAX_INHERIT_DEPTH, 0);
+    atr_obj = -1;  /* Invalidate single-entry cache too */
+}
+
+/*
+ * atr_commands_changed - Invalidate compiled $/!/^ patterns for a subtree
+ *
+ * Call when a command or listen pattern on thing is added, rewritten or
+ * removed, or when any attribute on thing appears or disappears (which
+ * can shadow or expose an inherited pattern).  Descendants inherit those
+ * patterns, so their indexes go too.
+ */
+void atr_commands_changed(dbref thing)
+{
+    if (GoodObject(thing) && !loading_db)
+        inh_gen_bump(thing, MAX_INHERIT_DEPTH, 1);
+}
+
+/*
+ * atr_supplier - Which object supplies atr for thing?
+ *
+ * Same search order as the old recursive lookup: thing itself, then each
+ * parent levels-first in list order.
+ * RETURNS: Supplying object or NOTHING
+ */
+static dbref atr_supplier(dbref thing, ATTR *atr, int levels)
+{
+    struct inh_cache_ent *e = NULL;
+    dbref supplier = NOTHING;
+    int i;
+
+    if (!loading_db) {
+        e = inh_cache_ent(thing, atr);
+        if (e->thing == thing && e->atr == atr && e->gen == db[thing].inh_gen) {
+            inh_cache_hits++;
+            return e->supplier;
+        }
+        inh_cache_misses++;
+    }
+
+    if (atr_find(thing, atr)) {
+        supplier = thing;
+    } else if (levels > 0) {
+        for (i = 0; db[thing].parents && db[thing].parents[i] != NOTHING; i++) {
+            if (GoodObject(db[thing].parents[i]) &&
+                (supplier = atr_supplier(db[thing].parents[i], atr, levels - 1)) != NOTHING)
+                break;
+        }
+    }
+
+    if (e) {
+        e->thing = thing;
+        e->atr = atr;
+        e->supplier = supplier;
+        e->gen = db[thing].inh_gen;
+    }
+    return supplier;
+}
+
 /*
  * atr_get_internal - Internal attribute lookup (checks parents)
  * 
- * SECURITY: Validates all object references
+ * SECURITY: Validates all object references, parent depth limited
  * RETURNS: Attribute value or empty string
  */
 static char *atr_get_internal(dbref thing, ATTR *atr)
 {
-    int i;
     ALIST *ptr;
-    char *k;
+    dbref supplier;
     
     if (!GoodObject(thing))
         return "";
     
     /* Check this object */
-    for (ptr = db[thing].list; ptr; ptr = AL_NEXT(ptr)) {
-        if (ptr && (AL_TYPE(ptr) == atr))
-            return ((char *)(AL_STR(ptr)));
-    }
+    if ((ptr = atr_find(thing, atr)))
+        return ((char *)(AL_STR(ptr)));
     
     /* Check parents (if attribute is inheritable) */
     if (atr && (atr->flags & AF_INHERIT)) {
-        for (i = 0; db[thing].parents && db[thing].parents[i] != NOTHING; i++) {
-            if (GoodObject(db[thing].parents[i])) {
-                if ((k = atr_get_internal(db[thing].parents[i], atr)))
-                    if (*k)
-                        return k;
-            }
-        }
+        supplier = atr_supplier(thing, atr, MAX_INHERIT_DEPTH);
+        if (supplier != NOTHING && (ptr = atr_find(supplier, atr)))
+            return ((char *)(AL_STR(ptr)));
     }
     
     return "";
@@ -1673,6 +1995,10 @@ char *atr_get(dbref thing, ATTR *atr)
     if (!atr)
         return "";
     
+    /* Queue counts live in db[].queue (see cque.c); Queue is a view */
+    if (atr == A_QUEUE)
+        return db[thing].queue > 0 ? tprintf("%d", db[thing].queue) : "";
+    
     /* Check cache */
     if ((thing == atr_obj) && (atr == atr_atr))
         return (atr_p);
@@ -1760,10 +2086,8 @@ char *atr_get(dbref thing, ATTR *atr)
     }
     
     /* Regular attribute - look it up */
-    for (ptr = db[thing].list; ptr; ptr = AL_NEXT(ptr)) {
-        if (ptr && AL_TYPE(ptr) == atr)
-            return (atr_p = (char *)(AL_STR(ptr)));
-    }
+    if ((ptr = atr_find(thing, atr)))
+        return (atr_p = (char *)(AL_STR(ptr)));
     
     /* Not found - check for inheritance */
     if (atr->flags & AF_INHERIT)
@@ -1789,7 +2113,11 @@ void atr_free(dbref thing)
         SAFE_FREE(ptr);
     }
     
+    atr_index_drop(thing);
     db[thing].list = NULL;
+    atr_inherit_changed(thing);
+    cmd_index_free(thing);
+    blacklist_free(thing);
     atr_obj = -1;  /* Invalidate cache */
 }
 
@@ -1806,6 +2134,7 @@ void atr_collect(dbref thing)
     if (!GoodObject(thing))
         return;
     
+    atr_index_drop(thing);
     ptr = db[thing].list;
     db[thing].list = NULL;
     
@@ -1834,7 +2163,9 @@ void atr_cpy_noninh(dbref dest, dbref source)
         return;
     
     ptr = db[source].list;
+    atr_index_drop(dest);
     db[dest].list = NULL;
+    atr_inherit_changed(dest);
     
     while (ptr) {
         if (AL_TYPE(ptr) && !(AL_TYPE(ptr)->flags & AF_INHERIT)) {
@@ -1956,6 +2287,11 @@ dbref new_object(void)
     o->name = NULL;
     o->cname = NULL;
     o->list = NULL;
+    o->atr_index = NULL;
+    o->inh_gen++;  /* recycled dbref: stale inheritance cache entries */
+    o->cmd_index = NULL;
+    o->cmd_gen++;
+    o->blacklist = NULL;
     o->location = NOTHING;
     o->contents = NOTHING;
     o->exits = NOTHING;
@@ -1966,6 +2302,7 @@ dbref new_object(void)
     o->next = NOTHING;
     o->next_fighting = NOTHING;
     o->owner = NOTHING;
+    o->queue = 0;
     o->flags = 0;  /* Caller must set type */
     o->mod_time = 0;
     o->create_time = now;
@@ -2484,6 +2821,7 @@ static void welcome_descriptors(void)
     for (d = descriptor_list; d; d = d->next) {
         if (d->state == RELOADCONNECT && GoodObject(d->player)) {
             d->state = CONNECTED;
+            descriptor_index(d);
             db[d->player].flags |= CONNECT;
             queue_string(d, tprintf("%s %s", muse_name, online_message));
         }
@@ -49,7 +49,6 @@
  * Constants
  * =================================================================== */
 
-#define MAX_INHERIT_DEPTH 20  /* Maximum parent chain depth to prevent infinite loops */
 #define MAX_ATTRDEFS 90       /* Maximum attribute definitions per object */
 
 /* ===================================================================
@@ -409,8 +408,10 @@ void do_defattr(dbref player, char *arg1, char *arg2)
   atr = atr_str(thing, thing, attribute);
   if (atr && atr->obj == thing)
   {
-    /* Attribute already defined on this object - just update flags */
+    /* Attribute already defined on this object - just update flags.
+     * INHERIT/LOCK/HAVEN decide what this object and its children see. */
     atr->flags = atr_flags;
+    atr_inherit_changed(thing);
     notify(player, "Options set.");
     return;
   }
@@ -631,6 +632,7 @@ void do_delparent(dbref player, char *arg1, char *arg2)
   /* Remove from both parent and child lists */
   REMOVE_FIRST_L(db[thing].parents, parent);
   REMOVE_FIRST_L(db[parent].children, thing);
+  atr_inherit_changed(thing);
   
   /* Notify success */
   notify(player, tprintf("%s is no longer a parent of %s.",
@@ -744,6 +746,7 @@ void do_addparent(dbref player, char *arg1, char *arg2)
   /* Add to both parent and child lists */
   PUSH_L(db[thing].parents, parent);
   PUSH_L(db[parent].children, thing);
+  atr_inherit_changed(thing);
   
   /* Notify success */
   notify(player, tprintf("%s is now a parent of %s.",
@@ -12,6 +12,11 @@
  * - channel_id_hash: channel_id string -> channel_cache_t*
  * - member_hash: player dbref string -> channel_member_t* linked list
  *
+ * Membership records of connected players who are neither muted nor
+ * banned are also chained off their channel (chan->online), which is
+ * what com_send_int walks.  A record is re-filed whenever any of those
+ * conditions changes; see online_update().
+ *
  * SAFETY:
  * - All SQL uses mysql_real_escape_string to prevent injection
  * - Cache entries allocated with SAFE_MALLOC, freed with SMART_FREE
@@ -73,18 +78,91 @@ static char *safe_strdup(const char *s)
     return copy;
 }
 
+/* ============================================================================
+ * INTERNAL HELPERS - ONLINE LISTS
+ * ============================================================================ */
+
+/*
+ * online_unlink - Take a membership off its channel's online list
+ */
+static void online_unlink(channel_member_t *m)
+{
+    channel_cache_t *chan;
+
+    if (!m->online) {
+        return;
+    }
+
+    if (m->oprev) {
+        m->oprev->onext = m->onext;
+    } else {
+        chan = channel_cache_lookup_by_id(m->channel_id);
+        if (chan && chan->online == m) {
+            chan->online = m->onext;
+        }
+    }
+    if (m->onext) {
+        m->onext->oprev = m->oprev;
+    }
+    m->onext = NULL;
+    m->oprev = NULL;
+    m->online = 0;
+}
+
+/*
+ * online_update - Put a membership on or take it off its channel's
+ *                 online list to match the player's current state
+ */
+static void online_update(channel_member_t *m)
+{
+    channel_cache_t *chan;
+    int want;
+
+    chan = channel_cache_lookup_by_id(m->channel_id);
+    want = chan && !m->muted && !m->is_banned &&
+           player_descriptors(m->player) != NULL;
+
+    if (!want) {
+        online_unlink(m);
+        return;
+    }
+    if (m->online) {
+        return;
+    }
+
+    m->oprev = NULL;
+    m->onext = chan->online;
+    if (m->onext) {
+        m->onext->oprev = m;
+    }
+    chan->online = m;
+    m->online = 1;
+}
+
 /* ============================================================================
  * INTERNAL HELPERS - CACHE ENTRY MANAGEMENT
  * ============================================================================ */
 
 /*
  * cache_free_channel - Free a channel_cache_t and all its strings
+ *
+ * Members still on its online list are cut loose first, since they may
+ * outlive it (channel_cache_clear frees channels before members).
  */
 static void cache_free_channel(channel_cache_t *chan)
 {
+    channel_member_t *m, *next;
+
     if (!chan) {
         return;
     }
+    for (m = chan->online; m; m = next) {
+        next = m->onext;
+        m->onext = NULL;
+        m->oprev = NULL;
+        m->online = 0;
+    }
+    chan->online = NULL;
     SMART_FREE(chan->name);
     SMART_FREE(chan->cname);
     SMART_FREE(chan->password);
@@ -105,6 +183,7 @@ static void cache_free_member(channel_member_t *m)
     if (!m) {
         return;
     }
+    online_unlink(m);
     SMART_FREE(m->alias);
     SMART_FREE(m->color_name);
     SMART_FREE(m);
@@ -209,7 +288,8 @@ static void cache_remove_channel(channel_cache_t *chan)
 /*
  * cache_add_member - Add a member entry to the member hash
  *
- * Prepends to the linked list for the player.
+ * Prepends to the linked list for the player, and to the channel's
+ * online list if the player is connected.
  */
 static void cache_add_member(dbref player, channel_member_t *m)
 {
@@ -227,11 +307,14 @@ static void cache_add_member(dbref player, channel_member_t *m)
 
     existing = (channel_member_t *)hash_lookup(member_hash, key);
     m->next = existing;
+    m->player = player;
 
     hash_insert(member_hash, key, m);
 
     /* Restore destructor */
     member_hash->value_destructor = member_value_destructor;
+
+    online_update(m);
 }
 
 /*
@@ -617,6 +700,15 @@ channel_member_t *channel_cache_get_member_list(dbref player)
                                             cache_make_player_key(player));
 }
 
+void channel_cache_update_online(dbref player)
+{
+    channel_member_t *m;
+
+    for (m = channel_cache_get_member_list(player); m; m = m->next) {
+        online_update(m);
+    }
+}
+
 void *channel_cache_get_hash(void)
 {
     return (void *)channel_name_hash;
@@ -1036,6 +1128,7 @@ int mariadb_channel_set_mute(long channel_id, dbref player, int muted)
     m = channel_cache_get_member(player, channel_id);
     if (m) {
         m->muted = muted;
+        online_update(m);
     }
 
     return 1;
@@ -1227,6 +1320,7 @@ int mariadb_channel_set_ban(long channel_id, dbref player, int is_banned)
     m = channel_cache_get_member(player, channel_id);
     if (m) {
         m->is_banned = is_banned;
+        online_update(m);
     } else if (is_banned) {
         /* Create new banned member entry */
         channel_cache_t *chan = channel_cache_lookup_by_id(channel_id);
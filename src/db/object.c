@@ -736,6 +736,7 @@ void do_clone(dbref player, char *arg1, char *arg2)
     /* Set up parent/child relationship */
     PUSH_L(db[clone].parents, thing);
     PUSH_L(db[thing].children, clone);
+    atr_inherit_changed(clone);
 
     notify(player, tprintf("%s cloned with number %" DBREF_FMT ".",
                           unparse_object(player, thing), clone));
@@ -1905,6 +1906,7 @@ void do_empty(dbref thing)
     if (db[thing].children) {
         for (i = 0; db[thing].children[i] != NOTHING; i++) {
             if (GoodObject(db[thing].children[i])) {
+                atr_inherit_changed(db[thing].children[i]);
                 REMOVE_FIRST_L(db[db[thing].children[i]].parents, thing);
             }
         }
@@ -2855,6 +2857,7 @@ void do_incremental(void)
                         log_error(tprintf("Bad #%" DBREF_FMT " in parent list on #%" DBREF_FMT ".",
                                         db[thing].parents[i], thing));
                         REMOVE_FIRST_L(db[thing].parents, db[thing].parents[i]);
+                        atr_inherit_changed(thing);
                         goto again1;
                     }
 
@@ -2873,6 +2876,7 @@ void do_incremental(void)
                         log_error(tprintf("Wrong #%" DBREF_FMT " in parent list on #%" DBREF_FMT ".",
                                         db[thing].parents[i], thing));
                         REMOVE_FIRST_L(db[thing].parents, db[thing].parents[i]);
+                        atr_inherit_changed(thing);
                         goto again1;
                     }
                 }
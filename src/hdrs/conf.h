@@ -77,6 +77,14 @@ DO_NUM("announce_cost",announce_cost)
 DO_NUM("queue_cost",queue_cost)
 DO_NUM("queue_loss",queue_loss)
 DO_NUM("max_queue",max_queue)
+DO_NUM("queue_budget_msec",queue_budget_msec)
+DO_NUM("queue_fair",queue_fair)
+DO_NUM("queue_quantum_usec",queue_quantum_usec)
+DO_NUM("dns_cache_ttl",dns_cache_ttl)
+DO_NUM("ident_lookups",ident_lookups)
+DO_NUM("mccp_compression",mccp_compression)
+DO_NUM("queue_owner_cmds",queue_owner_cmds)
+DO_NUM("max_pids",max_pids)
 DO_NUM("channel_name_limit",channel_name_limit)
 DO_NUM("player_name_limit",player_name_limit)
 DO_NUM("player_reference_limit",player_reference_limit)
@@ -95,6 +95,14 @@ extern int announce_cost;
 extern int queue_cost;
 extern int queue_loss;
 extern int max_queue;
+extern int queue_budget_msec;
+extern int queue_fair;
+extern int queue_quantum_usec;
+extern int dns_cache_ttl;
+extern int ident_lookups;
+extern int mccp_compression;
+extern int queue_owner_cmds;
+extern int max_pids;
 extern int channel_name_limit;
 extern int player_name_limit;
 extern int player_reference_limit;
@@ -119,8 +119,11 @@ extern struct object *db;         /* The main database array */
 extern dbref db_top;              /* Number of objects in database */
 extern size_t number_stack_blocks;
 extern size_t stack_size;
+extern size_t number_stack_chunks;
 extern size_t text_block_size;
 extern size_t text_block_num;
+extern size_t output_ring_size;
+extern size_t output_ring_num;
 extern int dozonetemp;            /* Temporary variable for DOZONE macro */
 
 /* ============================================================================
@@ -331,6 +334,23 @@ struct alist {
 #define AL_DISPOSE(alist) ((alist)->AL_type = 0)
 #define Astr(alist)     ((char *)(&((alist)[1])))
 
+/* Parent chains deeper than this are not searched */
+#define MAX_INHERIT_DEPTH 20
+
+/*
+ * Attribute index
+ *
+ * Objects with many attributes get an open-addressed table keyed by ATTR*
+ * that points at the live ALIST entry for each attribute.  The linked list
+ * stays the authoritative store (and keeps AL_MAKE's inline string); the
+ * index only replaces the list walk in atr_get()/atr_add()/atr_clr().
+ */
+struct atr_index {
+    size_t mask;        /* Capacity - 1 (capacity is a power of two) */
+    size_t count;       /* Entries in use */
+    ALIST *slot[];      /* NULL marks an empty slot */
+};
+
 /*
  * User-defined attribute structure
  * 
@@ -353,6 +373,10 @@ extern void atr_clr(dbref thing, ATTR *atr);
 extern void atr_free(dbref thing);
 extern void atr_collect(dbref thing);
 extern void atr_cpy_noninh(dbref dest, dbref source);
+extern void atr_inherit_changed(dbref thing);
+extern void atr_commands_changed(dbref thing);
+extern unsigned long inh_cache_hits;
+extern unsigned long inh_cache_misses;
 
 /* Attribute lookup */
 extern ATTR *builtin_atr_str(char *str);
@@ -478,6 +502,7 @@ struct object {
     /* Ownership and permissions */
     dbref owner;                /* Who owns this object */
     ptype *pows;                /* Power/permission array */
+    int queue;                  /* Commands queued by objects we own */
     
     /* Object state */
     object_flag_type flags;     /* Object type and flags */
@@ -485,7 +510,13 @@ struct object {
     
     /* Attribute storage */
     ALIST *list;                /* Linked list of attributes */
+    struct atr_index *atr_index; /* Lookup table over list (large objects) */
+    unsigned int inh_gen;       /* Bumped when inherited attributes may change */
+    struct cmd_index *cmd_index; /* Compiled $/!/^ patterns (see game.c) */
+    unsigned int cmd_gen;       /* Bumped when those patterns may change */
     struct atrdef *atrdefs;     /* User-defined attribute definitions */
+    struct descriptor_data *descs; /* Connected descriptors (descriptor_index) */
+    struct blacklist_set *blacklist; /* Compiled A_BLACKLIST (see boolexp.c) */
     
     /* Parent/child relationships for inheritance */
     dbref *parents;             /* Array of parent objects (NULL-terminated) */
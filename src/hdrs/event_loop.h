@@ -0,0 +1,103 @@
+/* event_loop.h - Readiness notification for the main server loop
+ *
+ * Backend-neutral interface over epoll (Linux) or select().  Telnet
+ * descriptors, the listening socket and libwebsockets' fds all share
+ * the one interest set; see event_loop.c.
+ */
+
+#ifndef _EVENT_LOOP_H_
+#define _EVENT_LOOP_H_
+
+#include <sys/time.h>
+
+/* Forward declaration */
+struct descriptor_data;
+
+/* Interest / readiness bits */
+#define EV_READ  1
+#define EV_WRITE 2
+#define EV_HELD  4   /* descriptor mask only: input queued, reads paused */
+
+/* What a registered fd belongs to */
+#define EV_DESC   1  /* telnet descriptor, data is descriptor_data */
+#define EV_LISTEN 2  /* the game's listening socket */
+#define EV_LWS    3  /* fd owned by libwebsockets */
+#define EV_TIMER  4  /* timerfd from timer.c */
+#define EV_RESOLVER 5 /* wakeup pipe from resolver.c */
+
+/* Descriptors with queued input whose reads are paused */
+extern int ev_input_waiting;
+
+/**
+ * Name of the active backend ("epoll" or "select")
+ */
+const char *ev_backend(void);
+
+/**
+ * Register an fd with the event loop
+ * @param fd File descriptor
+ * @param kind EV_DESC, EV_LISTEN or EV_LWS
+ * @param data Owner pointer handed back by ev_next()
+ * @param mask EV_READ and/or EV_WRITE interest
+ * @return 0 on success, -1 if the fd could not be watched
+ */
+int ev_add(int fd, int kind, void *data, int mask);
+
+/**
+ * Change the interest mask of a registered fd
+ * @param fd File descriptor
+ * @param mask New EV_READ/EV_WRITE interest
+ */
+void ev_mod(int fd, int mask);
+
+/**
+ * Forget an fd; readiness already collected for it is discarded
+ * @param fd File descriptor
+ */
+void ev_del(int fd);
+
+/**
+ * Watch the listening socket, re-registering it if it was reopened
+ * @param fd Current listening socket (-1 if none)
+ * @param accepting 0 to pause accepts (descriptor table full)
+ */
+void ev_listen(int fd, int accepting);
+
+/**
+ * Wait for readiness on registered fds
+ * @param timeout Maximum time to block
+ * @return Number of ready fds, or -1 on error (errno set)
+ */
+int ev_wait(struct timeval *timeout);
+
+/**
+ * Take the next ready fd collected by ev_wait()
+ * @param fd Receives the file descriptor
+ * @param kind Receives its EV_DESC/EV_LISTEN/EV_LWS kind
+ * @param data Receives the owner pointer
+ * @return EV_READ/EV_WRITE readiness, 0 when none are left
+ */
+int ev_next(int *fd, int *kind, void **data);
+
+/**
+ * Register a telnet descriptor and set its initial interest
+ * @param d Descriptor (C_REMOTE and C_WEBSOCKET are ignored)
+ * @return 0, or -1 if the fd cannot be polled (select() backend and
+ *         fd >= FD_SETSIZE); the caller must close the descriptor
+ */
+int ev_attach(struct descriptor_data *d);
+
+/**
+ * Unregister a descriptor before its fd is closed
+ * @param d Descriptor
+ */
+void ev_detach(struct descriptor_data *d);
+
+/**
+ * Recompute a descriptor's interest after its queues changed:
+ * read unless input is queued, write while output is pending
+ * @param d Descriptor
+ */
+void ev_sync(struct descriptor_data *d);
+
+#endif /* _EVENT_LOOP_H_ */
@@ -116,12 +116,25 @@ extern char *parse_color_nobeep (char *, int);
 extern char *strip_color (const char *);
 extern char *strip_color_nobeep (char *);
 extern char *truncate_color (char *, int);
+/* color_render() modes */
+#define COLOR_STRIP  1          /* Text only, no escapes */
+#define COLOR_PUEBLO 2          /* <font> tags instead of ANSI */
+#define COLOR_NOBEEP 4          /* Drop BEL characters */
+#define COLOR_BUFFER_SIZE 65535 /* Output size the string APIs use */
+extern size_t color_render (char *, size_t, const char *, int);
+extern int color_mode (dbref, int);
+extern char *color_string (const char *, int);
 
 
 /* From boolexp.c */
 extern int eval_boolexp (dbref, dbref, char *, dbref);
 extern char *process_lock (dbref, char *);
 extern char *unprocess_lock (dbref, char *);
+extern unsigned long lock_cache_hits;
+extern unsigned long lock_cache_misses;
+extern int blacklist_check (dbref, dbref);
+extern void blacklist_free (dbref);
+extern unsigned long blacklist_builds;
 
 /* From bsd.c */
 void free_text_block (struct text_block *);
@@ -131,6 +144,9 @@ extern int loading_db;
 extern time_t now;
 extern void do_ctrace (dbref);
 extern int is_emergency_session (dbref);
+extern void descriptor_index (struct descriptor_data *);
+extern void descriptor_unindex (struct descriptor_data *);
+extern struct descriptor_data *player_descriptors (dbref);
 extern void announce_connect (dbref);
 extern void announce_disconnect (dbref);
 extern int boot_off (dbref);
@@ -138,6 +154,10 @@ extern void emergency_shutdown (void);
 extern int getdtablesize (void);
 extern int queue_string (struct descriptor_data *, const char *);
 extern int queue_write (struct descriptor_data *, const char *, int);
+struct iovec;
+extern int output_peek (struct descriptor_data *, struct iovec *);
+extern void output_consume (struct descriptor_data *, int);
+extern void output_free (struct descriptor_data *);
 extern void raw_notify (dbref, char *);
 extern void raw_notify_noc (dbref, char *);
 extern void remove_muse_pid (void);
@@ -147,6 +167,22 @@ extern void send_message_text (struct descriptor_data *,char *,int);
 extern void flush_all_output (void);
 extern int process_output (struct descriptor_data *);
 extern char *add_pre_suf (dbref, int, char *, int);
+
+/* One message rendered once per recipient class (Pueblo, ANSI, NOBEEP)
+ * instead of once per recipient; see output_handler.c */
+#define RENDER_CLASSES 8
+struct render_cache {
+  char *msg;
+  int color;
+  char *text[RENDER_CLASSES];
+  struct render_cache *prev;
+};
+extern void render_begin (struct render_cache *, char *, int);
+extern void render_end (struct render_cache *);
+extern int notify_class (dbref, int);
+extern int notify_shareable (dbref);
+extern unsigned long render_cache_hits;
+extern unsigned long render_cache_misses;
 extern void shutdown_stack (void);
 
 
@@ -185,7 +221,15 @@ extern int do_top (void);
 extern void parse_que (dbref, char *, dbref);
 extern void parse_que_pri (dbref, char *, dbref, int);
 extern int test_top (void);
-extern void wait_que (dbref, int, char *, dbref);
+extern int test_wait (void);
+extern long queue_next_wake (void);
+extern int queue_run (void);
+extern void wait_que (dbref, long, char *, dbref);
+extern unsigned long queue_passes;
+extern unsigned long queue_budget_hits;
+extern int queue_pass_cmds;
+extern int queue_pass_peak;
+extern long queue_pass_usec;
 
 /* From create.c */
 extern void init_universe (struct object *);
@@ -262,6 +306,12 @@ extern void func_zerolev (void);
 extern dbref match_thing (dbref, const char *);
 extern char *parse_up (char **, int);
 extern int mem_usage (dbref);
+struct softcode;
+extern void softcode_bracket (struct softcode *, char **, char *, dbref, dbref);
+extern size_t softcode_literal (struct softcode *, const char *,
+                                const char **, size_t *);
+extern unsigned long softcode_cache_hits;
+extern unsigned long softcode_cache_misses;
 
 /* From game.c */
 extern void exit_nicely (int);
@@ -270,6 +320,8 @@ extern int Live_Player (dbref);
 extern int Live_Puppet (dbref);
 extern int Listener (dbref);
 extern int Commer (dbref);
+extern void cmd_index_free (dbref);
+extern unsigned long cmd_index_builds;
 extern int Hearer (dbref);
 extern void dump_database (void);
 extern void fork_and_dump (void);
@@ -418,6 +470,7 @@ extern void safe_memory_init (void);
 extern void safe_memory_cleanup (void);
 extern void *stack_em_fun (size_t);
 extern void *stack_em (size_t);
+extern void *stack_em_ticks (size_t, int);
 extern void clear_stack (void);
 extern char *stralloc (const char *);
 extern char *stralloc_p (char *);
@@ -550,6 +603,8 @@ extern int pay_quota (dbref, int);
 extern int payfor (dbref, int);
 extern int power (dbref, int);
 extern void pronoun_substitute (char *, dbref, char *, dbref);
+extern void pronoun_substitute_compiled (char *, dbref, char *, dbref,
+                                         struct softcode *);
 extern char *main_exit_name (dbref);
 extern int sub_quota (dbref, int);
 extern char *ljust (char *, int);
@@ -661,6 +716,16 @@ extern void parse_subject_body(char *, char **, char **);
 extern void dispatch (void);
 extern void init_timer (void);
 extern void trig_atime (void);
+extern long timer_msec (void);
+extern void timer_once (const char *, long);
+extern int timer_fd (void);
+extern void timer_fired (void);
+extern void timer_arm (struct timeval *);
+extern void info_timers (dbref);
+
+/* from resolver.c */
+extern void info_resolver (dbref);
+extern void info_mccp (dbref);
 
 /* from time.c */
 extern char *time_format_1 (time_t);
@@ -697,6 +762,10 @@ extern void dump_users (dbref, char *, char *, struct descriptor_data *);
 
 /* From wild.c */
 extern long wild_match (char *, char *);
+struct wild_prog;
+extern struct wild_prog *wild_compile (const char *);
+extern long wild_exec (const struct wild_prog *, char *);
+extern void wild_free (struct wild_prog *);
 
 /* From log.c */
 extern void close_logs (void);
@@ -12,6 +12,10 @@
  * - channel_id_hash: channel_id (as string) -> channel_cache_t*
  * - member_hash: player dbref (as string) -> channel_member_t* linked list
  *
+ * Each channel also chains the membership records of its connected,
+ * unmuted, unbanned members (channel_cache_t.online), so delivery walks
+ * only the players who will actually hear the message.
+ *
  * All mutations write through to MariaDB first, then update the cache.
  *
  * SAFETY:
@@ -50,6 +54,7 @@ typedef struct channel_cache {
     char  *speak_lock;
     char  *join_lock;
     char  *hide_lock;
+    struct channel_member *online;  /* listeners, chained through onext */
 } channel_cache_t;
 
 /*
@@ -66,7 +71,11 @@ typedef struct channel_member {
     int    is_default;
     int    is_operator;
     int    is_banned;
+    dbref  player;                /* whose membership this is */
     struct channel_member *next;  /* linked list per player */
+    struct channel_member *onext; /* channel's online list */
+    struct channel_member *oprev;
+    int    online;                /* 1 while on the online list */
 } channel_member_t;
 
 
@@ -146,6 +155,17 @@ channel_member_t *channel_cache_get_member(dbref player, long channel_id);
  */
 channel_member_t *channel_cache_get_member_list(dbref player);
 
+/*
+ * channel_cache_update_online - Re-file a player's memberships on the
+ *                               channels' online lists
+ *
+ * Called when the player's first descriptor connects and when the last
+ * one goes away.
+ *
+ * @param player Player dbref
+ */
+void channel_cache_update_online(dbref player);
+
 /* ============================================================================
  * CHANNEL CRUD OPERATIONS
  * ============================================================================
@@ -438,6 +458,8 @@ static inline channel_member_t *channel_cache_get_member(
     long id __attribute__((unused))) { return NULL; }
 static inline channel_member_t *channel_cache_get_member_list(
     dbref p __attribute__((unused))) { return NULL; }
+static inline void channel_cache_update_online(
+    dbref p __attribute__((unused))) { }
 
 static inline long mariadb_channel_create(
     const char *n __attribute__((unused)),
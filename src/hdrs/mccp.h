@@ -0,0 +1,92 @@
+/* mccp.h - MCCP v2 output compression (telnet option COMPRESS2, 86)
+ *
+ * Telnet connections are offered COMPRESS2 when they open.  A client
+ * that answers DO gets everything after IAC SB COMPRESS2 IAC SE as one
+ * zlib stream.  The output ring keeps holding plain text; it is
+ * compressed on its way to the socket.  See mccp.c.
+ */
+
+#ifndef _MCCP_H_
+#define _MCCP_H_
+
+/* Forward declaration */
+struct descriptor_data;
+
+/* Telnet command bytes */
+#define TN_SE    240
+#define TN_SB    250
+#define TN_WILL  251
+#define TN_WONT  252
+#define TN_DO    253
+#define TN_DONT  254
+#define TN_IAC   255
+
+#define TELOPT_COMPRESS2 86
+
+#ifdef USE_MCCP
+
+/**
+ * Offer COMPRESS2 to a new telnet connection (IAC WILL COMPRESS2)
+ * @param d Descriptor, before anything else is queued
+ */
+void mccp_offer(struct descriptor_data *d);
+
+/**
+ * Client said DO COMPRESS2: queue the start marker and compress
+ * everything queued after it
+ */
+void mccp_start(struct descriptor_data *d);
+
+/**
+ * Finish the stream (client said DONT).  Queued text is compressed and
+ * the stream closed; once its last bytes are written, output goes out
+ * plain again.
+ */
+void mccp_end(struct descriptor_data *d);
+
+/**
+ * Finish every stream and write them out before returning, polling all
+ * the sockets together for up to msec.  Used before plain text is
+ * written straight to the fds (reboot and shutdown messages).
+ * Descriptors whose stream could not be sent still have d->mccp set
+ * afterwards and should be closed.
+ */
+void mccp_drain_all(int msec);
+
+/* How long close_sockets() waits for the streams to drain */
+#define MCCP_DRAIN_MSEC 2000
+
+/**
+ * process_output() for a compressing descriptor
+ * @return 1 on success (including a full socket), 0 on error
+ */
+int mccp_output(struct descriptor_data *d);
+
+/**
+ * Compressed bytes are waiting for the socket
+ */
+int mccp_pending(struct descriptor_data *d);
+
+/**
+ * Release a descriptor's stream without finishing it
+ */
+void mccp_free(struct descriptor_data *d);
+
+/**
+ * ", mccp: N.N:1" for connection listings, "" if not compressing
+ */
+const char *mccp_status(struct descriptor_data *d);
+
+#else
+/* Stubs when zlib is not available */
+#define mccp_offer(d) ((void)0)
+#define mccp_start(d) ((void)0)
+#define mccp_end(d) ((void)0)
+#define mccp_drain_all(m) ((void)0)
+#define mccp_output(d) (1)
+#define mccp_pending(d) (0)
+#define mccp_free(d) ((void)0)
+#define mccp_status(d) ("")
+#endif
+
+#endif /* _MCCP_H_ */
@@ -32,6 +32,19 @@ struct text_queue {
   struct text_block **tail;
 };
 
+/* Pending output: a growable ring holding output_size bytes from
+ * buf[start], wrapping at size.  buf is NULL until something is queued.
+ * When the ring drains or grows, start is set to headroom, so that many
+ * bytes stay free in front of the text (LWS_PRE for WebSocket). */
+struct output_ring {
+  char *buf;
+  int size;
+  int start;
+  int headroom;
+};
+
+struct mccp_stream;
+
 enum descriptor_state {
   WAITCONNECT, WAITPASS, CONNECTED, RELOADCONNECT
 };
@@ -45,13 +58,14 @@ struct descriptor_data {
 #define C_REMOTE 2
 #define C_WEBSOCKET 4
 #define C_CLOSING 8
+#define C_MCCP 16               /* COMPRESS2 offered */
   struct descriptor_data *parent; /* for C_REMOTE stuff */
   char addr[51];
   dbref player;
   char *output_prefix;
   char *output_suffix;
   int output_size;
-  struct text_queue output;
+  struct output_ring output;
   struct text_queue input;
   char *raw_input;
   char *raw_input_at;
@@ -61,12 +75,18 @@ struct descriptor_data {
   struct sockaddr_in address;
   struct descriptor_data *next;
   struct descriptor_data **prev;
+  dbref indexed;                /* player filed under, NOTHING if none */
+  struct descriptor_data *pnext; /* same player's descriptors, see */
+  struct descriptor_data *pprev; /* descriptor_index() */
   char *charname;		/* for non-echoing passwords */
   char user[40];
   int snag_input;               /* for @paste */
   int pueblo; /* flag for the pueblo client */
   int emergency_bypass; /* flag for emergency bypass login */
   void *wsi; /* libwebsockets instance handle (NULL for telnet) */
+  int telnet; /* telnet command parse state, see process_input() */
+  struct mccp_stream *mccp; /* MCCP2 output stream, NULL if uncompressed */
+  int ev_mask; /* event loop interest (EV_READ/EV_WRITE/EV_HELD) */
   long account_id; /* Account ID from web auth, 0 if not authenticated via token */
 };
 
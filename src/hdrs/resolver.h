@@ -0,0 +1,29 @@
+/* resolver.h - Asynchronous host and ident lookups for new connections
+ *
+ * Reverse DNS and RFC 1413 ident queries run on worker threads so a
+ * slow nameserver or a firewalled identd never stalls the main loop.
+ * Results come back through a pipe watched by the event loop; see
+ * resolver.c.
+ */
+
+#ifndef _RESOLVER_H_
+#define _RESOLVER_H_
+
+/* Forward declaration */
+struct descriptor_data;
+
+/**
+ * Start lookups for a freshly opened descriptor.  d->addr and d->user
+ * read "resolving" until the answers arrive (a cached hostname is
+ * filled in immediately).
+ * @param d Descriptor with address and concid already set
+ */
+void resolver_start(struct descriptor_data *d);
+
+/**
+ * Apply finished lookups to their descriptors and the host cache.
+ * Called by the main loop when the resolver's pipe is readable.
+ */
+void resolver_collect(void);
+
+#endif /* _RESOLVER_H_ */
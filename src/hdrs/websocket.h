@@ -2,7 +2,7 @@
  *
  * Provides WebSocket connectivity via libwebsockets, allowing browser-based
  * clients to connect using xterm.js. WebSocket connections become standard
- * descriptors in the select() loop, identical to telnet after handshake.
+ * descriptors in the main event loop, identical to telnet after handshake.
  *
  * Uses the same void* pattern as mariadb.h to avoid requiring
  * libwebsockets.h in every compilation unit.
@@ -22,6 +22,7 @@ int websocket_init(int port);
 void websocket_shutdown(void);
 void websocket_add_fds(fd_set *read_set, fd_set *write_set, int *maxfd);
 void websocket_service_fds(fd_set *read_set, fd_set *write_set);
+void websocket_service_fd(int fd, int ready);
 void websocket_service_timeout(void);
 void websocket_request_write(struct descriptor_data *d);
 int websocket_write_output(struct descriptor_data *d);
@@ -33,10 +34,16 @@ void websocket_close_connection(struct descriptor_data *d);
 #define websocket_shutdown() ((void)0)
 #define websocket_add_fds(r, w, m) ((void)0)
 #define websocket_service_fds(r, w) ((void)0)
+#define websocket_service_fd(f, r) ((void)0)
 #define websocket_service_timeout() ((void)0)
 #define websocket_request_write(d) ((void)0)
 #define websocket_write_output(d) (1)
 #define websocket_close_connection(d) ((void)0)
 #endif
 
+/**
+ * WebSocket lines for @info compression
+ */
+void websocket_info(dbref player);
+
 #endif /* _WEBSOCKET_H_ */
@@ -19,9 +19,10 @@
 #include "interface.h"
 
 /* ===================================================================
- * Color Attribute Flags
+ * Color Code Table
  * =================================================================== */
 
+/* Color attribute bits */
 #define CA_BRIGHT    1
 #define CA_REVERSE   2
 #define CA_UNDERLINE 4
@@ -29,188 +30,315 @@
 #define CA_BLINK     8
 #endif
 
-/* ===================================================================
- * ANSI Color Strings
- * =================================================================== */
+/* Kinds of code character */
+#define CC_FORE 1
+#define CC_BACK 2
+#define CC_ATTR 3
+
+struct color_code {
+    unsigned char kind;         /* CC_*, or 0 if the byte is not a code */
+    unsigned char value;        /* Color 0-7 (ANSI 30+/40+), or CA_* bit */
+};
+
+/* Every byte that can appear between '|' and '+'; the rest are ignored */
+static const struct color_code color_codes[256] = {
+    ['!'] = {CC_ATTR, CA_BRIGHT},
+    ['u'] = {CC_ATTR, CA_UNDERLINE},
+#ifdef BLINK
+    ['b'] = {CC_ATTR, CA_BLINK},
+#endif
+    ['r'] = {CC_ATTR, CA_REVERSE},
+    ['N'] = {CC_FORE, 0}, ['R'] = {CC_FORE, 1}, ['G'] = {CC_FORE, 2},
+    ['Y'] = {CC_FORE, 3}, ['B'] = {CC_FORE, 4}, ['M'] = {CC_FORE, 5},
+    ['C'] = {CC_FORE, 6}, ['W'] = {CC_FORE, 7},
+    ['0'] = {CC_BACK, 0}, ['1'] = {CC_BACK, 1}, ['2'] = {CC_BACK, 2},
+    ['3'] = {CC_BACK, 3}, ['4'] = {CC_BACK, 4}, ['5'] = {CC_BACK, 5},
+    ['6'] = {CC_BACK, 6}, ['7'] = {CC_BACK, 7},
+};
+
+/* Pueblo names for colors 0-7 */
+static const char *const pueblo_names[8] = {
+    "black", "red", "green", "yellow", "blue", "magenta", "cyan", "white"
+};
 
 /* Use \033 instead of \e for ISO C compliance */
-static const char *normal_ansi = "\033[0m";
-static const char *normal_pueblo = "<font fgcolor=\"FFFFFF\" bgcolor=\"000000\">";
+static const char normal_ansi[] = "\033[0m";
+static const char normal_pueblo[] = "<font fgcolor=\"FFFFFF\" bgcolor=\"000000\">";
 
-/* ===================================================================
- * Forward Declarations
- * =================================================================== */
+/* Longest markup color_markup() writes (Pueblo, all attributes) */
+#define MARKUP_MAX 128
 
-static int color2num(char c);
-static int is_foreground(int num);
-static int is_background(int num);
-static void set_ca(int *attribs, int num);
-static char *make_num_string(int fore, int back, int ca);
-static char *color_escape(const char *s);
-static char *make_font_string(const char *fore, const char *back, int ca);
-static char *color_pueblo(const char *s);
-static const char *pueblo_color(int num);
+/* Only this many code characters are looked at */
+#define MAX_CODES 63
 
 /* ===================================================================
- * Utility Functions
+ * Color Engine
  * =================================================================== */
 
 /**
- * Convert color code character to ANSI number
- * @param c Color code character
- * @return ANSI color code number, or -1 if invalid
+ * Build the escape sequence (or Pueblo <font> tag) for a run of codes
+ * @param buf At least MARKUP_MAX bytes
+ * @param s Start of the codes (after '|')
+ * @param e End of the codes (the '+')
+ * @param mode COLOR_* bits; BEL bytes are skipped under COLOR_NOBEEP
+ * @return Length written, 0 if there were no valid codes
  */
-static int color2num(char c)
+static size_t color_markup(char *buf, const char *s, const char *e, int mode)
 {
-    switch (c) {
-        case '!': return 1;  /* Bright */
-        case 'u': return 4;  /* Underline */
+    int fore = -1, back = -1, attribs = 0, valid = 0, n = 0;
+    const struct color_code *cc;
+    char *p = buf;
+
+    for (; s < e && n < MAX_CODES; s++) {
+        if (*s == '\a' && (mode & COLOR_NOBEEP)) {
+            continue;
+        }
+        n++;
+        cc = &color_codes[(unsigned char)*s];
+        switch (cc->kind) {
+            case CC_FORE: fore = cc->value; break;
+            case CC_BACK: back = cc->value; break;
+            case CC_ATTR: attribs |= cc->value; break;
+            default: continue;
+        }
+        valid = 1;
+    }
+
+    if (!valid) {
+        return 0;
+    }
+
+    if (mode & COLOR_PUEBLO) {
+        p = stpcpy(p, "<font fgcolor=\"");
+        p = stpcpy(p, fore < 0 ? "FFFFFF" : pueblo_names[fore]);
+        p = stpcpy(p, "\" bgcolor=\"");
+        p = stpcpy(p, back < 0 ? "000000" : pueblo_names[back]);
+        p = stpcpy(p, "\" ");
+        if (attribs & CA_UNDERLINE) {
+            p = stpcpy(p, "style=\"text-decoration:underline\" ");
+        }
+        *p++ = '>';
+        return (size_t)(p - buf);
+    }
+
+    /* White on black unless told otherwise */
+    if (fore < 0) {
+        fore = 7;
+    }
+    if (back < 0) {
+        back = 0;
+    }
+
+    /* Prevent same color for foreground and background */
+    if (fore == back) {
+        back = (fore == 0 && !(attribs & CA_BRIGHT)) ? 7 : 0;
+    }
+
+    *p++ = '\033';
+    *p++ = '[';
+    *p++ = '3';
+    *p++ = (char)('0' + fore);
+    *p++ = ';';
+    *p++ = '4';
+    *p++ = (char)('0' + back);
+    if (attribs & CA_BRIGHT) {
+        p = stpcpy(p, ";1");
+    }
+    if (attribs & CA_REVERSE) {
+        p = stpcpy(p, ";7");
+    }
+    if (attribs & CA_UNDERLINE) {
+        p = stpcpy(p, ";4");
+    }
 #ifdef BLINK
-        case 'b': return 5;  /* Blink */
-#endif
-        case 'r': return 7;  /* Reverse */
-        case 'N': return 30; /* Black foreground */
-        case 'R': return 31; /* Red foreground */
-        case 'G': return 32; /* Green foreground */
-        case 'Y': return 33; /* Yellow foreground */
-        case 'B': return 34; /* Blue foreground */
-        case 'M': return 35; /* Magenta foreground */
-        case 'C': return 36; /* Cyan foreground */
-        case 'W': return 37; /* White foreground */
-        case '0': return 40; /* Black background */
-        case '1': return 41; /* Red background */
-        case '2': return 42; /* Green background */
-        case '3': return 43; /* Yellow background */
-        case '4': return 44; /* Blue background */
-        case '5': return 45; /* Magenta background */
-        case '6': return 46; /* Cyan background */
-        case '7': return 47; /* White background */
-        default:  return -1;
+    if (attribs & CA_BLINK) {
+        p = stpcpy(p, ";5");
     }
+#endif
+    *p++ = 'm';
+    return (size_t)(p - buf);
 }
 
 /**
- * Check if number is a foreground color code
+ * Copy [s, e) to out + opos, stopping at limit; drops BEL bytes if nobeep
+ * @return New output position
  */
-static int is_foreground(int num)
+static size_t color_copy(char *out, size_t opos, size_t limit,
+                         const char *s, const char *e, int nobeep)
 {
-    return (num >= 30 && num <= 37);
+    const char *bel;
+    size_t n;
+
+    while (s < e && opos < limit) {
+        bel = nobeep ? memchr(s, '\a', (size_t)(e - s)) : NULL;
+        n = (size_t)((bel ? bel : e) - s);
+        if (n > limit - opos) {
+            n = limit - opos;
+        }
+        memcpy(out + opos, s, n);
+        opos += n;
+        s = bel ? bel + 1 : e;
+    }
+    return opos;
 }
 
 /**
- * Check if number is a background color code
+ * Where BEL-stripped input ends: the old strip_beep() copy kept at most
+ * BUFFER_LEN - 1 characters
  */
-static int is_background(int num)
+static const char *color_beep_limit(const char *s, const char *e)
 {
-    return (num >= 40 && num <= 47);
-}
+    size_t kept = 0;
 
-/**
- * Set color attribute flags based on ANSI code
- */
-static void set_ca(int *attribs, int num)
-{
-    switch (num) {
-        case 1: *attribs |= CA_BRIGHT; break;
-        case 7: *attribs |= CA_REVERSE; break;
-        case 4: *attribs |= CA_UNDERLINE; break;
-#ifdef BLINK
-        case 5: *attribs |= CA_BLINK; break;
-#endif
-        default:
-            log_error("Invalid attribute number in set_ca");
-            break;
+    if ((size_t)(e - s) < BUFFER_LEN) {
+        return e;
+    }
+    for (; s < e && kept < BUFFER_LEN - 1; s++) {
+        if (*s != '\a') {
+            kept++;
+        }
     }
+    return s;
 }
 
 /**
- * Build ANSI escape code string from color values
- * @param fore Foreground color code (or 0 for none)
- * @param back Background color code (or 0 for none)
- * @param ca Color attributes bitmap
- * @return Allocated string with semicolon-separated codes
+ * Translate |codes+text| markup in one pass, without allocating
+ *
+ * COLOR_STRIP keeps only the text, COLOR_PUEBLO emits <font> tags
+ * instead of ANSI escapes, and COLOR_NOBEEP drops BEL characters as
+ * it goes.  Output that does not fit in size bytes is cut short; an
+ * escape or reset that would not fit whole is left out.
+ *
+ * @param out Output buffer
+ * @param size Size of out (COLOR_BUFFER_SIZE matches the string APIs)
+ * @param str Input string with |code+text| markup
+ * @param mode COLOR_* bits
+ * @return Length of the NUL-terminated result
  */
-static char *make_num_string(int fore, int back, int ca)
+size_t color_render(char *out, size_t size, const char *str, int mode)
 {
-    char buff[256];
-    size_t pos = 0;
-
-    buff[0] = '\0';
-
-    if (fore > 0) {
-        pos += snprintf(buff + pos, sizeof(buff) - pos, "%d;", fore);
+    const char *s, *e, *plus, *scan, *text, *text_end, *next;
+    const char *reset = (mode & COLOR_PUEBLO) ? normal_pueblo : normal_ansi;
+    size_t reset_len = (mode & COLOR_PUEBLO) ? sizeof(normal_pueblo) - 1
+                                             : sizeof(normal_ansi) - 1;
+    int nobeep = mode & COLOR_NOBEEP;
+    char markup[MARKUP_MAX];
+    size_t opos = 0, limit, mlen;
+
+    if (!size) {
+        return 0;
     }
-
-    if (back > 0) {
-        pos += snprintf(buff + pos, sizeof(buff) - pos, "%d;", back);
+    limit = size - 1;
+    if (!str) {
+        *out = '\0';
+        return 0;
     }
 
-    if (ca > 0) {
-        if (ca & CA_BRIGHT)
-            pos += snprintf(buff + pos, sizeof(buff) - pos, "1;");
-        if (ca & CA_REVERSE)
-            pos += snprintf(buff + pos, sizeof(buff) - pos, "7;");
-        if (ca & CA_UNDERLINE)
-            pos += snprintf(buff + pos, sizeof(buff) - pos, "4;");
-#ifdef BLINK
-        if (ca & CA_BLINK)
-            pos += snprintf(buff + pos, sizeof(buff) - pos, "5;");
-#endif
+    e = str + strlen(str);
+    if (nobeep) {
+        e = color_beep_limit(str, e);
     }
 
-    /* Remove trailing semicolon */
-    if (pos > 0 && buff[pos - 1] == ';') {
-        buff[pos - 1] = '\0';
-    }
+    s = str;
+    while (s < e && opos < limit) {
+        /* Plain text up to the next bar */
+        next = memchr(s, '|', (size_t)(e - s));
+        if (!next) {
+            next = e;
+        }
+        opos = color_copy(out, opos, limit, s, next, nobeep);
+        s = next;
+        if (s >= e || opos >= limit) {
+            break;
+        }
 
-    return stralloc(buff);
-}
+        /* Look for color markup: |codes+text| */
+        scan = memchr(s + 1, '|', (size_t)(e - s - 1));
+        plus = scan ? memchr(s + 1, '+', (size_t)(scan - s - 1)) : NULL;
+        if (!plus) {
+            /* Not a valid color code -- output the | literally */
+            out[opos++] = '|';
+            s++;
+            continue;
+        }
 
-/**
- * Convert color code string to ANSI escape sequence
- * @param s String of color codes (e.g., "RB" for red on blue)
- * @return Allocated ANSI escape string
- */
-static char *color_escape(const char *s)
-{
-    char escape[256];
-    int foreground = 37; /* Default to white */
-    int background = 40; /* Default to black */
-    int attribs = 0;
-    int valid = 0;
-
-    for (; *s; s++) {
-        int num = color2num(*s);
-        if (num > 0) {
-            valid = 1;
-            if (is_foreground(num)) {
-                foreground = num;
-            } else if (is_background(num)) {
-                background = num;
-            } else {
-                set_ca(&attribs, num);
+        text = plus + 1;
+        text_end = scan;
+        while (nobeep && text < e && *text == '\a') {
+            text++;
+        }
+
+        /* Handle curly braces: |codes+{text with | bars}| */
+        if (text < e && *text == '{') {
+            const char *end_curl = memchr(text + 1, '}', (size_t)(e - text - 1));
+
+            if (end_curl) {
+                next = end_curl + 1;
+                while (nobeep && next < e && *next == '\a') {
+                    next++;
+                }
+                if (next < e && *next == '|') {
+                    text++;
+                    text_end = end_curl;
+                    scan = next;
+                }
             }
         }
-    }
 
-    if (valid) {
-        /* Prevent same color for foreground and background */
-        if (foreground == (background - 10)) {
-            if (foreground == 30 && !(attribs & CA_BRIGHT)) {
-                background = 47; /* White background */
-            } else {
-                background = 40; /* Black background */
+        if (!(mode & COLOR_STRIP)) {
+            mlen = color_markup(markup, s + 1, plus, mode);
+            if (opos + mlen < limit) {
+                memcpy(out + opos, markup, mlen);
+                opos += mlen;
             }
+            opos = color_copy(out, opos, limit, text, text_end, nobeep);
+            if (opos + reset_len < limit) {
+                memcpy(out + opos, reset, reset_len);
+                opos += reset_len;
+            }
+        } else {
+            opos = color_copy(out, opos, limit, text, text_end, nobeep);
         }
 
-        char *num_str = make_num_string(foreground, background, attribs);
-        snprintf(escape, sizeof(escape), "\033[%sm", num_str);
-        SMART_FREE(num_str); 
+        s = scan + 1;
+    }
+
+    out[opos] = '\0';
+    return opos;
+}
+
+/**
+ * Which color_render() mode a player's settings call for
+ * @param player Player receiving the text
+ * @param pueblo Non-zero for a Pueblo connection
+ */
+int color_mode(dbref player, int pueblo)
+{
+    int mode;
+
+    if (!GoodObject(player)) {
+        return COLOR_STRIP;
+    }
+    if (db[player].flags & PLAYER_ANSI) {
+        mode = pueblo ? COLOR_PUEBLO : 0;
     } else {
-        escape[0] = '\0';
+        mode = COLOR_STRIP;
+    }
+    if (db[player].flags & PLAYER_NOBEEP) {
+        mode |= COLOR_NOBEEP;
     }
+    return mode;
+}
+
+/**
+ * color_render() into a stralloc'd string
+ */
+char *color_string(const char *str, int mode)
+{
+    char out[COLOR_BUFFER_SIZE];
 
-    return stralloc(escape);
+    color_render(out, sizeof(out), str, mode);
+    return stralloc(out);
 }
 
 /**
@@ -235,10 +363,6 @@ char *strip_beep(char *str)
     return stralloc(buf);
 }
 
-/* ===================================================================
- * Main Color Processing Functions
- * =================================================================== */
-
 /**
  * Process color markup in string
  * @param str Input string with |code+text| markup
@@ -248,95 +372,7 @@ char *strip_beep(char *str)
  */
 char *colorize(const char *str, int strip, int pueblo)
 {
-    char out[65535];
-    const char *s;
-    size_t opos = 0;
-
-    if (!str) {
-        return stralloc("");
-    }
-
-    for (s = str; *s && opos < sizeof(out) - 1; s++) {
-        if (*s != '|') {
-            out[opos++] = *s;
-            continue;
-        }
-
-        /* Look for color markup: |codes+text| */
-        const char *plus = NULL;
-        const char *scan;
-        for (scan = s + 1; *scan && *scan != '|'; scan++) {
-            if (*scan == '+' && !plus)
-                plus = scan;
-        }
-
-        if (!plus || !*scan) {
-            /* Not a valid color code — output the | literally */
-            out[opos++] = *s;
-            continue;
-        }
-
-        /* s points to opening |, plus points to +, scan points to closing | */
-        const char *text_start = plus + 1;
-        const char *text_end = scan;
-
-        /* Handle curly braces: |codes+{text with | bars}| */
-        if (*text_start == '{') {
-            const char *end_curl = strchr(text_start + 1, '}');
-            if (end_curl && *(end_curl + 1) == '|') {
-                text_start++;          /* skip { */
-                text_end = end_curl;   /* points to } */
-                scan = end_curl + 1;   /* points to closing | */
-            }
-        }
-
-        if (!strip) {
-            /* Emit ANSI/Pueblo escape for the color codes between | and + */
-            size_t code_len = (size_t)(plus - s - 1);
-            char codebuf[64];
-            if (code_len >= sizeof(codebuf))
-                code_len = sizeof(codebuf) - 1;
-            memcpy(codebuf, s + 1, code_len);
-            codebuf[code_len] = '\0';
-
-            char *markup;
-            if (!pueblo) {
-                markup = color_escape(codebuf);
-            } else {
-                markup = color_pueblo(codebuf);
-            }
-            if (markup) {
-                size_t mlen = strlen(markup);
-                if (opos + mlen < sizeof(out) - 1) {
-                    memcpy(out + opos, markup, mlen);
-                    opos += mlen;
-                }
-                SMART_FREE(markup);
-            }
-
-            /* Emit the text */
-            for (const char *t = text_start; t < text_end && opos < sizeof(out) - 1; t++)
-                out[opos++] = *t;
-
-            /* Emit reset */
-            const char *reset = pueblo ? normal_pueblo : normal_ansi;
-            size_t rlen = strlen(reset);
-            if (opos + rlen < sizeof(out) - 1) {
-                memcpy(out + opos, reset, rlen);
-                opos += rlen;
-            }
-        } else {
-            /* Strip mode — just emit the text */
-            for (const char *t = text_start; t < text_end && opos < sizeof(out) - 1; t++)
-                out[opos++] = *t;
-        }
-
-        /* Advance s to the closing |; the for loop s++ will move past it */
-        s = scan;
-    }
-
-    out[opos] = '\0';
-    return stralloc(out);
+    return color_string(str, strip ? COLOR_STRIP : (pueblo ? COLOR_PUEBLO : 0));
 }
 
 /**
@@ -409,7 +445,7 @@ char *truncate_color(char *str, int num)
  */
 char *strip_color(const char *str)
 {
-    return colorize(str, 1, 0);
+    return color_string(str, COLOR_STRIP);
 }
 
 /**
@@ -417,10 +453,7 @@ char *strip_color(const char *str)
  */
 char *strip_color_nobeep(char *str)
 {
-    char *temp = strip_beep(str);
-    char *result = colorize(temp, 1, 0);
-    SMART_FREE(temp);
-    return result;
+    return color_string(str, COLOR_STRIP | COLOR_NOBEEP);
 }
 
 /**
@@ -430,7 +463,7 @@ char *strip_color_nobeep(char *str)
  */
 char *parse_color(const char *str, int pueblo)
 {
-    return colorize(str, 0, pueblo);
+    return color_string(str, pueblo ? COLOR_PUEBLO : 0);
 }
 
 /**
@@ -438,10 +471,7 @@ char *parse_color(const char *str, int pueblo)
  */
 char *parse_color_nobeep(char *str, int pueblo)
 {
-    char *temp = strip_beep(str);
-    char *result = colorize(temp, 0, pueblo);
-    SMART_FREE(temp);
-    return result;
+    return color_string(str, (pueblo ? COLOR_PUEBLO : 0) | COLOR_NOBEEP);
 }
 
 /* ===================================================================
@@ -561,96 +591,3 @@ char *html_remove(dbref player, char *msg)
 
     return stralloc(buildmsg);
 }
-
-/**
- * Convert color code to Pueblo color name
- */
-static const char *pueblo_color(int num)
-{
-    switch (num) {
-        case 4:  return "underline";
-#ifdef BLINK
-        case 5:  return "blink";
-#endif
-        case 30:
-        case 40: return "black";
-        case 31:
-        case 41: return "red";
-        case 32:
-        case 42: return "green";
-        case 33:
-        case 43: return "yellow";
-        case 34:
-        case 44: return "blue";
-        case 35:
-        case 45: return "magenta";
-        case 36:
-        case 46: return "cyan";
-        case 37:
-        case 47: return "white";
-        default: return NULL;
-    }
-}
-
-/**
- * Build Pueblo font tag string
- */
-static char *make_font_string(const char *fore, const char *back, int ca)
-{
-    char buff[512];
-    size_t pos = 0;
-
-    buff[0] = '\0';
-
-    if (fore) {
-        pos += snprintf(buff + pos, sizeof(buff) - pos, "fgcolor=\"%s\" ", fore);
-    }
-
-    if (back) {
-        pos += snprintf(buff + pos, sizeof(buff) - pos, "bgcolor=\"%s\" ", back);
-    }
-
-    if (ca > 0) {
-        if (ca & CA_UNDERLINE) {
-            pos += snprintf(buff + pos, sizeof(buff) - pos, "style=\"text-decoration:underline\" ");
-        }
-    }
-
-    return stralloc(buff);
-}
-
-/**
- * Convert color codes to Pueblo HTML tags
- */
-static char *color_pueblo(const char *s)
-{
-    char escape[512];
-    const char *foreground = "FFFFFF";
-    const char *background = "000000";
-    int attribs = 0;
-    int valid = 0;
-
-    for (; *s; s++) {
-        int num = color2num(*s);
-        if (num > 0) {
-            valid = 1;
-            if (is_foreground(num)) {
-                foreground = pueblo_color(num);
-            } else if (is_background(num)) {
-                background = pueblo_color(num);
-            } else {
-                set_ca(&attribs, num);
-            }
-        }
-    }
-
-    if (valid) {
-        char *font_str = make_font_string(foreground, background, attribs);
-        snprintf(escape, sizeof(escape), "<font %s>", font_str);
-        SMART_FREE(font_str);
-    } else {
-        escape[0] = '\0';
-    }
-
-    return stralloc(escape);
-}
@@ -336,6 +336,7 @@ void check_connect(struct descriptor_data *d, char *msg)
         d->state = CONNECTED;
         d->connected_at = now;
         d->player = player;
+        descriptor_index(d);
 
         log_io(tprintf("TOKEN CONNECT: account %ld concid %ld player "
                        "%s(#%" DBREF_FMT ")",
@@ -389,6 +390,7 @@ void check_connect(struct descriptor_data *d, char *msg)
                 d->state = CONNECTED;
                 d->connected_at = now;
                 d->player = player;
+                descriptor_index(d);
 
                 send_message_text(d, motd_msg, 0);
                 announce_connect(player);
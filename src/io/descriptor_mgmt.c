@@ -5,6 +5,8 @@
 #include "config.h"
 #include "externs.h"
 #include "io_internal.h"
+#include "mariadb_channel.h"
+#include "mccp.h"
 
 /* Internal structure for connection tracing */
 struct ctrace_int {
@@ -30,13 +32,91 @@ struct ctrace_int {
 //    }
 //}
 
+/* === PLAYER INDEX === */
+
+/* Besides descriptor_list, every CONNECTED descriptor whose d->player is
+ * a valid object is chained off db[player].descs through pnext/pprev, so
+ * notifying a player or asking whether they are connected costs nothing
+ * per other connection.  Anything that changes d->state or d->player
+ * calls descriptor_index() afterwards; shutdownsock() unindexes before
+ * freeing.  The head is reached through d->indexed rather than a pointer
+ * into db[], which moves when the database grows.  A player's first
+ * connection and last disconnection also re-file their channel
+ * memberships, which keep their own list of who is listening. */
+
+/* File d under the player it is connected as (or under nobody) */
+void descriptor_index(struct descriptor_data *d)
+{
+    dbref want;
+
+    if (!d) {
+        return;
+    }
+
+    want = (d->state == CONNECTED && GoodObject(d->player))
+           ? d->player : NOTHING;
+    if (want == d->indexed) {
+        return;
+    }
+
+    descriptor_unindex(d);
+    if (want == NOTHING) {
+        return;
+    }
+
+    d->pprev = NULL;
+    d->pnext = db[want].descs;
+    if (d->pnext) {
+        d->pnext->pprev = d;
+    }
+    db[want].descs = d;
+    d->indexed = want;
+
+    if (!d->pnext) {
+        channel_cache_update_online(want);
+    }
+}
+
+/* Take d out of its player's chain */
+void descriptor_unindex(struct descriptor_data *d)
+{
+    dbref player;
+
+    if (!d || d->indexed == NOTHING) {
+        return;
+    }
+
+    if (d->pprev) {
+        d->pprev->pnext = d->pnext;
+    } else {
+        db[d->indexed].descs = d->pnext;
+    }
+    if (d->pnext) {
+        d->pnext->pprev = d->pprev;
+    }
+    player = d->indexed;
+    d->pnext = NULL;
+    d->pprev = NULL;
+    d->indexed = NOTHING;
+
+    if (!db[player].descs) {
+        channel_cache_update_online(player);
+    }
+}
+
+/* First connected descriptor of player (follow ->pnext), NULL if none */
+struct descriptor_data *player_descriptors(dbref player)
+{
+    return GoodObject(player) ? db[player].descs : NULL;
+}
+
 /* Check if a player is connected via emergency bypass */
 int is_emergency_session(dbref player)
 {
     struct descriptor_data *d;
 
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == player && d->emergency_bypass) {
+    for (d = player_descriptors(player); d; d = d->pnext) {
+        if (d->emergency_bypass) {
             return 1;
         }
     }
@@ -219,8 +299,8 @@ void announce_disconnect(dbref player)
 
     /* Check if this is a partial disconnect (player has other connections) */
     num = 0;
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player > 0 && d->player == player) {
+    if (player > 0) {
+        for (d = player_descriptors(player); d; d = d->pnext) {
             num++;
         }
     }
@@ -391,14 +471,14 @@ static void ctrace_notify_internal(dbref player, struct ctrace_int *d, int dep)
     /* Format descriptor info */
     if (d->des && dep) {
         snprintf(buf + j, sizeof(buf) - j,
-                "%s descriptor: %d, concid: %ld, host: %s@%s",
+                "%s descriptor: %d, concid: %ld, host: %s@%s%s",
                 (d->des->state == CONNECTED)
                     ? tprintf("\"%s\"", unparse_object(player, d->des->player))
                     : ((d->des->cstatus & C_CCONTROL)
                         ? "<Concentrator Control>"
                         : "<Unconnected>"),
                 d->des->descriptor, d->des->concid, 
-                d->des->user, d->des->addr);
+                d->des->user, d->des->addr, mccp_status(d->des));
         buf[sizeof(buf) - 1] = '\0';
         notify(player, buf);
     }
@@ -0,0 +1,458 @@
+/* event_loop.c - Readiness notification for the main server loop
+ *
+ * shovechars() used to rebuild two fd_sets from the whole descriptor list
+ * every pass and then walk the list again after select() to find the few
+ * sockets that were actually ready.  This module keeps the interest set
+ * registered instead: descriptors announce themselves once when opened,
+ * update their interest only when their queues change (ev_sync), and the
+ * main loop visits nothing but the fds ev_wait() reported.
+ *
+ * The timerfd behind the job scheduler (timer.c) sits in the same set, so
+ * periodic jobs and @wait deadlines wake the loop without signals.
+ *
+ * Backends:
+ *   epoll  - Linux, level-triggered.  An fd whose interest drops to
+ *            nothing is removed from the kernel set so a hung-up peer
+ *            with paused reads cannot report EPOLLHUP on every pass.
+ *   select - Everywhere else, or when epoll_create1() fails, or with
+ *            NO_EPOLL defined in config.h.  Same semantics, limited to
+ *            FD_SETSIZE.
+ *
+ * Registration is level-triggered on purpose: process_input() reads one
+ * buffer per pass and command quotas pause reads entirely, so the loop
+ * relies on being told again about data it left in the socket.
+ */
+
+#include "config.h"
+#include "externs.h"
+#include "io_internal.h"
+#include "event_loop.h"
+#include "mccp.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/select.h>
+
+#if defined(__linux__) && !defined(NO_EPOLL)
+#define HAVE_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+/* Per-fd registration, indexed by fd */
+struct ev_slot {
+    void *data;
+    int kind;      /* 0 when the slot is free */
+    int mask;      /* EV_READ/EV_WRITE interest */
+    int ready;     /* readiness collected by the last ev_wait() */
+    int in_kernel; /* epoll: currently in the kernel set */
+};
+
+static struct ev_slot *ev_slots = NULL;
+static int ev_nslots = 0;
+
+/* fds reported by the last ev_wait(), consumed by ev_next() */
+static int *ev_ready_fds = NULL;
+static int ev_nready = 0;
+static int ev_ready_pos = 0;
+
+static int listen_fd = -1;
+
+int ev_input_waiting = 0;
+
+#ifdef HAVE_EPOLL
+#define EV_BATCH 256
+static int epoll_fd = -1;
+static struct epoll_event ev_events[EV_BATCH];
+#endif
+
+/* select backend state */
+static int use_select = 0;
+static fd_set sel_read, sel_write;
+static int sel_maxfd = -1;
+
+static int ev_started = 0;
+
+/* === SETUP === */
+
+static void ev_start(void)
+{
+    if (ev_started) {
+        return;
+    }
+    ev_started = 1;
+
+    FD_ZERO(&sel_read);
+    FD_ZERO(&sel_write);
+    use_select = 1;
+
+#ifdef HAVE_EPOLL
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd >= 0) {
+        use_select = 0;
+    } else {
+        log_error(tprintf("epoll_create1 failed (%s), using select()",
+                          strerror(errno)));
+    }
+#endif
+
+    log_io(tprintf("Event loop backend: %s", ev_backend()));
+}
+
+const char *ev_backend(void)
+{
+    return use_select ? "select" : "epoll";
+}
+
+/* Make sure slot fd exists */
+static void ev_grow(int fd)
+{
+    struct ev_slot *slots;
+    int *fds;
+    int n;
+
+    if (fd < ev_nslots) {
+        return;
+    }
+
+    n = ev_nslots ? ev_nslots : 64;
+    while (n <= fd) {
+        n *= 2;
+    }
+
+    SAFE_MALLOC(slots, struct ev_slot, (size_t)n);
+    SAFE_MALLOC(fds, int, (size_t)n);
+    memset(slots, 0, sizeof(struct ev_slot) * (size_t)n);
+
+    if (ev_slots) {
+        memcpy(slots, ev_slots, sizeof(struct ev_slot) * (size_t)ev_nslots);
+        memcpy(fds, ev_ready_fds, sizeof(int) * (size_t)ev_nready);
+        SMART_FREE(ev_slots);
+        SMART_FREE(ev_ready_fds);
+    }
+
+    ev_slots = slots;
+    ev_ready_fds = fds;
+    ev_nslots = n;
+}
+
+/* === KERNEL INTEREST === */
+
+/* Push slot fd's mask to the backend */
+static void ev_apply(int fd)
+{
+    struct ev_slot *s = &ev_slots[fd];
+
+    if (use_select) {
+        if (s->mask & EV_READ) {
+            FD_SET(fd, &sel_read);
+        } else {
+            FD_CLR(fd, &sel_read);
+        }
+        if (s->mask & EV_WRITE) {
+            FD_SET(fd, &sel_write);
+        } else {
+            FD_CLR(fd, &sel_write);
+        }
+        if (s->mask && fd > sel_maxfd) {
+            sel_maxfd = fd;
+        }
+        return;
+    }
+
+#ifdef HAVE_EPOLL
+    {
+        struct epoll_event e;
+        int op;
+
+        memset(&e, 0, sizeof(e));
+        e.data.fd = fd;
+        if (s->mask & EV_READ) {
+            e.events |= EPOLLIN;
+        }
+        if (s->mask & EV_WRITE) {
+            e.events |= EPOLLOUT;
+        }
+
+        if (!s->mask) {
+            if (!s->in_kernel) {
+                return;
+            }
+            op = EPOLL_CTL_DEL;
+        } else {
+            op = s->in_kernel ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        }
+
+        if (epoll_ctl(epoll_fd, op, fd, &e) < 0) {
+            /* EBADF/ENOENT: the fd was closed under us, which already
+             * removed it from the kernel set */
+            if (errno != EBADF && errno != ENOENT) {
+                log_error(tprintf("epoll_ctl(%d) on fd %d: %s", op, fd,
+                                  strerror(errno)));
+            }
+            s->in_kernel = 0;
+            return;
+        }
+        s->in_kernel = (op != EPOLL_CTL_DEL);
+    }
+#endif
+}
+
+/* === REGISTRATION === */
+
+int ev_add(int fd, int kind, void *data, int mask)
+{
+    if (fd < 0) {
+        return -1;
+    }
+
+    ev_start();
+
+    if (use_select && fd >= FD_SETSIZE) {
+        log_error(tprintf("event loop: fd %d exceeds FD_SETSIZE", fd));
+        return -1;
+    }
+
+    ev_grow(fd);
+    if (ev_slots[fd].kind) {
+        ev_del(fd);
+    }
+
+    ev_slots[fd].data = data;
+    ev_slots[fd].kind = kind;
+    ev_slots[fd].mask = mask & (EV_READ | EV_WRITE);
+    ev_slots[fd].ready = 0;
+    ev_slots[fd].in_kernel = 0;
+    ev_apply(fd);
+    return 0;
+}
+
+void ev_mod(int fd, int mask)
+{
+    mask &= EV_READ | EV_WRITE;
+
+    if (fd < 0 || fd >= ev_nslots || !ev_slots[fd].kind ||
+        ev_slots[fd].mask == mask) {
+        return;
+    }
+
+    ev_slots[fd].mask = mask;
+    ev_apply(fd);
+}
+
+void ev_del(int fd)
+{
+    if (fd < 0 || fd >= ev_nslots || !ev_slots[fd].kind) {
+        return;
+    }
+
+    ev_slots[fd].mask = 0;
+    ev_apply(fd);
+    ev_slots[fd].kind = 0;
+    ev_slots[fd].data = NULL;
+    ev_slots[fd].ready = 0;
+
+    if (use_select && fd == sel_maxfd) {
+        while (sel_maxfd >= 0 && !(ev_slots[sel_maxfd].kind &&
+                                   ev_slots[sel_maxfd].mask)) {
+            sel_maxfd--;
+        }
+    }
+}
+
+void ev_listen(int fd, int accepting)
+{
+    /* make_socket() may have run again (accept trouble or resock),
+     * possibly handing back the same fd number */
+    if (fd != listen_fd || fd < 0 || fd >= ev_nslots ||
+        ev_slots[fd].kind != EV_LISTEN) {
+        if (listen_fd >= 0 && listen_fd < ev_nslots &&
+            ev_slots[listen_fd].kind == EV_LISTEN) {
+            ev_del(listen_fd);
+        }
+        listen_fd = -1;
+        if (fd >= 0 && ev_add(fd, EV_LISTEN, NULL, 0) == 0) {
+            listen_fd = fd;
+        }
+    }
+
+    if (listen_fd >= 0) {
+        ev_mod(listen_fd, accepting ? EV_READ : 0);
+    }
+}
+
+/* === WAITING === */
+
+int ev_wait(struct timeval *timeout)
+{
+    int found, fd, ready;
+
+    ev_start();
+    ev_nready = 0;
+    ev_ready_pos = 0;
+
+    if (use_select) {
+        fd_set rset, wset;
+
+        rset = sel_read;
+        wset = sel_write;
+        found = select(sel_maxfd + 1, &rset, &wset, (fd_set *)0, timeout);
+        if (found <= 0) {
+            return found;
+        }
+
+        for (fd = 0; fd <= sel_maxfd && ev_nready < found; fd++) {
+            ready = 0;
+            if (FD_ISSET(fd, &rset)) {
+                ready |= EV_READ;
+            }
+            if (FD_ISSET(fd, &wset)) {
+                ready |= EV_WRITE;
+            }
+            if (ready && ev_slots[fd].kind) {
+                ev_slots[fd].ready = ready;
+                ev_ready_fds[ev_nready++] = fd;
+            }
+        }
+        return ev_nready;
+    }
+
+#ifdef HAVE_EPOLL
+    {
+        long usec, msec;
+        int i;
+
+        /* Round up so a pending @wait or quota slice isn't woken early
+         * into a busy poll; sub-millisecond timeouts just poll.  The
+         * main loop never asks for more than 100 seconds. */
+        usec = (long)timeout->tv_sec * 1000000L + (long)timeout->tv_usec;
+        if (usec < 1000L) {
+            msec = 0;
+        } else if (usec > 100000000L) {
+            msec = 100000L;
+        } else {
+            msec = (usec + 999L) / 1000L;
+        }
+
+        found = epoll_wait(epoll_fd, ev_events, EV_BATCH, (int)msec);
+        if (found <= 0) {
+            return found;
+        }
+
+        for (i = 0; i < found; i++) {
+            uint32_t e = ev_events[i].events;
+
+            fd = ev_events[i].data.fd;
+            if (fd < 0 || fd >= ev_nslots || !ev_slots[fd].kind) {
+                continue;
+            }
+
+            /* Errors and hangups surface through whichever direction
+             * is wanted, so read()/write() see them as select did */
+            ready = 0;
+            if (e & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                ready |= EV_READ;
+            }
+            if (e & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                ready |= EV_WRITE;
+            }
+            ready &= ev_slots[fd].mask;
+            if (ready) {
+                ev_slots[fd].ready = ready;
+                ev_ready_fds[ev_nready++] = fd;
+            }
+        }
+        return ev_nready;
+    }
+#else
+    return 0;
+#endif
+}
+
+int ev_next(int *fd, int *kind, void **data)
+{
+    int f, ready;
+
+    while (ev_ready_pos < ev_nready) {
+        f = ev_ready_fds[ev_ready_pos++];
+
+        /* Slots deleted (or reused) since ev_wait() have ready == 0 */
+        ready = ev_slots[f].ready;
+        ev_slots[f].ready = 0;
+        if (!ready || !ev_slots[f].kind) {
+            continue;
+        }
+
+        *fd = f;
+        *kind = ev_slots[f].kind;
+        *data = ev_slots[f].data;
+        return ready;
+    }
+
+    return 0;
+}
+
+/* === DESCRIPTORS === */
+
+static int ev_owns(struct descriptor_data *d)
+{
+    int fd = d->descriptor;
+
+    return fd >= 0 && fd < ev_nslots && ev_slots[fd].kind == EV_DESC &&
+           ev_slots[fd].data == d;
+}
+
+int ev_attach(struct descriptor_data *d)
+{
+    if (!d || (d->cstatus & (C_REMOTE | C_WEBSOCKET))) {
+        return 0;
+    }
+
+    d->ev_mask = 0;
+    if (ev_add(d->descriptor, EV_DESC, d, 0) < 0) {
+        return -1;
+    }
+    ev_sync(d);
+    return 0;
+}
+
+void ev_detach(struct descriptor_data *d)
+{
+    if (!d || !ev_owns(d)) {
+        return;
+    }
+
+    if (d->ev_mask & EV_HELD) {
+        ev_input_waiting--;
+    }
+    d->ev_mask = 0;
+    ev_del(d->descriptor);
+}
+
+void ev_sync(struct descriptor_data *d)
+{
+    int want = 0;
+
+    if (!d || !ev_owns(d)) {
+        return;
+    }
+
+    /* Queued input pauses reads until process_commands() drains it;
+     * the main loop wakes on the next quota slice instead */
+    if (d->input.head) {
+        want |= EV_HELD;
+    } else {
+        want |= EV_READ;
+    }
+    if ((d->output_size || mccp_pending(d)) &&
+        (d->state != CONNECTED || d->player > 0)) {
+        want |= EV_WRITE;
+    }
+
+    if ((want ^ d->ev_mask) & EV_HELD) {
+        ev_input_waiting += (want & EV_HELD) ? 1 : -1;
+    }
+    if ((want ^ d->ev_mask) & (EV_READ | EV_WRITE)) {
+        ev_mod(d->descriptor, want);
+    }
+    d->ev_mask = want;
+}
@@ -72,11 +72,7 @@ void check_for_idlers_int(dbref player, char *msg)
                 long shortest_idle = idle_time;
 
                 /* Check all connections for this player */
-                for (e = descriptor_list; e; e = e->next) {
-                    if (e->state != CONNECTED || e->player != d->player) {
-                        continue;
-                    }
-                    
+                for (e = player_descriptors(d->player); e; e = e->pnext) {
                     total_conn++;
                     
                     long this_idle = now - e->last_time;
@@ -150,21 +146,19 @@ void check_for_connect_unidlers(dbref player)
     }
 
     /* Count active connections for this player */
-    for (d = descriptor_list; !found && d; d = d->next) {
-        if (d->state == CONNECTED && d->player == player) {
-            conn++;
-            
-            /* If they have multiple connections, un-idle them */
-            if (conn > 1) {
-                log_io(tprintf("%s unidled due to reconnect.", 
-                              db[player].cname));
-                com_send_as_hidden("pub_io",
-                    tprintf("%s unidled due to reconnect.",
-                           db[player].cname),
-                    player);
-                set_unidle(player, INT_MAX);
-                found = 1;
-            }
+    for (d = player_descriptors(player); !found && d; d = d->pnext) {
+        conn++;
+        
+        /* If they have multiple connections, un-idle them */
+        if (conn > 1) {
+            log_io(tprintf("%s unidled due to reconnect.", 
+                          db[player].cname));
+            com_send_as_hidden("pub_io",
+                tprintf("%s unidled due to reconnect.",
+                       db[player].cname),
+                player);
+            set_unidle(player, INT_MAX);
+            found = 1;
         }
     }
 }
@@ -5,6 +5,8 @@
 #include "config.h"
 #include "externs.h"
 #include "io_internal.h"
+#include "event_loop.h"
+#include "mccp.h"
 #include <ctype.h>
 #include <unistd.h>
 
@@ -38,6 +40,7 @@ void save_command(struct descriptor_data *d, const char *command)
     }
     
     add_to_queue(&d->input, command, strlen(command) + 1);
+    ev_sync(d);
 }
 
 /* Set a user string (output prefix/suffix) */
@@ -68,6 +71,51 @@ void set_userstring(char **userstring, const char *command)
     }
 }
 
+/* d->telnet states besides 0 (plain text) and the WILL/WONT/DO/DONT
+ * byte itself, which waits for its option */
+#define TS_IAC    1
+#define TS_SB     2
+#define TS_SB_IAC 3
+
+/* Consume one byte of a telnet command.  Only COMPRESS2 is acted on;
+ * everything else is skipped so option bytes do not end up in the
+ * command line.  Returns 1 if the byte is data after all (the second
+ * 0xFF of IAC IAC). */
+static int telnet_byte(struct descriptor_data *d, int c)
+{
+    switch (d->telnet) {
+        case TS_IAC:
+            if (c >= TN_WILL && c <= TN_DONT) {
+                d->telnet = c;
+            } else if (c == TN_SB) {
+                d->telnet = TS_SB;
+            } else {
+                d->telnet = 0;
+                return c == TN_IAC;     /* NOP, GA, ... are dropped */
+            }
+            break;
+        case TS_SB:
+            if (c == TN_IAC) {
+                d->telnet = TS_SB_IAC;
+            }
+            break;
+        case TS_SB_IAC:
+            d->telnet = (c == TN_SE) ? 0 : TS_SB;
+            break;
+        default:
+            if (c == TELOPT_COMPRESS2) {
+                if (d->telnet == TN_DO) {
+                    mccp_start(d);
+                } else if (d->telnet == TN_DONT) {
+                    mccp_end(d);
+                }
+            }
+            d->telnet = 0;
+            break;
+    }
+    return 0;
+}
+
 /* Process input from a descriptor */
 int process_input(struct descriptor_data *d)
 {
@@ -100,6 +148,16 @@ int process_input(struct descriptor_data *d)
 
     /* Process received data */
     for (q = buf, qend = buf + got; q < qend; q++) {
+        if (d->telnet) {
+            /* IAC IAC is a data byte, and goes through the same filter
+             * as any other */
+            if (!telnet_byte(d, (unsigned char)*q)) {
+                continue;
+            }
+        } else if ((unsigned char)*q == TN_IAC) {
+            d->telnet = TS_IAC;
+            continue;
+        }
         if (*q == '\n') {
             /* End of line - save command */
             *p = '\0';
@@ -151,6 +209,7 @@ void process_commands(void)
                 d->input.head = t->nxt;
                 if (!d->input.head) {
                     d->input.tail = &d->input.head;
+                    ev_sync(d);
                 }
                 free_text_block(t);
                 
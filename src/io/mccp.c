@@ -0,0 +1,404 @@
+/* mccp.c - MCCP v2 output compression for telnet connections
+ *
+ * Most MU* clients speak MCCP v2: the server says IAC WILL COMPRESS2,
+ * the client answers IAC DO COMPRESS2, and after IAC SB COMPRESS2 IAC SE
+ * every byte the server sends is part of one zlib stream.  Room
+ * descriptions, help text and WHO lists shrink several times over.
+ *
+ * The output ring (text_queue.c) keeps holding plain text, so the
+ * max_output limit and flush_output() work on what the player will
+ * actually see.  Each descriptor has its own deflate stream and a buffer
+ * of wire bytes waiting for the socket.  process_output() compresses
+ * the whole ring into that buffer only once the previous batch has been
+ * written.  While the client is slow, new text waits in the ring, where
+ * flush_output() can still drop old lines; compressed bytes are never
+ * thrown away, so the stream cannot be corrupted by a flush.
+ *
+ * Each batch ends with a Z_SYNC_FLUSH.  A batch is everything queued
+ * since the last write, so it ends on whatever line or prompt the game
+ * last produced, and the client can show it straight away.
+ *
+ * A stream is finished (Z_FINISH) if the client says DONT, and before a
+ * reboot or shutdown message is written straight to the sockets; that
+ * waits, for all connections at once, until every stream has been sent
+ * (mccp_drain_all()), so plain text never lands in the middle of one.
+ */
+
+#include "config.h"
+#include "externs.h"
+#include "io_internal.h"
+#include "event_loop.h"
+#include "mccp.h"
+#include "websocket.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+#ifdef USE_MCCP
+
+#include <zlib.h>
+
+/* Smaller than zlib's defaults (32K window, memLevel 8, about 256K per
+ * stream); game text compresses nearly as well with this, for about a
+ * third of the memory on every connection */
+#define MCCP_WINDOW_BITS 13
+#define MCCP_MEM_LEVEL   7
+
+/* Wire buffers grow by at least this much at a time */
+#define MCCP_CHUNK 4096
+
+struct mccp_stream {
+    z_stream z;
+    unsigned char *buf;         /* wire bytes not yet written */
+    int size;
+    int len;                    /* bytes in buf */
+    int sent;                   /* of which already written */
+    int ended;                  /* Z_FINISH done; drop once buf drains */
+    unsigned long in;           /* plain text compressed */
+    unsigned long out;          /* compressed bytes produced */
+};
+
+/* Statistics for @info compression */
+static int streams_active = 0;
+static unsigned long streams_started = 0;
+static unsigned long bytes_in = 0;
+static unsigned long bytes_out = 0;
+
+/* === WIRE BUFFER === */
+
+/* Make room for n more bytes after s->len, dropping what has been sent */
+static int mccp_reserve(struct mccp_stream *s, int n)
+{
+    unsigned char *buf;
+    int size, keep;
+
+    keep = s->len - s->sent;
+    if (s->sent && keep + n <= s->size) {
+        memmove(s->buf, s->buf + s->sent, (size_t)keep);
+        s->len = keep;
+        s->sent = 0;
+    }
+    if (s->len + n <= s->size) {
+        return 1;
+    }
+
+    for (size = s->size ? s->size : MCCP_CHUNK; size < keep + n; size <<= 1)
+        ;
+
+    SAFE_MALLOC(buf, unsigned char, (size_t)size);
+    if (!buf) {
+        log_error("Failed to allocate MCCP buffer");
+        return 0;
+    }
+    if (keep) {
+        memcpy(buf, s->buf + s->sent, (size_t)keep);
+    }
+    if (s->buf) {
+        SMART_FREE(s->buf);
+    }
+    s->buf = buf;
+    s->size = size;
+    s->len = keep;
+    s->sent = 0;
+    return 1;
+}
+
+/* Append bytes to the wire buffer as they are */
+static int mccp_append(struct mccp_stream *s, const void *b, size_t n)
+{
+    if (!mccp_reserve(s, (int)n)) {
+        return 0;
+    }
+    memcpy(s->buf + s->len, b, n);
+    s->len += (int)n;
+    return 1;
+}
+
+/* Feed n bytes through deflate into the wire buffer */
+static int mccp_deflate(struct mccp_stream *s, const void *b, size_t n, int flush)
+{
+    unsigned long produced = 0;
+    uInt room;
+
+    s->z.next_in = (Bytef *)b;
+    s->z.avail_in = (uInt)n;
+    do {
+        if (!mccp_reserve(s, MCCP_CHUNK)) {
+            return 0;
+        }
+        s->z.next_out = s->buf + s->len;
+        s->z.avail_out = room = (uInt)(s->size - s->len);
+        if (deflate(&s->z, flush) == Z_STREAM_ERROR) {
+            log_error("MCCP deflate failed");
+            return 0;
+        }
+        produced += room - s->z.avail_out;
+        s->len = s->size - (int)s->z.avail_out;
+    } while (s->z.avail_out == 0);
+
+    s->in += n;
+    s->out += produced;
+    bytes_in += n;
+    bytes_out += produced;
+    return 1;
+}
+
+/* Compress everything in the ring, ending with flush */
+static int mccp_compress_queue(struct descriptor_data *d, int flush)
+{
+    struct iovec iov[2];
+    int n, i;
+
+    n = output_peek(d, iov);
+    for (i = 0; i < n; i++) {
+        if (!mccp_deflate(d->mccp, iov[i].iov_base, iov[i].iov_len, Z_NO_FLUSH)) {
+            return 0;
+        }
+    }
+    if (!mccp_deflate(d->mccp, NULL, 0, flush)) {
+        return 0;
+    }
+    output_consume(d, d->output_size);
+    return 1;
+}
+
+/* === NEGOTIATION === */
+
+void mccp_offer(struct descriptor_data *d)
+{
+    static const unsigned char will[] = {TN_IAC, TN_WILL, TELOPT_COMPRESS2};
+
+    if (!d || !mccp_compression || (d->cstatus & (C_REMOTE | C_WEBSOCKET))) {
+        return;
+    }
+    d->cstatus |= C_MCCP;
+    queue_write(d, (const char *)will, sizeof(will));
+}
+
+void mccp_start(struct descriptor_data *d)
+{
+    static const unsigned char start[] = {TN_IAC, TN_SB, TELOPT_COMPRESS2,
+                                          TN_IAC, TN_SE};
+    struct mccp_stream *s;
+    struct iovec iov[2];
+    int n, i;
+
+    if (!d || !(d->cstatus & C_MCCP) || d->mccp) {
+        return;
+    }
+
+    SAFE_MALLOC(s, struct mccp_stream, 1);
+    if (!s) {
+        log_error("Failed to allocate MCCP stream");
+        return;
+    }
+    memset(s, 0, sizeof(*s));
+    if (deflateInit2(&s->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     MCCP_WINDOW_BITS, MCCP_MEM_LEVEL,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        log_error(tprintf("MCCP deflateInit failed for concid %ld", d->concid));
+        SMART_FREE(s);
+        return;
+    }
+    d->mccp = s;
+    streams_active++;
+    streams_started++;
+
+    /* Text already queued was meant for an uncompressed connection; it
+     * goes out as it is, ahead of the start marker */
+    n = output_peek(d, iov);
+    for (i = 0; i < n; i++) {
+        if (!mccp_append(s, iov[i].iov_base, iov[i].iov_len)) {
+            mccp_free(d);
+            return;
+        }
+    }
+    output_consume(d, d->output_size);
+    if (!mccp_append(s, start, sizeof(start))) {
+        mccp_free(d);
+        return;
+    }
+    ev_sync(d);
+}
+
+void mccp_end(struct descriptor_data *d)
+{
+    struct mccp_stream *s;
+
+    if (!d || !(s = d->mccp) || s->ended) {
+        return;
+    }
+
+    if (!mccp_compress_queue(d, Z_FINISH)) {
+        /* The client cannot decode past this point anyway */
+        output_consume(d, d->output_size);
+    }
+    deflateEnd(&s->z);
+    s->ended = 1;
+    ev_sync(d);
+}
+
+/* === OUTPUT === */
+
+int mccp_output(struct descriptor_data *d)
+{
+    struct mccp_stream *s = d->mccp;
+    ssize_t cnt;
+
+    /* Only compress more once the last batch is on the wire */
+    if (s->sent == s->len && !s->ended && d->output_size) {
+        if (!mccp_compress_queue(d, Z_SYNC_FLUSH)) {
+            return 0;
+        }
+    }
+
+    if (s->sent < s->len) {
+        cnt = write(d->descriptor, s->buf + s->sent, (size_t)(s->len - s->sent));
+        if (cnt < 0) {
+            return errno == EWOULDBLOCK;
+        }
+        s->sent += (int)cnt;
+    }
+
+    if (s->sent == s->len) {
+        s->sent = s->len = 0;
+        if (s->ended) {
+            mccp_free(d);
+        }
+    }
+    return 1;
+}
+
+void mccp_drain_all(int msec)
+{
+    struct descriptor_data *d, **dv;
+    struct pollfd *pv;
+    struct timeval start, tv;
+    int n = 0, i, live, left;
+
+    for (d = descriptor_list; d; d = d->next) {
+        if (d->mccp) {
+            n++;
+        }
+    }
+    if (!n) {
+        return;
+    }
+
+    SAFE_MALLOC(dv, struct descriptor_data *, (size_t)n);
+    SAFE_MALLOC(pv, struct pollfd, (size_t)n);
+    if (!dv || !pv) {
+        log_error("Failed to allocate MCCP drain list");
+        if (dv) {
+            SMART_FREE(dv);
+        }
+        if (pv) {
+            SMART_FREE(pv);
+        }
+        return;
+    }
+
+    n = 0;
+    for (d = descriptor_list; d; d = d->next) {
+        if (d->mccp) {
+            mccp_end(d);
+            dv[n++] = d;
+        }
+    }
+
+    gettimeofday(&start, NULL);
+    for (;;) {
+        /* Write what each socket will take; a failed write leaves the
+         * stream in place for the caller to find */
+        live = 0;
+        for (i = 0; i < n; i++) {
+            if (!(d = dv[i])) {
+                continue;
+            }
+            if (!mccp_output(d) || !d->mccp) {
+                dv[i] = NULL;
+                continue;
+            }
+            pv[live].fd = d->descriptor;
+            pv[live].events = POLLOUT;
+            pv[live].revents = 0;
+            live++;
+        }
+        if (!live) {
+            break;
+        }
+
+        gettimeofday(&tv, NULL);
+        left = msec - msec_diff(tv, start);
+        if (left <= 0) {
+            for (i = 0; i < n; i++) {
+                if (dv[i]) {
+                    log_io(tprintf("MCCP: concid %ld did not take its stream end",
+                                   dv[i]->concid));
+                }
+            }
+            break;
+        }
+        if (poll(pv, (nfds_t)live, left) < 0 && errno != EINTR) {
+            break;
+        }
+    }
+
+    SMART_FREE(pv);
+    SMART_FREE(dv);
+}
+
+int mccp_pending(struct descriptor_data *d)
+{
+    return d->mccp && d->mccp->sent < d->mccp->len;
+}
+
+void mccp_free(struct descriptor_data *d)
+{
+    struct mccp_stream *s;
+
+    if (!d || !(s = d->mccp)) {
+        return;
+    }
+    if (!s->ended) {
+        deflateEnd(&s->z);
+    }
+    if (s->buf) {
+        SMART_FREE(s->buf);
+    }
+    SMART_FREE(s);
+    d->mccp = NULL;
+    streams_active--;
+}
+
+const char *mccp_status(struct descriptor_data *d)
+{
+    if (!d || !d->mccp) {
+        return "";
+    }
+    if (!d->mccp->out) {
+        return ", mccp: on";
+    }
+    return tprintf(", mccp: %.1f:1",
+                   (double)d->mccp->in / (double)d->mccp->out);
+}
+
+#endif /* USE_MCCP */
+
+void info_mccp(dbref player)
+{
+#ifdef USE_MCCP
+    notify(player, tprintf("MCCP: %s (zlib %s)",
+                           mccp_compression ? "on" : "off", zlibVersion()));
+    notify(player, tprintf("Streams: %d active, %lu started",
+                           streams_active, streams_started));
+    notify(player, tprintf("Bytes: %lu in, %lu out, ratio %.1f:1",
+                           bytes_in, bytes_out,
+                           bytes_out ? (double)bytes_in / (double)bytes_out : 0.0));
+#else
+    notify(player, "MCCP: unavailable (built without zlib)");
+#endif
+    websocket_info(player);
+}
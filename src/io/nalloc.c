@@ -2,50 +2,85 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #ifdef MEMORY_DEBUG_LOG
 #include <time.h>
 #include <stdarg.h>
 #include <errno.h>
 #endif
 
-#define MAX_ALLOCATIONS 1000000
+/* Allocation tracking table: open-addressed pointer hash with linear
+ * probing.  Capacity is always a power of two and the table doubles once
+ * it passes 3/4 full, so track/untrack cost O(1) regardless of how many
+ * blocks are live.  Deletion uses backward-shift, so there are no
+ * tombstones to sweep. */
+#define ALLOC_TABLE_INITIAL (1 << 16)
+
+/* Temporary ("stack") allocations live in a ring of per-tick bump arenas.
+ * A block asked to survive N ticks is carved out of the arena for tick
+ * (now + N); clear_stack() advances the tick and releases that arena's
+ * chunks wholesale, so nothing is ever freed one block at a time.
+ * Chunks are aligned to their own size, which lets smart_free() map any
+ * pointer back to its chunk base with a mask and one hash probe. */
+#define ARENA_CHUNK_SIZE  (16 * 1024)   /* power of two */
+#define ARENA_LARGE       (ARENA_CHUNK_SIZE / 4)  /* gets a chunk of its own */
+#define ARENA_ALIGN       16
+#define ARENA_RING        256           /* must exceed the longest lifetime */
+#define ARENA_POOL_MAX    64            /* idle chunks kept for reuse */
+#define ARENA_PAD         50            /* extra ticks of slack on every block */
+#define ARENA_SET_INITIAL 256
 #ifdef MEMORY_DEBUG_LOG
 #define DEFAULT_CONTENT_LOG_SIZE 64
 #endif
 
-typedef struct mem_stack_t {
-      void *ptr;                /* information to be stored */
-      size_t size;              /* size of stuff allocated. */
-      int timer;                /* times through loops before killing. */
-      int perm;                 /* permanant flag */
-      struct mem_stack_t *prev; /* pointer to last peice of stack. */
-      struct mem_stack_t *next; /* pointer to next peice of stack. */
-} MSTACK;
+typedef struct arena_chunk {
+      struct arena_chunk *next; /* next chunk in the same generation/pool */
+      size_t size;              /* bytes including this header */
+      size_t used;              /* bump offset from chunk base */
+} ARENA_CHUNK;
 
 typedef struct {
-    void *ptr;
+      ARENA_CHUNK *head;        /* chunk currently being bumped */
+      size_t bytes;             /* bytes handed out from this generation */
+      size_t blocks;            /* blocks handed out from this generation */
+} ARENA_GEN;
+
+#define ARENA_HDR ((sizeof(ARENA_CHUNK) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+typedef struct {
+    void *ptr;                  /* key; NULL marks an empty slot */
     size_t size;
     const char *file;
     int line;
-    int active;
 #ifdef MEMORY_DEBUG_LOG
     unsigned long sequence;
 #endif
 } allocation_record_t;
 
 
-void __free_hunk(MSTACK *);
-void *stack_em_int(size_t, int, int);
-char *stralloc_int(char *, int);
+static int arena_owns(const void *);
 
 
-MSTACK *mem_stack;
-MSTACK *mem_first = NULL;
-MSTACK *mem_last = NULL;
 size_t number_stack_blocks = 0;
 size_t stack_size = 0;
-
-static allocation_record_t allocations[MAX_ALLOCATIONS];
+size_t number_stack_chunks = 0;
+
+static ARENA_GEN arena_ring[ARENA_RING];
+static unsigned long arena_tick = 0;
+static ARENA_CHUNK *arena_pool = NULL;
+static size_t arena_pool_count = 0;
+
+/* set of live chunk base addresses, open-addressed like the allocation table */
+static ARENA_CHUNK **arena_set = NULL;
+static size_t arena_set_capacity = 0;
+static size_t arena_set_count = 0;
+
+#ifdef MEMORY_TRACKING
+static allocation_record_t *allocations = NULL;
+static size_t alloc_capacity = 0;       /* slots, power of two */
+static size_t alloc_count = 0;          /* live tracked blocks */
+static size_t alloc_bytes = 0;          /* bytes in live tracked blocks */
+#endif
 static int initialized = 0;
 
 #ifdef MEMORY_DEBUG_LOG
@@ -170,6 +205,58 @@ void safe_memory_set_content_log_size(size_t max_bytes) {
 }
 #endif /* MEMORY_DEBUG_LOG */
 
+#ifdef MEMORY_TRACKING
+/* Fibonacci hash of a pointer.  The low bits of malloc() results are
+ * always zero, so shift them out before multiplying. */
+static size_t alloc_slot(const void *ptr, size_t mask) {
+    uintptr_t key = (uintptr_t)ptr >> 4;
+    return (size_t)((key * (uintptr_t)0x9E3779B97F4A7C15ULL) >> 16) & mask;
+}
+
+static allocation_record_t *alloc_table_new(size_t capacity) {
+    /* Raw calloc(): the tracker cannot track itself. */
+    allocation_record_t *table = calloc(capacity, sizeof(allocation_record_t));
+
+    if (!table) {
+        fprintf(stderr, "PANIC: Out of memory growing allocation table to %zu slots\n",
+                capacity);
+        fflush(stderr);
+#ifdef MEMORY_DEBUG_LOG
+        memdebug_log_ts("PANIC: Out of memory growing allocation table to %zu slots\n",
+                capacity);
+#endif
+        exit(1);
+    }
+    return table;
+}
+
+static void alloc_table_grow(void) {
+    allocation_record_t *old = allocations;
+    size_t old_capacity = alloc_capacity;
+    size_t mask;
+
+    alloc_capacity = old_capacity * 2;
+    allocations = alloc_table_new(alloc_capacity);
+    mask = alloc_capacity - 1;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].ptr) {
+            size_t slot = alloc_slot(old[i].ptr, mask);
+            while (allocations[slot].ptr) {
+                slot = (slot + 1) & mask;
+            }
+            allocations[slot] = old[i];
+        }
+    }
+    free(old);
+
+#ifdef MEMORY_DEBUG_LOG
+    memdebug_log_ts("Allocation table grown to %zu slots (%zu live)\n",
+            alloc_capacity, alloc_count);
+#endif
+}
+#endif /* MEMORY_TRACKING */
+
 void safe_memory_init(void) {
     if (initialized) {
 #ifdef MEMORY_DEBUG_LOG
@@ -177,35 +264,45 @@ void safe_memory_init(void) {
 #endif
         return;
     }
-    memset(allocations, 0, sizeof(allocations));
+#ifdef MEMORY_TRACKING
+    alloc_capacity = ALLOC_TABLE_INITIAL;
+    allocations = alloc_table_new(alloc_capacity);
+    alloc_count = 0;
+    alloc_bytes = 0;
+#endif
     initialized = 1;
 }
 
+#ifdef MEMORY_TRACKING
 static void track_allocation(void *ptr, size_t size, const char *file, int line) {
+    size_t mask, slot;
+
     if (!initialized) {
 #ifdef MEMORY_DEBUG_LOG
         memdebug_log("FATAL: safe_memory_init() not called before allocation at %s:%d\n", file, line);
 #endif
         abort();
     }
-    
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (!allocations[i].active) {
-            allocations[i].ptr = ptr;
-            allocations[i].size = size;
-            allocations[i].file = file;
-            allocations[i].line = line;
-            allocations[i].active = 1;
-#ifdef MEMORY_DEBUG_LOG
-            allocations[i].sequence = operation_sequence;
-#endif
-            return;
-        }
+
+    if ((alloc_count + 1) * 4 > alloc_capacity * 3) {
+        alloc_table_grow();
     }
-    
+
+    mask = alloc_capacity - 1;
+    slot = alloc_slot(ptr, mask);
+    while (allocations[slot].ptr) {
+        slot = (slot + 1) & mask;
+    }
+
+    allocations[slot].ptr = ptr;
+    allocations[slot].size = size;
+    allocations[slot].file = file;
+    allocations[slot].line = line;
 #ifdef MEMORY_DEBUG_LOG
-    memdebug_log_ts("WARNING: Allocation tracking table full\n");
+    allocations[slot].sequence = operation_sequence;
 #endif
+    alloc_count++;
+    alloc_bytes += size;
 }
 
 static int untrack_allocation(void *ptr, const char *file, int line
@@ -214,6 +311,8 @@ static int untrack_allocation(void *ptr, const char *file, int line
     const char **alloc_file, int *alloc_line
 #endif
 ) {
+    size_t mask, slot, hole, next;
+
     if (!initialized) {
 #ifdef MEMORY_DEBUG_LOG
         memdebug_log("FATAL: safe_memory_init() not called before free at %s:%d\n", file, line);
@@ -224,18 +323,33 @@ static int untrack_allocation(void *ptr, const char *file, int line
     if (ptr == NULL) {
         return 1; /* freeing NULL is allowed */
     }
-    
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (allocations[i].active && allocations[i].ptr == ptr) {
+
+    mask = alloc_capacity - 1;
+    for (slot = alloc_slot(ptr, mask); allocations[slot].ptr; slot = (slot + 1) & mask) {
+        if (allocations[slot].ptr != ptr) {
+            continue;
+        }
 #ifdef MEMORY_DEBUG_LOG
-            *alloc_seq = allocations[i].sequence;
-            *alloc_size = allocations[i].size;
-            *alloc_file = allocations[i].file;
-            *alloc_line = allocations[i].line;
+        *alloc_seq = allocations[slot].sequence;
+        *alloc_size = allocations[slot].size;
+        *alloc_file = allocations[slot].file;
+        *alloc_line = allocations[slot].line;
 #endif
-            allocations[i].active = 0;
-            return 1;
+        alloc_count--;
+        alloc_bytes -= allocations[slot].size;
+
+        /* Backward-shift delete: pull later members of this probe run
+         * into the hole so lookups never stop short at an empty slot. */
+        hole = slot;
+        for (next = (hole + 1) & mask; allocations[next].ptr; next = (next + 1) & mask) {
+            size_t home = alloc_slot(allocations[next].ptr, mask);
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                allocations[hole] = allocations[next];
+                hole = next;
+            }
         }
+        allocations[hole].ptr = NULL;
+        return 1;
     }
     
 #ifdef MEMORY_DEBUG_LOG
@@ -248,6 +362,7 @@ static int untrack_allocation(void *ptr, const char *file, int line
     log_error(tprintf("!!! DOUBLE-FREE DETECTED !!! Pointer: %p   Free attempt at: %s:%d", ptr, file, line));
     return 0;  /* Return failure so safe_free() skips glibc free() on already-freed pointer */
 }
+#endif /* MEMORY_TRACKING */
 
 void* safe_malloc(size_t size, const char *file, int line) {
     void *ptr = malloc(size);
@@ -267,7 +382,9 @@ void* safe_malloc(size_t size, const char *file, int line) {
     operation_sequence++;
 #endif
     
+#ifdef MEMORY_TRACKING
     track_allocation(ptr, size, file, line);
+#endif
     
 #ifdef MEMORY_DEBUG_LOG
     /* Log the allocation */
@@ -286,20 +403,14 @@ void smart_free(void *ptr, const char *file, int line)
         return;
     }
 
-    // Check if it's in the MSTACK
-    MSTACK *m;
-    for (m = mem_first; m; m = m->next)
+    /* Arena blocks are released with their generation, never singly. */
+    if (arena_owns(ptr))
     {
-        if (m->ptr == ptr)
-        {
-            // Found in stack - expire it
-            m->timer = 1;
 #ifdef MEMORY_DEBUG_LOG
-            memdebug_log_ts("SMART_FREE: %p found in MSTACK=%p, expiring (timer=1) at %s:%d\n",
-                           ptr, (void*)m, file, line);
+        memdebug_log_ts("SMART_FREE: %p is arena memory, left to its generation at %s:%d\n",
+                       ptr, file, line);
 #endif
-            return;
-        }
+        return;
     }
 
     // Not in stack - use regular safe_free
@@ -328,6 +439,7 @@ void safe_free(void *ptr, const char *file, int line) {
     }
 #endif
     
+#ifdef MEMORY_TRACKING
     if (!untrack_allocation(ptr, file, line
 #ifdef MEMORY_DEBUG_LOG
         , &alloc_seq, &alloc_size, &alloc_file, &alloc_line
@@ -338,6 +450,10 @@ void safe_free(void *ptr, const char *file, int line) {
 #endif
         return;  /* Skip glibc free() — pointer already freed, would corrupt heap */
     }
+#else
+    (void)file;
+    (void)line;
+#endif
     
 #ifdef MEMORY_DEBUG_LOG
     /* Log allocation details and content before freeing */
@@ -365,8 +481,8 @@ void safe_memory_cleanup(void) {
     int leaks = 0;
     memdebug_log("\n=== Memory Cleanup Report ===\n");
     
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (allocations[i].active) {
+    for (size_t i = 0; i < alloc_capacity; i++) {
+        if (allocations[i].ptr) {
             if (leaks == 0) {
                 memdebug_log("MEMORY LEAKS DETECTED:\n");
             }
@@ -404,249 +520,278 @@ void safe_memory_report(void) {
         return;
     }
     
-    int active_count = 0;
-    size_t total_size = 0;
-    
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (allocations[i].active) {
-            active_count++;
-            total_size += allocations[i].size;
-        }
-    }
-    
-    memdebug_log_ts("REPORT: Active allocations: %d (%zu bytes)\n",
-            active_count, total_size);
+    /* Counters are maintained by track/untrack; no table scan needed. */
+    memdebug_log_ts("REPORT: Active allocations: %zu (%zu bytes)\n",
+            alloc_count, alloc_bytes);
 #endif
     return;
 }
 
-void *stack_em_fun(size_t size)
+/* ============================================================================
+ * TEMPORARY ALLOCATION ARENA
+ * ============================================================================ */
+
+static size_t arena_set_slot(const ARENA_CHUNK *c, size_t mask)
 {
-    return(stack_em_int(size, 200, 0));
+    uintptr_t key = (uintptr_t)c / ARENA_CHUNK_SIZE;
+    return (size_t)((key * (uintptr_t)0x9E3779B97F4A7C15ULL) >> 16) & mask;
 }
 
-void *stack_em(size_t size)
+static void arena_set_insert(ARENA_CHUNK *c);
+
+static void arena_set_grow(void)
 {
-    return(stack_em_int(size, 1, 0));
+    ARENA_CHUNK **old = arena_set;
+    size_t old_capacity = arena_set_capacity;
+
+    arena_set_capacity = old_capacity ? old_capacity * 2 : ARENA_SET_INITIAL;
+    arena_set = calloc(arena_set_capacity, sizeof(ARENA_CHUNK *));
+    if (!arena_set) {
+        fprintf(stderr, "PANIC: Out of memory growing arena chunk set\n");
+        fflush(stderr);
+        exit(1);
+    }
+    arena_set_count = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i]) {
+            arena_set_insert(old[i]);
+        }
+    }
+    free(old);
 }
 
-void *stack_em_int(size_t size, int timer, int perm)
+static void arena_set_insert(ARENA_CHUNK *c)
 {
-      MSTACK *mnew;
-      
-      mnew = (MSTACK *)safe_malloc(sizeof(MSTACK) + 1, __FILE__, __LINE__);
-      mnew->ptr = safe_malloc(size, __FILE__, __LINE__);
-      
-      // CHECK FOR DUPLICATE POINTERS AT ALLOCATION TIME
-      MSTACK *check;
-      for (check = mem_first; check; check = check->next) {
-          if (check->ptr == mnew->ptr) {
-#ifdef MEMORY_DEBUG_LOG
-              memdebug_log_ts("DUPLICATE PTR AT ALLOCATION!\n");
-              memdebug_log("  Old MSTACK=%p, timer=%d, perm=%d, ptr=%p\n",
-                      (void*)check, check->timer, check->perm, check->ptr);
-              memdebug_log("  New MSTACK=%p, timer=%d, perm=%d, ptr=%p\n",
-                      (void*)mnew, timer, perm, mnew->ptr);
-#endif
-              abort();
-          }
-      }
-      
-      mnew->size = size;
-      mnew->timer = timer + 50;  /* add some padding in case */
-      mnew->perm = perm; /* perm flag */
-      mnew->next = NULL;;
-      mnew->prev = mem_last;
-      
-      if (mem_last)
-      {
-        mem_last->next = mnew;
-        mem_last = mnew;
-      }
-      else
-      {
-        mem_first = mem_last = mnew;
-      }
-      
-      stack_size = stack_size + sizeof(MSTACK) + size + 1;
-      number_stack_blocks++;
-      
-#ifdef MEMORY_DEBUG_LOG
-      memdebug_log_ts("DEBUG: ALLOC: number_stack_blocks: %zu / MSTACK=%p, ptr=%p, mnew->prev=%p, mnew->next=%p m->size=%zu, m->timer=%d, m->perm=%d\n",
-          number_stack_blocks, (void*)mnew, mnew->ptr, (void*)mnew->prev, (void*)mnew->next, mnew->size, mnew->timer, mnew->perm);
-#endif
-      
-      return(mnew->ptr);
+    size_t mask, slot;
+
+    if ((arena_set_count + 1) * 2 > arena_set_capacity) {
+        arena_set_grow();
+    }
+    mask = arena_set_capacity - 1;
+    for (slot = arena_set_slot(c, mask); arena_set[slot]; slot = (slot + 1) & mask)
+        ;
+    arena_set[slot] = c;
+    arena_set_count++;
 }
 
-void __free_hunk(MSTACK *m)
+static void arena_set_remove(ARENA_CHUNK *c)
 {
-#ifdef MEMORY_DEBUG_LOG
-    memdebug_log_ts("DEBUG: Entering __free_hunk:  number_stack_blocks: %zu / MSTACK=%p, ptr=%p, m->prev=%p, m->next=%p m->size=%zu, m->timer=%d, m->perm=%d\n",
-          number_stack_blocks, (void*)m, m->ptr, (void*)m->prev, (void*)m->next, m->size, m->timer, m->perm);
-#endif
-    
-    // Verify we actually have blocks to free
-    if (number_stack_blocks == 0) {
-#ifdef MEMORY_DEBUG_LOG
-      memdebug_log("ERROR: Attempting to free when number_stack_blocks is 0!\n");
-      memdebug_log("MSTACK pointer: %p, m->ptr: %p\n", (void*)m, m->ptr);
-#endif
-      return;
-    }
-    
-    // Verify this block is actually in our list
-#ifdef MEMORY_DEBUG_LOG
-    memdebug_log_ts("DEBUG: Checking if MSTACK is in list...\n");
-#endif
-    MSTACK *check;
-    int found = 0;
-    for (check = mem_first; check; check = check->next) {
-      if (check == m) {
-          found = 1;
-          break;
-      }
+    size_t mask, slot, hole, next;
+
+    if (!arena_set_capacity) {
+        return;
     }
-    
-    if (!found) {
-#ifdef MEMORY_DEBUG_LOG
-      memdebug_log("ERROR: Attempting to free MSTACK %p not in our list!\n", (void*)m);
-      memdebug_log("This is likely a double-free or corruption.\n");
-#endif
-      return;
+    mask = arena_set_capacity - 1;
+    for (slot = arena_set_slot(c, mask); arena_set[slot]; slot = (slot + 1) & mask) {
+        if (arena_set[slot] != c) {
+            continue;
+        }
+        hole = slot;
+        for (next = (hole + 1) & mask; arena_set[next]; next = (next + 1) & mask) {
+            size_t home = arena_set_slot(arena_set[next], mask);
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                arena_set[hole] = arena_set[next];
+                hole = next;
+            }
+        }
+        arena_set[hole] = NULL;
+        arena_set_count--;
+        return;
     }
-    
-#ifdef MEMORY_DEBUG_LOG
-    memdebug_log("DEBUG: Found in list: %d\n", found);
-#endif
-    
-    if (m == mem_first)
-    {
-      mem_first = m->next;
-      if(mem_first)
-      {
-        mem_first->prev = NULL;
-      }
-      else
-      {
-        mem_last = NULL;
-      }
-    }
-    else if (m == mem_last)
-    {
-      mem_last = m->prev;
-      if(mem_last)
-      {
-        mem_last->next = NULL;
-
-      }
-      else
-      {
-        mem_first = NULL;
-      }
-    }
-    else
-    {
-      (m->prev)->next = m->next;
-      (m->next)->prev = m->prev;
+}
+
+/* Does ptr point into a live arena chunk? */
+static int arena_owns(const void *ptr)
+{
+    ARENA_CHUNK *base;
+    size_t mask, slot;
+
+    if (!arena_set_count) {
+        return 0;
     }
-    
-//    fprintf(stderr, "DEBUG: About to modify linked list...\n");
-//    fflush(stderr);
-    
-    if(m->ptr)
-    {
-            SAFE_FREE(m->ptr);
-            // NULL out after freeing
-            m->ptr=NULL;
+    base = (ARENA_CHUNK *)((uintptr_t)ptr & ~(uintptr_t)(ARENA_CHUNK_SIZE - 1));
+    mask = arena_set_capacity - 1;
+    for (slot = arena_set_slot(base, mask); arena_set[slot]; slot = (slot + 1) & mask) {
+        if (arena_set[slot] == base) {
+            return 1;
+        }
     }
-    
-    // Verify stack_size doesn't underflow
-    if (stack_size < m->size + sizeof(MSTACK)) {
+    return 0;
+}
+
+/* Get a chunk of at least 'size' bytes (header included), from the pool
+ * when it is a standard chunk. */
+static ARENA_CHUNK *arena_chunk_get(size_t size)
+{
+    ARENA_CHUNK *c;
+
+    if (size <= ARENA_CHUNK_SIZE && arena_pool) {
+        c = arena_pool;
+        arena_pool = c->next;
+        arena_pool_count--;
+    } else {
+        if (size < ARENA_CHUNK_SIZE) {
+            size = ARENA_CHUNK_SIZE;
+        }
+        size = (size + ARENA_CHUNK_SIZE - 1) & ~(size_t)(ARENA_CHUNK_SIZE - 1);
+        c = aligned_alloc(ARENA_CHUNK_SIZE, size);
+        if (!c) {
+            fprintf(stderr, "PANIC: Out of memory allocating %zu byte arena chunk\n", size);
+            fflush(stderr);
 #ifdef MEMORY_DEBUG_LOG
-        memdebug_log("ERROR: stack_size underflow! Current: %zu, trying to subtract: %zu\n", stack_size, m->size + sizeof(MSTACK));
+            memdebug_log_ts("PANIC: Out of memory allocating %zu byte arena chunk\n", size);
 #endif
-        abort();
+            exit(1);
+        }
+        c->size = size;
+        arena_set_insert(c);
+        number_stack_chunks++;
     }
-    
-    // continue previous code
-    stack_size = stack_size - m->size - sizeof(MSTACK);
-    m->next = NULL;
-    m->prev = NULL;
-    SAFE_FREE(m);
-    number_stack_blocks--;
+    c->next = NULL;
+    c->used = ARENA_HDR;
+    return c;
 }
 
-void clear_stack(void)
+static void arena_chunk_put(ARENA_CHUNK *c)
 {
-    MSTACK *m, *mnext;
-    if(!mem_first)
+    if (c->size == ARENA_CHUNK_SIZE && arena_pool_count < ARENA_POOL_MAX) {
+        c->next = arena_pool;
+        arena_pool = c;
+        arena_pool_count++;
         return;
-    
-    m = mem_first;
-    for(; m; m=mnext)
-    {
-#ifdef MEMORY_DEBUG_LOG
-        memdebug_log("DEBUG: clear_stack:  number_stack_blocks: %zu / MSTACK=%p, ptr=%p, m->prev=%p, m->next=%p m->size=%zu, m->timer=%d, m->perm=%d\n",
-              number_stack_blocks, (void*)m, m->ptr, (void*)m->prev, (void*)m->next, m->size, m->timer, m->perm);
-#endif
-        
-        mnext = m->next;
-        m->timer--;
-        if ((m->timer < 1) && (m->perm == 0))
-        {
-            __free_hunk(m);
+    }
+    arena_set_remove(c);
+    number_stack_chunks--;
+    free(c);
+}
+
+/* Release every block in one generation. */
+static void arena_release(ARENA_GEN *g)
+{
+    ARENA_CHUNK *c, *cnext;
+
+    for (c = g->head; c; c = cnext) {
+        cnext = c->next;
+        arena_chunk_put(c);
+    }
+    number_stack_blocks -= g->blocks;
+    stack_size -= g->bytes;
+    g->head = NULL;
+    g->bytes = 0;
+    g->blocks = 0;
+}
+
+/* Allocate 'size' bytes that stay valid for 'ticks' calls of clear_stack(). */
+void *stack_em_ticks(size_t size, int ticks)
+{
+    ARENA_GEN *g;
+    ARENA_CHUNK *c;
+    size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    void *p;
+
+    if (need == 0) {
+        need = ARENA_ALIGN;
+    }
+    if (ticks < 1) {
+        ticks = 1;
+    } else if (ticks >= ARENA_RING) {
+        ticks = ARENA_RING - 1;
+    }
+    g = &arena_ring[(arena_tick + (unsigned long)ticks) % ARENA_RING];
+
+    if (need > ARENA_LARGE) {
+        /* Oversized blocks get a chunk of their own, linked in behind the
+         * chunk currently being bumped so it is not abandoned. */
+        c = arena_chunk_get(ARENA_HDR + need);
+        c->used = c->size;
+        p = (char *)c + ARENA_HDR;
+        if (g->head) {
+            c->next = g->head->next;
+            g->head->next = c;
+        } else {
+            g->head = c;
+        }
+    } else {
+        c = g->head;
+        if (!c || c->size - c->used < need) {
+            c = arena_chunk_get(ARENA_CHUNK_SIZE);
+            c->next = g->head;
+            g->head = c;
         }
+        p = (char *)c + c->used;
+        c->used += need;
     }
+
+    g->bytes += size;
+    g->blocks++;
+    stack_size += size;
+    number_stack_blocks++;
+
+    return p;
 }
 
-char *stralloc(const char *string)
+void *stack_em_fun(size_t size)
 {
-   return stralloc_int(string, 0);
+    return(stack_em_ticks(size, 200 + ARENA_PAD));
 }
 
-char *stralloc_p(char *string)
+void *stack_em(size_t size)
+{
+    return(stack_em_ticks(size, 1 + ARENA_PAD));
+}
+
+/* Advance one tick and drop the generation that just expired. */
+void clear_stack(void)
+{
+    arena_tick++;
+    arena_release(&arena_ring[arena_tick % ARENA_RING]);
+}
+
+char *stralloc(const char *string)
 {
-   return stralloc_int(string, 1);
+  size_t slen = strlen(string);
+  char *p = stack_em_ticks(slen + 1, 5 + ARENA_PAD);
+  memcpy(p, string, slen + 1);
+  return(p);
 }
 
-char *stralloc_int(char *string, int perm)
+/* Permanent strings are ordinary tracked heap blocks; strfree_p() frees them. */
+char *stralloc_p(char *string)
 {
-  char *p;
   size_t slen = strlen(string);
-  p = stack_em_int((slen + 1), 5, perm);
-  strncpy(p, string, slen);
-  p[slen] = '\0';
+  char *p = safe_malloc(slen + 1, __FILE__, __LINE__);
+  memcpy(p, string, slen + 1);
   return(p);
 }
 
 char *funalloc(char *string)
 {
-    size_t slen = strlen(string);
-    char *p = stack_em_int((slen + 1), 5, 0);  /* permanantly allocate functions? */
-    strncpy(p, string, slen);
-    p[slen] = '\0';
-    return(p);
+  return stralloc(string);
 }
 
 void strfree_p(char *string)
 {
-  MSTACK *m;
-  for (m = mem_first; m; m=m->next)
+  if (string && !arena_owns(string))
   {
-    if (m->ptr == string) /* if it's the same pointer */
-    {
-      __free_hunk(m);
-      break;
-    }
+    SAFE_FREE(string);
   }
 }
 
 void shutdown_stack(void)
 {
+  ARENA_CHUNK *c;
   int x;
-  for (x=0;x<MAX_ALLOCATIONS;x++)
+
+  for (x = 0; x < ARENA_RING; x++)
+  {
+    arena_release(&arena_ring[x]);
+  }
+  while ((c = arena_pool) != NULL)
   {
-    clear_stack();
+    arena_pool = c->next;
+    arena_pool_count--;
+    arena_set_remove(c);
+    number_stack_chunks--;
+    free(c);
   }
 }
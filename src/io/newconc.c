@@ -317,12 +317,20 @@ void do_connectid(struct descriptor_data *d, long concid, char *addr)
   k->output_prefix = NULL;
   k->output_suffix = NULL;
   k->output_size = 0;
-  k->output.head = NULL;
-  k->output.tail = &k->output.head;
+  k->output.buf = NULL;
+  k->output.size = 0;
+  k->output.start = 0;
+  k->output.headroom = 0;
   k->input.head = NULL;
   k->input.tail = &k->input.head;
   k->raw_input = NULL;
   k->raw_input_at = NULL;
+  k->ev_mask = 0;
+  k->telnet = 0;
+  k->mccp = NULL;
+  k->indexed = NOTHING;
+  k->pnext = NULL;
+  k->pprev = NULL;
   k->quota = command_burst_size;
   k->last_time = 0;
   k->connected_at = now;
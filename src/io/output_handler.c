@@ -5,9 +5,12 @@
 #include "config.h"
 #include "externs.h"
 #include "io_internal.h"
+#include "event_loop.h"
 #include "websocket.h"
+#include "mccp.h"
 #include <errno.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 /* Helper function for safe string operations */
 void safe_string_copy(char *dest, const char *src, size_t dest_size)
@@ -95,19 +98,7 @@ char *format_player_output(dbref player, int color, const char *msg, int pueblo)
     if (!GoodObject(player)) {
         return stralloc(buffer);
     }
-    if (db[player].flags & PLAYER_NOBEEP) {
-        if (db[player].flags & PLAYER_ANSI) {
-            return stralloc(parse_color_nobeep(buffer, pueblo));
-        } else {
-            return stralloc(strip_color_nobeep(buffer));
-        }
-    } else {
-        if (db[player].flags & PLAYER_ANSI) {
-            return stralloc(parse_color(buffer, pueblo));
-        } else {
-            return stralloc(strip_color(buffer));
-        }
-    }
+    return color_string(buffer, color_mode(player, pueblo));
 }
 
 /* Add prefix and suffix to output */
@@ -134,15 +125,21 @@ char *add_pre_suf(dbref player, int color, char *msg, int pueblo)
         return stralloc(msg);
     }
 
-    /* Get and process prefix */
-    pronoun_substitute(buf1, player, 
-                      stralloc(atr_get(player, A_PREFIX)), player);
-    prefix = buf1 + strlen(db[player].name) + 1;
+    /* Get and process prefix (most players have none) */
+    prefix = NULL;
+    if (*atr_get(player, A_PREFIX)) {
+        pronoun_substitute(buf1, player, 
+                          stralloc(atr_get(player, A_PREFIX)), player);
+        prefix = buf1 + strlen(db[player].name) + 1;
+    }
 
     /* Get and process suffix */
-    pronoun_substitute(buf2, player, 
-                      stralloc(atr_get(player, A_SUFFIX)), player);
-    suffix = buf2 + strlen(db[player].name) + 1;
+    suffix = NULL;
+    if (*atr_get(player, A_SUFFIX)) {
+        pronoun_substitute(buf2, player, 
+                          stralloc(atr_get(player, A_SUFFIX)), player);
+        suffix = buf2 + strlen(db[player].name) + 1;
+    }
 
     /* Format the main message */
     safe_string_copy(buf0, format_player_output(player, color, msg, pueblo),
@@ -173,15 +170,113 @@ char *add_pre_suf(dbref player, int color, char *msg, int pueblo)
     return stralloc(buf0);
 }
 
-/* Internal notification function */
+/* Would add_pre_suf() hand msg back unchanged?  True when the player
+ * has no prefix or suffix and color processing has nothing to act on
+ * (no |code+text| markup, and no beeps for a NOBEEP player). */
+static int notify_is_plain(dbref player, int color, const char *msg)
+{
+    extern dbref as_from;
+
+    /* add_pre_suf() passes msg straight through for these */
+    if (!(db[player].flags & CONNECT) && player != as_from) {
+        return 1;
+    }
+
+    if (*atr_get(player, A_PREFIX) || *atr_get(player, A_SUFFIX)) {
+        return 0;
+    }
+    if (strlen(msg) >= IO_BUFFER_SIZE) {
+        return 0;  /* add_pre_suf() truncates */
+    }
+
+    return !color ||
+           !strpbrk(msg, (db[player].flags & PLAYER_NOBEEP) ? "|\a" : "|");
+}
+
+/* === BROADCAST RENDER CACHE === */
+
+/* A message going to many players comes out of add_pre_suf() the same
+ * for everyone in the same class -- Pueblo or telnet, ANSI or not, beeps
+ * or not -- unless they have a prefix or suffix of their own.  Callers
+ * that fan one message out (room emits, walls, announcements) bracket the
+ * loop with render_begin()/render_end(); raw_notify_internal() then
+ * renders that message at most once per class and queues the shared
+ * result.  Scopes nest, since a LISTEN can notify another room before
+ * the outer loop is done. */
+
+static struct render_cache *render_active = NULL;
+
+unsigned long render_cache_hits = 0;
+unsigned long render_cache_misses = 0;
+
+void render_begin(struct render_cache *rc, char *msg, int color)
+{
+    memset(rc, 0, sizeof(*rc));
+    rc->msg = msg;
+    rc->color = color;
+    rc->prev = render_active;
+    render_active = rc;
+}
+
+void render_end(struct render_cache *rc)
+{
+    render_active = rc->prev;
+}
+
+/* Which rendering of a message this player gets, 0..RENDER_CLASSES-1 */
+int notify_class(dbref player, int pueblo)
+{
+    return (pueblo ? 1 : 0) |
+           ((db[player].flags & PLAYER_ANSI) ? 2 : 0) |
+           ((db[player].flags & PLAYER_NOBEEP) ? 4 : 0);
+}
+
+/* Does add_pre_suf() depend on nothing but notify_class() for player? */
+int notify_shareable(dbref player)
+{
+    extern dbref as_from;
+
+    return (db[player].flags & CONNECT) && player != as_from &&
+           !*atr_get(player, A_PREFIX) && !*atr_get(player, A_SUFFIX);
+}
+
+/* add_pre_suf(), served from the active render cache when msg is the
+ * message being fanned out */
+static char *render_notify(dbref player, int color, char *msg, int pueblo)
+{
+    struct render_cache *rc = render_active;
+    int cls;
+
+    if (!rc || rc->msg != msg || rc->color != color ||
+        !notify_shareable(player)) {
+        return add_pre_suf(player, color, msg, pueblo);
+    }
+
+    cls = notify_class(player, pueblo);
+    if (rc->text[cls]) {
+        render_cache_hits++;
+    } else {
+        rc->text[cls] = add_pre_suf(player, color, msg, pueblo);
+        render_cache_misses++;
+    }
+    return rc->text[cls];
+}
+
+/* Internal notification function
+ *
+ * Rendering is done on demand: nothing at all when the recipient has no
+ * connections or is blacklisting itself, only the ANSI or Pueblo variant
+ * that its descriptors actually use, no copy at all when
+ * notify_is_plain() says the text would come out unchanged, and a
+ * shared copy when the message is being fanned out (render_begin()). */
 void raw_notify_internal(dbref player, char *msg, int color)
 {
     struct descriptor_data *d;
-    extern dbref speaker, as_from, as_to;
-    char buf0[IO_BUFFER_SIZE];
-    char ansi[ANSI_BUFFER_SIZE];
-    char *html = NULL;
-    char *temp;
+    extern dbref as_from, as_to;
+    const char *ansi = NULL, *html = NULL;
+    size_t ansi_len = 0, html_len = 0;
+    dbref target, owner;
+    int plain;
 
     if (!msg) {
         return;
@@ -198,68 +293,45 @@ void raw_notify_internal(dbref player, char *msg, int color)
                       "See \"help WHEN\" for more information.");
     }
 
-    /* Build message with speaker info if puppet */
-    if (IS(player, TYPE_PLAYER, PUPPET)) {
-        if (speaker != player) {
-            temp = tprintf(" [#%" DBREF_FMT "/%s]", speaker,
-                          short_name(real_owner(db[speaker].owner)));
-        } else {
-            temp = tprintf("");
-        }
-        
-        size_t msg_len = strlen(msg);
-        size_t temp_len = strlen(temp);
-        if (msg_len + temp_len >= sizeof(buf0)) {
-            safe_string_copy(buf0, msg, sizeof(buf0) - temp_len);
-        } else {
-            safe_string_copy(buf0, msg, sizeof(buf0));
-        }
-        safe_string_cat(buf0, temp, sizeof(buf0));
-    } else {
-        safe_string_copy(buf0, msg, sizeof(buf0));
-    }
-
-    /* Format ANSI output */
-    safe_string_copy(ansi, add_pre_suf(player, color, msg, 0),
-                    sizeof(ansi));
+    /* Handle as_from/as_to redirection */
+    target = (player == as_from) ? as_to : player;
 
-    /* Allocate and format HTML output if needed */
-    SAFE_MALLOC(html, char, HTML_BUFFER_SIZE);
-    if (!html) {
-        log_error("Failed to allocate HTML buffer");
+    /* Nothing to render for a player with no connections */
+    if (!player_descriptors(target)) {
         return;
     }
-    safe_string_copy(html, add_pre_suf(player, color, msg, 1),
-                    HTML_BUFFER_SIZE);
 
-    /* Handle as_from/as_to redirection */
-    if (player == as_from) {
-        player = as_to;
+    /* Blacklist restrictions.  Every descriptor found below belongs to
+     * target, so this is the same test for all of them. */
+    owner = real_owner(target);
+    if (*atr_get(owner, A_BLACKLIST) && blacklist_check(owner, owner)) {
+        return;
     }
 
+    plain = notify_is_plain(player, color, msg);
+
     /* Send to all connected descriptors for this player */
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == player) {
-            /* Check blacklist restrictions */
-            if (((!strlen(atr_get(real_owner(d->player), A_BLACKLIST))) &&
-                 (!strlen(atr_get(real_owner(player), A_BLACKLIST)))) ||
-                !((could_doit(real_owner(player), real_owner(d->player),
-                              A_BLACKLIST)) &&
-                  (could_doit(real_owner(d->player), real_owner(player),
-                              A_BLACKLIST)))) {
-                if (!d->pueblo) {
-                    queue_string(d, ansi);
-                    queue_write(d, "\n", 1);
-                } else {
-                    queue_string(d, html);
-                    queue_write(d, "\n", 1);
+    for (d = player_descriptors(target); d; d = d->pnext) {
+        if (!d->pueblo) {
+            if (!ansi) {
+                ansi = plain ? msg : render_notify(player, color, msg, 0);
+                ansi_len = strlen(ansi);
+                if (ansi_len >= ANSI_BUFFER_SIZE) {
+                    ansi_len = ANSI_BUFFER_SIZE - 1;
+                }
+            }
+            queue_write(d, ansi, (int)ansi_len);
+        } else {
+            if (!html) {
+                html = plain ? msg : render_notify(player, color, msg, 1);
+                html_len = strlen(html);
+                if (html_len >= HTML_BUFFER_SIZE) {
+                    html_len = HTML_BUFFER_SIZE - 1;
                 }
             }
+            queue_write(d, html, (int)html_len);
         }
-    }
-
-    if (html) {
-        SMART_FREE(html);
+        queue_write(d, "\n", 1);
     }
 }
 
@@ -277,8 +349,9 @@ void raw_notify_noc(dbref player, char *msg)
 /* Process output for a descriptor */
 int process_output(struct descriptor_data *d)
 {
-    struct text_block **qp, *cur;
-    int cnt;
+    struct iovec iov[2];
+    ssize_t cnt;
+    int n;
 
     if (!d) {
         return 0;
@@ -289,19 +362,24 @@ int process_output(struct descriptor_data *d)
         char buf[10];
         char obuf[IO_BUFFER_SIZE];
         int buflen;
-        int k, j;
+        int i, k, j;
+        size_t len;
+        const char *p;
 
         snprintf(buf, sizeof(buf), "%ld ", d->concid);
         buflen = strlen(buf);
         memcpy(obuf, buf, buflen);
         j = buflen;
 
-        for (qp = &d->output.head; (cur = *qp);) {
+        n = output_peek(d, iov);
+        for (i = 0; i < n; i++) {
             need_more_proc = 1;
-            
-            for (k = 0; k < cur->nchars && j < (int)sizeof(obuf) - 1; k++) {
-                obuf[j++] = cur->start[k];
-                if (cur->start[k] == '\n') {
+            p = iov[i].iov_base;
+            len = iov[i].iov_len;
+
+            for (k = 0; k < (int)len && j < (int)sizeof(obuf) - 1; k++) {
+                obuf[j++] = p[k];
+                if (p[k] == '\n') {
                     if (d->parent) {
                         queue_write(d->parent, obuf, j);
                     }
@@ -314,14 +392,8 @@ int process_output(struct descriptor_data *d)
                     }
                 }
             }
-            
-            d->output_size -= cur->nchars;
-            if (!cur->nxt) {
-                d->output.tail = qp;
-            }
-            *qp = cur->nxt;
-            free_text_block(cur);
         }
+        output_consume(d, d->output_size);
         
         if (j > buflen && j < (int)sizeof(obuf)) {
             queue_write(d, obuf + buflen, j - buflen);
@@ -335,31 +407,32 @@ int process_output(struct descriptor_data *d)
         return websocket_write_output(d);
     }
 
-    /* Normal (non-remote/telnet) output processing */
-    for (qp = &d->output.head; (cur = *qp);) {
-        cnt = write(d->descriptor, cur->start, cur->nchars);
+    /* MCCP: the ring holds plain text, compressed on its way out; a
+     * stream that has just finished falls through to plain output */
+    if (d->mccp) {
+        if (!mccp_output(d)) {
+            return 0;
+        }
+        if (d->mccp) {
+            ev_sync(d);
+            return 1;
+        }
+    }
+
+    /* Normal (non-remote/telnet) output: everything queued goes out in
+     * one writev(), two iovecs when the ring has wrapped */
+    if ((n = output_peek(d, iov)) > 0) {
+        cnt = writev(d->descriptor, iov, n);
         if (cnt < 0) {
             if (errno == EWOULDBLOCK) {
                 return 1;
             }
             return 0;
         }
-        
-        d->output_size -= cnt;
-        if (cnt == cur->nchars) {
-            if (!cur->nxt) {
-                d->output.tail = qp;
-            }
-            *qp = cur->nxt;
-            free_text_block(cur);
-            continue;
-        }
-        
-        cur->nchars -= cnt;
-        cur->start += cnt;
-        break;
+        output_consume(d, (int)cnt);
     }
     
+    ev_sync(d);
     return 1;
 }
 
@@ -0,0 +1,551 @@
+/* resolver.c - Asynchronous host and ident lookups for new connections
+ *
+ * new_connection() used to call gethostbyaddr() and initializesock() ran
+ * a synchronous RFC 1413 ident query with a 3 second connect timeout,
+ * both on the main thread.  A slow nameserver or a firewall that silently
+ * drops port 113 froze the whole game for every connect.
+ *
+ * Lookups now go to a small pool of worker threads.  A descriptor is
+ * usable the moment it is accepted; its d->addr and d->user read
+ * "resolving" until the answers arrive.  Workers push finished jobs onto
+ * a done list and poke a pipe registered with the event loop (EV_RESOLVER),
+ * and resolver_collect() applies them on the main thread.  Jobs are keyed
+ * by concid, so an answer for a connection that has already gone away is
+ * simply dropped.
+ *
+ * Worker threads touch nothing but their own job: no SAFE_MALLOC, no
+ * logging, no game state.  Jobs are allocated and freed by the main
+ * thread only.
+ *
+ * Hostnames are kept in a cache for dns_cache_ttl seconds (the old TODO's
+ * "hash table of hosts that have been looked up before").  Failed lookups
+ * are cached too, for at most RESOLVER_NEG_TTL seconds, so a host without
+ * a PTR record does not cost a query on every reconnect.  Ident answers
+ * are per connection and never cached; ident_lookups 0 turns them off.
+ *
+ * Site and guest lockouts match on the numeric address (d->address), so
+ * nothing needs to wait for a lookup to finish.
+ */
+
+#include "config.h"
+#include "externs.h"
+#include "io_internal.h"
+#include "event_loop.h"
+#include "resolver.h"
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#define RESOLVER_THREADS    4
+#define RESOLVER_BUCKETS    256
+#define RESOLVER_CACHE_MAX  4096
+#define RESOLVER_NEG_TTL    300   /* seconds, cap for failed lookups */
+
+#define IDENT_CONNECT_MSEC  3000
+#define IDENT_REPLY_MSEC    2000
+
+#define RESOLVING "resolving"
+
+/* === JOBS === */
+
+struct resolve_job {
+    struct resolve_job *next;
+    long concid;
+    struct sockaddr_in remote;
+    struct sockaddr_in local;
+    int want_host;
+    int want_ident;
+    int host_ok;
+    char host[NI_MAXHOST];
+    char user[40];
+};
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+
+/* Both lists are guarded by job_lock */
+static struct resolve_job *pending_head = NULL;
+static struct resolve_job **pending_tail = &pending_head;
+static struct resolve_job *done_list = NULL;
+
+static int wake_pipe[2] = { -1, -1 };
+
+/* 0 = not started, 1 = running, -1 = could not start (lookups skipped) */
+static int resolver_state = 0;
+
+static int jobs_out = 0;   /* queued or running, main thread only */
+static unsigned long jobs_done = 0;
+static unsigned long host_found = 0;
+static unsigned long host_failed = 0;
+static unsigned long ident_found = 0;
+static unsigned long ident_failed = 0;
+
+/* === HOST CACHE === */
+
+struct host_entry {
+    struct host_entry *next;
+    in_addr_t addr;
+    time_t expires;
+    int ok;
+    char name[51];   /* sizeof descriptor_data.addr */
+};
+
+static struct host_entry *host_cache[RESOLVER_BUCKETS];
+static int host_entries = 0;
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+
+static unsigned int host_bucket(in_addr_t addr)
+{
+    uint32_t h = (uint32_t)addr * 2654435761u;
+
+    return (unsigned int)(h >> 24) % RESOLVER_BUCKETS;
+}
+
+static void host_unlink(struct host_entry **pp)
+{
+    struct host_entry *e = *pp;
+
+    *pp = e->next;
+    SMART_FREE(e);
+    host_entries--;
+}
+
+/* Drop every expired entry */
+static void host_prune(void)
+{
+    struct host_entry **pp;
+    int i;
+
+    for (i = 0; i < RESOLVER_BUCKETS; i++) {
+        pp = &host_cache[i];
+        while (*pp) {
+            if ((*pp)->expires <= now) {
+                host_unlink(pp);
+            } else {
+                pp = &(*pp)->next;
+            }
+        }
+    }
+}
+
+static struct host_entry *host_lookup(in_addr_t addr)
+{
+    struct host_entry **pp;
+
+    if (dns_cache_ttl <= 0) {
+        return NULL;
+    }
+
+    for (pp = &host_cache[host_bucket(addr)]; *pp; pp = &(*pp)->next) {
+        if ((*pp)->addr != addr) {
+            continue;
+        }
+        if ((*pp)->expires <= now) {
+            host_unlink(pp);
+            return NULL;
+        }
+        return *pp;
+    }
+    return NULL;
+}
+
+static void host_store(in_addr_t addr, int ok, const char *name)
+{
+    struct host_entry *e;
+    unsigned int b;
+    int ttl;
+
+    if (dns_cache_ttl <= 0) {
+        return;
+    }
+
+    ttl = ok ? dns_cache_ttl
+             : (dns_cache_ttl < RESOLVER_NEG_TTL ? dns_cache_ttl : RESOLVER_NEG_TTL);
+
+    if ((e = host_lookup(addr)) == NULL) {
+        if (host_entries >= RESOLVER_CACHE_MAX) {
+            host_prune();
+            if (host_entries >= RESOLVER_CACHE_MAX) {
+                return;
+            }
+        }
+        SAFE_MALLOC(e, struct host_entry, 1);
+        e->addr = addr;
+        b = host_bucket(addr);
+        e->next = host_cache[b];
+        host_cache[b] = e;
+        host_entries++;
+    }
+
+    e->ok = ok;
+    e->expires = now + ttl;
+    strncpy(e->name, name, sizeof(e->name) - 1);
+    e->name[sizeof(e->name) - 1] = '\0';
+}
+
+/* === WORKER SIDE === */
+
+static void lookup_host(struct resolve_job *job)
+{
+    job->host_ok = getnameinfo((struct sockaddr *)&job->remote,
+                               sizeof(job->remote), job->host,
+                               sizeof(job->host), NULL, 0,
+                               NI_NAMEREQD) == 0;
+}
+
+/* Wait up to msec for events on fd; 1 if they came */
+static int wait_fd(int fd, short events, int msec)
+{
+    struct pollfd p;
+    int r;
+
+    p.fd = fd;
+    p.events = events;
+    do {
+        r = poll(&p, 1, msec);
+    } while (r < 0 && errno == EINTR);
+
+    return r > 0 && (p.revents & events);
+}
+
+/* RFC 1413 query against the remote host's identd */
+static void lookup_ident(struct resolve_job *job)
+{
+    struct sockaddr_in sin_addr;
+    char buf[128], *r, *s;
+    int err, fd, i;
+    socklen_t len;
+    ssize_t n;
+
+    strcpy(job->user, "???");
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+        return;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    memset(&sin_addr, 0, sizeof(sin_addr));
+    sin_addr.sin_family = AF_INET;
+    sin_addr.sin_addr = job->local.sin_addr;
+    sin_addr.sin_port = 0;
+
+    if (bind(fd, (struct sockaddr *)&sin_addr, sizeof(sin_addr))) {
+        close(fd);
+        return;
+    }
+
+    sin_addr.sin_addr = job->remote.sin_addr;
+    sin_addr.sin_port = htons(113);
+    if (connect(fd, (struct sockaddr *)&sin_addr, sizeof(sin_addr)) &&
+        errno != EINPROGRESS) {
+        close(fd);
+        return;
+    }
+
+    if (!wait_fd(fd, POLLOUT, IDENT_CONNECT_MSEC)) {
+        close(fd);
+        return;
+    }
+
+    len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) || err) {
+        close(fd);
+        return;
+    }
+
+    snprintf(buf, sizeof(buf), "%d,%d\r\n", ntohs(job->remote.sin_port),
+             ntohs(job->local.sin_port));
+    if (send(fd, buf, strlen(buf), MSG_NOSIGNAL) < 0) {
+        close(fd);
+        return;
+    }
+
+    if (!wait_fd(fd, POLLIN, IDENT_REPLY_MSEC)) {
+        close(fd);
+        return;
+    }
+
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (n <= 2) {
+        return;
+    }
+    buf[n] = '\0';
+
+    /* "port , port : USERID : opsys : user" */
+    for (r = buf, i = 0; i < 3; i++, r++) {
+        if (!(r = strchr(r, ':'))) {
+            return;
+        }
+    }
+
+    if ((s = strchr(r, '\n'))) {
+        *s = '\0';
+    }
+    if ((s = strchr(r, '\r'))) {
+        *s = '\0';
+    }
+    while (*r && isspace((unsigned char)*r)) {
+        r++;
+    }
+
+    strncpy(job->user, r, 31);
+    job->user[31] = '\0';
+}
+
+static void *resolver_worker(void *arg)
+{
+    struct resolve_job *job;
+    char c = 0;
+
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&job_lock);
+        while (!pending_head) {
+            pthread_cond_wait(&job_cond, &job_lock);
+        }
+        job = pending_head;
+        pending_head = job->next;
+        if (!pending_head) {
+            pending_tail = &pending_head;
+        }
+        pthread_mutex_unlock(&job_lock);
+
+        if (job->want_host) {
+            lookup_host(job);
+        }
+        if (job->want_ident) {
+            lookup_ident(job);
+        }
+
+        pthread_mutex_lock(&job_lock);
+        job->next = done_list;
+        done_list = job;
+        pthread_mutex_unlock(&job_lock);
+
+        /* A full pipe already means "collect" */
+        if (write(wake_pipe[1], &c, 1) < 0 && errno != EAGAIN) {
+            continue;
+        }
+    }
+    return NULL;
+}
+
+/* === MAIN THREAD SIDE === */
+
+static int resolver_init(void)
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    sigset_t all, old;
+    int i, started = 0;
+
+    if (resolver_state) {
+        return resolver_state > 0;
+    }
+    resolver_state = -1;
+
+    if (pipe(wake_pipe) < 0) {
+        log_error(tprintf("resolver: pipe failed (%s), lookups disabled",
+                          strerror(errno)));
+        return 0;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(wake_pipe[i], F_SETFL, O_NONBLOCK);
+    }
+    if (ev_add(wake_pipe[0], EV_RESOLVER, NULL, EV_READ) < 0) {
+        log_error("resolver: cannot watch pipe, lookups disabled");
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        return 0;
+    }
+
+    /* Signals stay with the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (i = 0; i < RESOLVER_THREADS; i++) {
+        if (pthread_create(&tid, &attr, resolver_worker, NULL) == 0) {
+            started++;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (!started) {
+        log_error("resolver: no worker threads, lookups disabled");
+        ev_del(wake_pipe[0]);
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        return 0;
+    }
+
+    log_io(tprintf("Resolver started with %d threads", started));
+    resolver_state = 1;
+    return 1;
+}
+
+void resolver_start(struct descriptor_data *d)
+{
+    struct resolve_job *job;
+    char ip[INET_ADDRSTRLEN];
+    int want_host = 0, want_ident = 0;
+    socklen_t len;
+
+    if (!d) {
+        return;
+    }
+
+    inet_ntop(AF_INET, &d->address.sin_addr, ip, sizeof(ip));
+    strcpy(d->addr, ip);
+    strcpy(d->user, "???");
+
+#ifdef HOST_LOOKUPS
+    {
+        struct host_entry *e = host_lookup(d->address.sin_addr.s_addr);
+
+        if (e) {
+            cache_hits++;
+            if (e->ok) {
+                strcpy(d->addr, e->name);
+            }
+        } else {
+            cache_misses++;
+            want_host = 1;
+        }
+    }
+#endif
+
+    want_ident = ident_lookups != 0;
+
+    if ((!want_host && !want_ident) || !resolver_init()) {
+        return;
+    }
+
+    SAFE_MALLOC(job, struct resolve_job, 1);
+    memset(job, 0, sizeof(struct resolve_job));
+    job->concid = d->concid;
+    job->remote = d->address;
+    job->want_host = want_host;
+
+    len = sizeof(job->local);
+    if (want_ident &&
+        getsockname(d->descriptor, (struct sockaddr *)&job->local, &len) == 0) {
+        job->want_ident = 1;
+    }
+
+    if (!job->want_host && !job->want_ident) {
+        SMART_FREE(job);
+        return;
+    }
+
+    if (job->want_host) {
+        strcpy(d->addr, RESOLVING);
+    }
+    if (job->want_ident) {
+        strcpy(d->user, RESOLVING);
+    }
+
+    pthread_mutex_lock(&job_lock);
+    *pending_tail = job;
+    pending_tail = &job->next;
+    pthread_cond_signal(&job_cond);
+    pthread_mutex_unlock(&job_lock);
+    jobs_out++;
+}
+
+void resolver_collect(void)
+{
+    struct resolve_job *job, *next;
+    struct descriptor_data *d;
+    char ip[INET_ADDRSTRLEN];
+    char buf[64];
+
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+
+    pthread_mutex_lock(&job_lock);
+    job = done_list;
+    done_list = NULL;
+    pthread_mutex_unlock(&job_lock);
+
+    for (; job; job = next) {
+        next = job->next;
+        jobs_out--;
+        jobs_done++;
+
+        inet_ntop(AF_INET, &job->remote.sin_addr, ip, sizeof(ip));
+
+        if (job->want_host) {
+            if (job->host_ok) {
+                host_found++;
+            } else {
+                host_failed++;
+            }
+            host_store(job->remote.sin_addr.s_addr, job->host_ok, job->host);
+        }
+        if (job->want_ident) {
+            if (strcmp(job->user, "???")) {
+                ident_found++;
+            } else {
+                ident_failed++;
+            }
+        }
+
+        for (d = descriptor_list; d; d = d->next) {
+            if (d->concid == job->concid) {
+                break;
+            }
+        }
+
+        if (d) {
+            if (job->want_host) {
+                strncpy(d->addr, job->host_ok ? job->host : ip,
+                        sizeof(d->addr) - 1);
+                d->addr[sizeof(d->addr) - 1] = '\0';
+            }
+            if (job->want_ident) {
+                strcpy(d->user, job->user);
+            }
+            log_io(tprintf("|G+USER RESOLVED|: concid: %ld host %s@%s (%s)",
+                           d->concid, d->user, d->addr, ip));
+        }
+
+        SMART_FREE(job);
+    }
+}
+
+void info_resolver(dbref player)
+{
+    notify(player, tprintf("Resolver: %s, %d threads",
+                           resolver_state > 0 ? "running"
+                           : resolver_state < 0 ? "unavailable" : "idle",
+                           resolver_state > 0 ? RESOLVER_THREADS : 0));
+#ifdef HOST_LOOKUPS
+    notify(player, "Reverse DNS: on");
+#else
+    notify(player, "Reverse DNS: off (HOST_LOOKUPS not defined)");
+#endif
+    notify(player, tprintf("Ident: %s", ident_lookups ? "on" : "off"));
+    notify(player, tprintf("Jobs: %d outstanding, %lu finished",
+                           jobs_out, jobs_done));
+    notify(player, tprintf("Hostnames: %lu found, %lu without PTR",
+                           host_found, host_failed));
+    notify(player, tprintf("Ident answers: %lu received, %lu failed",
+                           ident_found, ident_failed));
+    notify(player, tprintf("Host cache: %d entries, ttl %ds, %lu hits, %lu misses",
+                           host_entries, dns_cache_ttl, cache_hits, cache_misses));
+}
@@ -14,6 +14,9 @@
 #include "mariadb_help.h"
 #include "mariadb_news.h"
 #include "websocket.h"
+#include "event_loop.h"
+#include "resolver.h"
+#include "mccp.h"
 
 #include <stddef.h>
 #include <sys/time.h>
@@ -199,7 +202,6 @@ int main(int argc, char *argv[])
             _exit(0);  /* Child exits — use _exit to skip atexit handlers */
         }
 
-        alarm(0);  /* Cancel any pending alarms */
         wait(0);   /* Wait for child to exit */
 
         /* Ensure stdout/stderr survive exec so the new process has
@@ -384,6 +386,8 @@ static void shovechars(int port)
     struct descriptor_data *d, *dnext;
     struct descriptor_data *newd;
     int avail_descriptors;
+    int fd, kind, ready;
+    void *data;
 
     time(&now);
     log_io(tprintf("Starting up on port %d", port));
@@ -400,6 +404,11 @@ static void shovechars(int port)
         }
     }
 
+    /* Timer jobs and @waits wake the loop through the timerfd */
+    if (timer_fd() >= 0) {
+        ev_add(timer_fd(), EV_TIMER, NULL, EV_READ);
+    }
+
     gettimeofday(&last_slice, &tz);
     avail_descriptors = getdtablesize() - 5;
 
@@ -424,7 +433,7 @@ static void shovechars(int port)
         /* Process remote descriptors */
         for (d = descriptor_list; d; d = dnext) {
             dnext = d->next;
-            if (d->cstatus & C_REMOTE && d->output.head) {
+            if (d->cstatus & C_REMOTE && d->output_size) {
                 if (!process_output(d)) {
                     shutdownsock(d);
                 }
@@ -441,7 +450,7 @@ static void shovechars(int port)
                 } else {
                     FD_SET(d->descriptor, &input_set);
                 }
-                if (d->output.head &&
+                if ((d->output_size || mccp_pending(d)) &&
                     (d->state != CONNECTED || d->player > 0)) {
                     FD_SET(d->descriptor, &output_set);
                 }
@@ -502,6 +511,7 @@ static void shovechars(int port)
 
         clear_stack();
         process_commands();
+        queue_run();
         check_for_idlers();
         
 #ifdef USE_RLPAGE
@@ -515,26 +525,26 @@ static void shovechars(int port)
         /* Test for events */
         dispatch();
 
-        /* Setup timeout for select */
-        timeout.tv_sec = (need_more_proc || test_top()) ? 0 : 100;
-        need_more_proc = 0;
+        /* Setup wait timeout: poll while queued commands are
+         * runnable; timer jobs and @waits wake us through timer_arm() */
         timeout.tv_usec = 5;
+        if (need_more_proc || test_top()) {
+            timeout.tv_sec = 0;
+        } else {
+            timeout.tv_sec = 100;
+        }
+        need_more_proc = 0;
         next_slice = msec_add(last_slice, command_time_msec);
         slice_timeout = timeval_sub(next_slice, current_time);
 
-        /* Setup file descriptor sets */
-        FD_ZERO(&input_set);
-        FD_ZERO(&output_set);
-        
-        if (ndescriptors < avail_descriptors && sock >= 0) {
-            FD_SET(sock, &input_set);
-        }
+        /* Accept only while descriptors are available */
+        ev_listen(sock, ndescriptors < avail_descriptors);
 
 #ifdef USE_CID_PLAY
         /* Process remote descriptors */
         for (d = descriptor_list; d; d = dnext) {
             dnext = d->next;
-            if (d->cstatus & C_REMOTE && d->output.head) {
+            if (d->cstatus & C_REMOTE && d->output_size) {
                 if (!process_output(d)) {
                     shutdownsock(d);
                 }
@@ -543,31 +553,22 @@ static void shovechars(int port)
         }
 #endif
 
-        /* Setup descriptor sets */
-        for (d = descriptor_list; d; d = d->next) {
-            if (!(d->cstatus & (C_REMOTE | C_WEBSOCKET))) {
-                if (d->input.head) {
-                    timeout = slice_timeout;
-                } else {
-                    FD_SET(d->descriptor, &input_set);
-                }
-                if (d->output.head &&
-                    (d->state != CONNECTED || d->player > 0)) {
-                    FD_SET(d->descriptor, &output_set);
-                }
-            }
+        /* Descriptors holding queued input have reads paused until
+         * their quota lets process_commands() drain it */
+        if (ev_input_waiting > 0) {
+            timeout = slice_timeout;
         }
 
-        /* Add WebSocket fds to select sets */
-        websocket_add_fds(&input_set, &output_set, &maxd);
+        /* Wake at the next timer job or @wait deadline */
+        timer_arm(&timeout);
 
-        /* Wait for I/O or timeout */
-        found = select(maxd, &input_set, &output_set,
-                      (fd_set *)0, &timeout);
+        /* Wait for I/O or timeout.  Interest is kept current by
+         * ev_sync() as queues change, so only ready fds come back. */
+        found = ev_wait(&timeout);
         
         if (found < 0) {
             if (errno != EINTR) {
-                perror("select");
+                perror(ev_backend());
             }
         } else {
             time(&now);
@@ -582,35 +583,51 @@ static void shovechars(int port)
 
             time(&now);
 
-            /* Accept new connections */
-            if (sock >= 0 && FD_ISSET(sock, &input_set)) {
-                newd = new_connection(sock);
-                if (!newd) {
-                    if (errno && errno != EINTR && 
-                        errno != EMFILE && errno != ENFILE) {
-                        perror("new_connection");
+            while ((ready = ev_next(&fd, &kind, &data)) != 0) {
+                switch (kind) {
+                case EV_LISTEN:
+                    /* Accept new connections */
+                    newd = new_connection(fd);
+                    if (!newd) {
+                        if (errno && errno != EINTR && 
+                            errno != EMFILE && errno != ENFILE) {
+                            perror("new_connection");
+                        }
+                    } else {
+                        if (newd->descriptor >= maxd) {
+                            maxd = newd->descriptor + 1;
+                        }
                     }
-                } else {
-                    if (newd->descriptor >= maxd) {
-                        maxd = newd->descriptor + 1;
+                    break;
+
+                case EV_LWS:
+                    /* Service WebSocket connections */
+                    websocket_service_fd(fd, ready);
+                    break;
+
+                case EV_TIMER:
+                    /* Jobs run from dispatch() on the next pass */
+                    timer_fired();
+                    break;
+
+                case EV_RESOLVER:
+                    /* Host/ident answers for new connections */
+                    resolver_collect();
+                    break;
+
+                case EV_DESC:
+                    d = (struct descriptor_data *)data;
+                    if ((ready & EV_READ) && !process_input(d)) {
+                        shutdownsock(d);
+                        break;
                     }
-                }
-            }
-
-            /* Service WebSocket connections */
-            websocket_service_fds(&input_set, &output_set);
-            websocket_service_timeout();
-
-            /* Process input from descriptors */
-            for (d = descriptor_list; d; d = dnext) {
-                dnext = d->next;
-                if (FD_ISSET(d->descriptor, &input_set) &&
-                    !(d->cstatus & (C_REMOTE | C_WEBSOCKET))) {
-                    if (!process_input(d)) {
+                    if ((ready & EV_WRITE) && !process_output(d)) {
                         shutdownsock(d);
                     }
+                    break;
                 }
             }
+            websocket_service_timeout();
 
 #ifdef USE_CID_PLAY
             /* Process remote output */
@@ -622,17 +639,6 @@ static void shovechars(int port)
             }
 #endif
 
-            /* Process output to descriptors */
-            for (d = descriptor_list; d; d = dnext) {
-                dnext = d->next;
-                if (!(d->cstatus & (C_REMOTE | C_WEBSOCKET)) &&
-                    FD_ISSET(d->descriptor, &output_set)) {
-                    if (!process_output(d)) {
-                        shutdownsock(d);
-                    }
-                }
-            }
-
 #ifdef USE_CID_PLAY
             /* Cleanup orphaned remote descriptors */
             for (d = descriptor_list; d; d = dnext) {
@@ -673,8 +679,10 @@ void outgoing_setupfd(dbref player, int fd)
     d->output_prefix = NULL;
     d->output_suffix = NULL;
     d->output_size = 0;
-    d->output.head = NULL;
-    d->output.tail = &d->output.head;
+    d->output.buf = NULL;
+    d->output.size = 0;
+    d->output.start = 0;
+    d->output.headroom = 0;
     d->input.head = NULL;
     d->input.tail = &d->input.head;
     d->raw_input = NULL;
@@ -682,8 +690,23 @@ void outgoing_setupfd(dbref player, int fd)
     d->quota = command_burst_size;
     d->last_time = 0;
     d->wsi = NULL;
+    d->telnet = 0;
+    d->mccp = NULL;
+    d->indexed = NOTHING;
+    d->pnext = NULL;
+    d->pprev = NULL;
+    d->ev_mask = 0;
     strcpy(d->addr, "UNUSED");  /* Was "RWHO" - RWHO system removed */
 
+    if (ev_attach(d) < 0) {
+        log_error(tprintf("Outgoing connection fd %d cannot be polled, closing",
+                          fd));
+        close(fd);
+        ndescriptors--;
+        SMART_FREE(d);
+        return;
+    }
+
     if (descriptor_list) {
         descriptor_list->prev = &d->next;
     }
@@ -714,12 +737,10 @@ int boot_off(dbref player)
         return 0;
     }
 
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == player) {
-            process_output(d);
-            shutdownsock(d);
-            return 1;
-        }
+    for (d = player_descriptors(player); d; d = d->pnext) {
+        process_output(d);
+        shutdownsock(d);
+        return 1;
     }
     
     return 0;
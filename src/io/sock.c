@@ -13,13 +13,13 @@
 #include "sock.h"
 #include "mariadb_lockout.h"
 #include "websocket.h"
+#include "event_loop.h"
+#include "resolver.h"
+#include "mccp.h"
 
 /* Null device for reserving file descriptors */
 static const char *NullFile = "logs/null";
 
-/* Function prototypes */
-void get_ident(char *, int, int, struct sockaddr_in);
-
 void close_sockets(void)
 {
   struct descriptor_data *d, *dnext;
@@ -36,6 +36,11 @@ void close_sockets(void)
     }
   }
 
+  /* The messages below are plain text written straight to the fds, and
+   * the new process starts each connection over uncompressed, so every
+   * stream has to be completely sent first */
+  mccp_drain_all(MCCP_DRAIN_MSEC);
+
   for (d = descriptor_list; d; d = dnext)
   {
     dnext = d->next;
@@ -49,6 +54,13 @@ void close_sockets(void)
     }
     else if (!(d->cstatus & C_REMOTE))
     {
+      /* A client that would not take its stream end is dropped rather
+       * than handed over mid-stream */
+      if (d->mccp)
+      {
+        shutdownsock(d);
+        continue;
+      }
       if (exit_status == 1)
         write(d->descriptor, tprintf("%s %s", muse_name, reboot_message),
               (strlen(reboot_message) + strlen(muse_name) + 1));
@@ -109,21 +121,7 @@ void open_sockets(void)
       continue;
     }
 
-#ifdef HOST_LOOKUPS
-    struct hostent *hent;
-    hent = gethostbyaddr((char *)&(in.sin_addr.s_addr),
-                         sizeof(in.sin_addr.s_addr), AF_INET);
-    if (hent)
-    {
-      strncpy(buff, hent->h_name, sizeof(buff) - 1);
-      buff[sizeof(buff) - 1] = '\0';
-      log_io(tprintf("h_name: %s", hent->h_name));
-    }
-    else
-#endif
-    {
-      inet_ntop(AF_INET, &in.sin_addr, buff, sizeof(buff));
-    }
+    inet_ntop(AF_INET, &in.sin_addr, buff, sizeof(buff));
     
     d = initializesock(desc, &in, buff, RELOADCONNECT);
     if (d) {
@@ -277,8 +275,10 @@ struct descriptor_data *initializesock(int s, struct sockaddr_in *a,
   d->output_prefix = 0;
   d->output_suffix = 0;
   d->output_size = 0;
-  d->output.head = 0;
-  d->output.tail = &d->output.head;
+  d->output.buf = NULL;
+  d->output.size = 0;
+  d->output.start = 0;
+  d->output.headroom = 0;
   d->input.head = 0;
   d->input.tail = &d->input.head;
   d->raw_input = 0;
@@ -286,27 +286,52 @@ struct descriptor_data *initializesock(int s, struct sockaddr_in *a,
   d->pueblo = 0;
   d->emergency_bypass = 0;
   d->wsi = NULL;
+  d->telnet = 0;
+  d->mccp = NULL;
+  d->ev_mask = 0;
+  d->indexed = NOTHING;
+  d->pnext = NULL;
+  d->pprev = NULL;
   d->quota = command_burst_size;
   d->last_time = now;
   strncpy(d->addr, addr, 50);
   d->addr[49] = '\0';
   d->address = *a;
   
+  /* An fd the event loop cannot poll would never be read or written */
+  if (ev_attach(d) < 0)
+  {
+    static const char full[] =
+      "Sorry, there are too many connections right now. Try again later.\r\n";
+
+    log_io(tprintf("|R+REFUSED|: concid: %ld host %s: too many connections",
+                   d->concid, addr));
+    if (write(s, full, sizeof(full) - 1) < 0)
+    {
+      /* Closing it anyway */
+    }
+    close(s);
+    ndescriptors--;
+    SMART_FREE(d);
+    return NULL;
+  }
+
   if (descriptor_list)
     descriptor_list->prev = &d->next;
   d->next = descriptor_list;
   d->prev = &descriptor_list;
   descriptor_list = d;
   
-  get_ident(d->user, s, 3, *a);
-  
   tt = now;
   ct = ctime(&tt);
   if (ct && *ct)
     ct[strlen(ct) - 1] = '\0';
   
-  log_io(tprintf("|G+USER CONNECT|: concid: %ld host %s@%s time: %s",
-                 d->concid, d->user, addr, ct ? ct : "unknown"));
+  log_io(tprintf("|G+USER CONNECT|: concid: %ld host %s time: %s",
+                 d->concid, addr, ct ? ct : "unknown"));
+
+  /* d->addr and d->user read "resolving" until the lookups come back */
+  resolver_start(d);
    
   if (state == WAITCONNECT)
   {
@@ -319,8 +344,14 @@ struct descriptor_data *initializesock(int s, struct sockaddr_in *a,
     }
   }
   
+  /* Connections kept over a reboot had their stream ended by
+   * close_sockets(), so they are offered compression again too */
+  mccp_offer(d);
+
   if (state == WAITCONNECT)
+  {
     welcome_user(d);
+  }
 
   if (d->descriptor >= maxd)
     maxd = d->descriptor + 1;
@@ -388,6 +419,7 @@ void shutdownsock(struct descriptor_data *d)
   else if (!(d->cstatus & C_REMOTE))
   {
     if (d->descriptor >= 0) {
+      ev_detach(d);
       shutdown(d->descriptor, SHUT_RDWR);
       close(d->descriptor);
     }
@@ -400,6 +432,7 @@ void shutdownsock(struct descriptor_data *d)
         k->parent = 0;
   }
   
+  descriptor_unindex(d);
   freeqs(d);
   *d->prev = d->next;
   if (d->next)
@@ -413,11 +446,8 @@ void shutdownsock(struct descriptor_data *d)
   if (guest_player != NOTHING)
   {
     count = 0;
-    for (sd = descriptor_list; sd; sd = sd->next)
-    {
-      if (sd->state == CONNECTED && sd->player == guest_player)
-        ++count;
-    }
+    for (sd = player_descriptors(guest_player); sd; sd = sd->pnext)
+      ++count;
     if (count == 0)
       destroy_guest(guest_player);
   }
@@ -456,6 +486,7 @@ struct descriptor_data *new_connection(int sock)
       if (k++ > 50)
       {
         log_error("Too many EALREADY errors, restarting socket");
+        ev_del(sock);
         close(sock);
         sock = make_socket(inet_port);
         k = 0;
@@ -468,21 +499,8 @@ struct descriptor_data *new_connection(int sock)
     return NULL;
   }
   
-#ifdef HOST_LOOKUPS
-  struct hostent *hent;
-  hent = gethostbyaddr((char *)&(addr.sin_addr.s_addr),
-                       sizeof(addr.sin_addr.s_addr), AF_INET);
-  if (hent)
-  {
-    strncpy(buff, hent->h_name, sizeof(buff) - 1);
-    buff[sizeof(buff) - 1] = '\0';
-    log_io(tprintf("Connection from: %s", hent->h_name));
-  }
-  else
-#endif
-  {
-    inet_ntop(AF_INET, &addr.sin_addr, buff, sizeof(buff));
-  }
+  /* Hostname and ident are looked up by the resolver threads */
+  inet_ntop(AF_INET, &addr.sin_addr, buff, sizeof(buff));
 
   return initializesock(newsock, &addr, buff, WAITCONNECT);
 }
@@ -509,15 +527,8 @@ void freeqs(struct descriptor_data *d)
   
   if (!d) return;
   
-  cur = d->output.head;
-  while (cur)
-  {
-    next = cur->nxt;
-    free_text_block(cur);
-    cur = next;
-  }
-  d->output.head = 0;
-  d->output.tail = &d->output.head;
+  mccp_free(d);
+  output_free(d);
   
   cur = d->input.head;
   while (cur)
@@ -539,106 +550,10 @@ void freeqs(struct descriptor_data *d)
 void resock(void)
 { 
   log_io("Resocking...");
+  ev_del(sock);
   close(sock);
   sock = make_socket(inet_port);
   log_io("Resocking done");
 }
 #endif
 
-/* TODO: Examine whether this entire ident (RFC 1413) lookup should be
- * modernized or replaced. The protocol is largely obsolete and most
- * hosts no longer run identd. Consider making this optional or removing it. */
-void get_ident(char *rslt, int sock, int timout, struct sockaddr_in remoteaddr)
-{
-  struct sockaddr_in localaddr, sin_addr; 
-  struct timeval timeout;
-  fd_set filedes;
-  char buf[128], *r, *s;
-  int err, fd;
-  socklen_t len;
-
-  strncpy(rslt, "???", 39);
-  rslt[39] = '\0';
-
-  len = sizeof(localaddr);
-  if (getsockname(sock, (struct sockaddr *)&localaddr, &len))
-    return;
-
-  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
-    return;
-    
-  fcntl(fd, F_SETFL, O_NONBLOCK);
-  
-  memset(&sin_addr, 0, sizeof(sin_addr));
-  sin_addr.sin_family = AF_INET;
-  sin_addr.sin_addr = localaddr.sin_addr;
-  sin_addr.sin_port = 0;
-  
-  if (bind(fd, (struct sockaddr *)&sin_addr, sizeof(sin_addr)))
-  {
-    close(fd);
-    return;
-  }
-
-  sin_addr.sin_family = AF_INET;
-  sin_addr.sin_addr = remoteaddr.sin_addr;
-  sin_addr.sin_port = htons(113);
-  connect(fd, (struct sockaddr *)&sin_addr, sizeof(sin_addr));
-
-  FD_ZERO(&filedes);
-  FD_SET(fd, &filedes);
-  timeout.tv_sec = timout;
-  timeout.tv_usec = 0;
-  
-  if (select(fd + 1, NULL, &filedes, NULL, &timeout) < 1)
-  {
-    close(fd);
-    return;
-  }
-  
-  len = sizeof(err);
-  getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
-  if (err)
-  {
-    close(fd);
-    return;
-  }
-
-  snprintf(buf, sizeof(buf), "%d,%d\r\n", ntohs(remoteaddr.sin_port),
-          ntohs(localaddr.sin_port));
-  write(fd, buf, strlen(buf));
-
-  FD_ZERO(&filedes);
-  FD_SET(fd, &filedes);
-  timeout.tv_sec = 2;
-  timeout.tv_usec = 0;
-  
-  if (select(fd + 1, &filedes, NULL, NULL, &timeout) < 1)
-  {
-    close(fd);
-    return;
-  }
-  
-  len = read(fd, buf, 127);
-  close(fd);
-  
-  if (len <= 2)
-    return;
-    
-  buf[len] = '\0';
-
-  for (r = buf, len = 0; len < 3; len++, r++)
-    if (!(r = strchr(r, ':')))
-      return;
-
-  if ((s = strchr(r, '\n')))
-    *s = '\0';
-  if ((s = strchr(r, '\r')))
-    *s = '\0';
-
-  while (*r && isspace((unsigned char)*r))
-    r++;
-    
-  strncpy(rslt, r, 31);
-  rslt[31] = '\0';
-}
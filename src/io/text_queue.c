@@ -1,17 +1,33 @@
 /* text_queue.c - Text block and queue management for network I/O
  * Extracted from bsd.c during modernization
+ *
+ * Input is still a queue of text blocks, one per command line.  Output
+ * goes into a per-descriptor ring (struct output_ring) so queueing a
+ * fragment is a memcpy rather than two tracked allocations, and
+ * process_output() can send everything pending with one writev().
+ * A ring can keep headroom free in front of its text, so a WebSocket
+ * frame header can be built in place.
  */
 
 #include "config.h"
 #include "externs.h"
 #include "net.h"
 #include "websocket.h"
+#include "event_loop.h"
 #include <string.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+
+/* Output rings start small and double; one larger than OUTPUT_RING_KEEP
+ * is released when it drains */
+#define OUTPUT_RING_MIN  1024
+#define OUTPUT_RING_KEEP 8192
 
 /* Global statistics */
 size_t text_block_size = 0;
 size_t text_block_num = 0;
+size_t output_ring_size = 0;
+size_t output_ring_num = 0;
 
 /* Create a new text block with the given data */
 struct text_block *make_text_block(const char *s, int n)
@@ -84,55 +100,199 @@ void add_to_queue(struct text_queue *q, const char *b, int n)
     q->tail = &p->nxt;
 }
 
-/* Internal flush implementation */
-static int flush_queue_int(struct text_queue *q, int n, int pueblo)
+/* === OUTPUT RING === */
+
+/* Make room for n more bytes of output, moving the queued bytes to the
+ * front of a larger buffer (after its headroom) when the ring is too
+ * small */
+static int ring_reserve(struct descriptor_data *d, int n)
 {
-    struct text_block *p;
-    int really_flushed = 0;
+    struct output_ring *r = &d->output;
+    int need = d->output_size + n;
+    int size, first;
+    char *buf;
+
+    if (need <= r->size) {
+        return 1;
+    }
+
+    for (size = r->size ? r->size : OUTPUT_RING_MIN;
+         size < need + r->headroom; size <<= 1)
+        ;
 
-    if (!q) {
+    SAFE_MALLOC(buf, char, (size_t)size);
+    if (!buf) {
+        log_error("Failed to allocate output ring");
         return 0;
     }
 
-    n += strlen(flushed_message);
+    if (d->output_size) {
+        first = r->size - r->start;
+        if (first > d->output_size) {
+            first = d->output_size;
+        }
+        memcpy(buf + r->headroom, r->buf + r->start, (size_t)first);
+        memcpy(buf + r->headroom + first, r->buf,
+               (size_t)(d->output_size - first));
+    }
 
-    while (n > 0 && (p = q->head)) {
-        n -= p->nchars;
-        really_flushed += p->nchars;
-        q->head = p->nxt;
-        free_text_block(p);
+    if (r->buf) {
+        output_ring_size -= (size_t)r->size;
+        SMART_FREE(r->buf);
+    } else {
+        output_ring_num++;
     }
+    output_ring_size += (size_t)size;
+
+    r->buf = buf;
+    r->size = size;
+    r->start = r->headroom;
+    return 1;
+}
 
-    /* Add flush message */
-    p = make_text_block(flushed_message, strlen(flushed_message));
-    if (p) {
-        p->nxt = q->head;
-        q->head = p;
-        if (!p->nxt) {
-            q->tail = &p->nxt;
+/* Copy n bytes in at the tail; ring_reserve() must have made room */
+static void ring_append(struct descriptor_data *d, const char *b, int n)
+{
+    struct output_ring *r = &d->output;
+    int end, first;
+
+    end = r->start + d->output_size;
+    if (end >= r->size) {
+        end -= r->size;
+    }
+    first = r->size - end;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(r->buf + end, b, (size_t)first);
+    memcpy(r->buf, b + first, (size_t)(n - first));
+    d->output_size += n;
+}
+
+/* Copy n bytes in at the head; ring_reserve() must have made room */
+static void ring_prepend(struct descriptor_data *d, const char *b, int n)
+{
+    struct output_ring *r = &d->output;
+    int start, first;
+
+    start = r->start - n;
+    if (start < 0) {
+        start += r->size;
+    }
+    first = r->size - start;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(r->buf + start, b, (size_t)first);
+    memcpy(r->buf, b + first, (size_t)(n - first));
+    r->start = start;
+    d->output_size += n;
+}
+
+/* Point iov at the queued output; returns the number of iovecs used (0-2) */
+int output_peek(struct descriptor_data *d, struct iovec *iov)
+{
+    struct output_ring *r = &d->output;
+    int first;
+
+    if (!d->output_size) {
+        return 0;
+    }
+
+    first = r->size - r->start;
+    iov[0].iov_base = r->buf + r->start;
+    if (first >= d->output_size) {
+        iov[0].iov_len = (size_t)d->output_size;
+        return 1;
+    }
+    iov[0].iov_len = (size_t)first;
+    iov[1].iov_base = r->buf;
+    iov[1].iov_len = (size_t)(d->output_size - first);
+    return 2;
+}
+
+/* Drop n bytes from the head after they have been sent */
+void output_consume(struct descriptor_data *d, int n)
+{
+    struct output_ring *r = &d->output;
+
+    if (n >= d->output_size) {
+        d->output_size = 0;
+        r->start = r->headroom;
+        /* A burst (a long @list, a flushed backlog) should not pin a big
+         * buffer to an idle connection */
+        if (r->size > OUTPUT_RING_KEEP) {
+            output_free(d);
         }
-        really_flushed -= p->nchars;
+        return;
     }
 
-    return really_flushed;
+    r->start += n;
+    if (r->start >= r->size) {
+        r->start -= r->size;
+    }
+    d->output_size -= n;
 }
 
-/* Flush queue (non-Pueblo version) */
-static int flush_queue(struct text_queue *q, int n)
+/* Release a descriptor's output ring and anything still queued in it */
+void output_free(struct descriptor_data *d)
 {
-    return flush_queue_int(q, n, 0);
+    struct output_ring *r = &d->output;
+
+    if (r->buf) {
+        output_ring_size -= (size_t)r->size;
+        output_ring_num--;
+        SMART_FREE(r->buf);
+    }
+    r->buf = NULL;
+    r->size = 0;
+    r->start = 0;
+    d->output_size = 0;
 }
 
-/* Flush queue (Pueblo version) */
-static int flush_queue_pueblo(struct text_queue *q, int n)
+/* Discard the oldest queued output so that n more bytes fit under the
+ * limit.  Whole lines are dropped where possible, and flushed_message
+ * goes in front of whatever remains. */
+static void flush_output(struct descriptor_data *d, int n)
 {
-    return flush_queue_int(q, n, 1);
+    struct output_ring *r = &d->output;
+    int fl = (int)strlen(flushed_message);
+    int drop, at;
+
+    drop = n + fl;
+    if (drop > d->output_size) {
+        drop = d->output_size;
+    }
+
+    /* Finish the line the cut falls in */
+    while (drop > 0 && drop < d->output_size) {
+        at = r->start + drop - 1;
+        if (at >= r->size) {
+            at -= r->size;
+        }
+        if (r->buf[at] == '\n') {
+            break;
+        }
+        drop++;
+    }
+
+    if (drop) {
+        r->start += drop;
+        if (r->start >= r->size) {
+            r->start -= r->size;
+        }
+        d->output_size -= drop;
+    }
+
+    if (fl && ring_reserve(d, fl)) {
+        ring_prepend(d, flushed_message, fl);
+    }
 }
 
 /* Write data to a descriptor's output queue */
 int queue_write(struct descriptor_data *d, const char *b, int n)
 {
-    int space;
+    int limit;
 
     if (!d || !b || n <= 0) {
         return 0;
@@ -144,24 +304,21 @@ int queue_write(struct descriptor_data *d, const char *b, int n)
     }
 #endif
 
-    if (d->pueblo == 0) {
-        space = max_output - d->output_size - n;
-        if (space < 0) {
-            d->output_size -= flush_queue(&d->output, -space);
-        }
-    } else {
-        space = max_output_pueblo - d->output_size - n;
-        if (space < 0) {
-            d->output_size -= flush_queue_pueblo(&d->output, -space);
-        }
+    limit = d->pueblo ? max_output_pueblo : max_output;
+    if (d->output_size + n > limit) {
+        flush_output(d, d->output_size + n - limit);
     }
 
-    add_to_queue(&d->output, b, n);
-    d->output_size += n;
+    if (!ring_reserve(d, n)) {
+        return 0;
+    }
+    ring_append(d, b, n);
 
     /* WebSocket: notify lws that we have data to send */
     if (d->cstatus & C_WEBSOCKET) {
         websocket_request_write(d);
+    } else {
+        ev_sync(d);
     }
 
     return n;
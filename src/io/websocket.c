@@ -16,35 +16,47 @@
  * ARCHITECTURE
  * ============================================================================
  * - lws manages the listener socket and WebSocket protocol handling
- * - The game's select() includes lws fds via websocket_add_fds()
- * - After select(), websocket_service_fds() dispatches ready fds to lws
+ * - lws fds are registered with the game's event loop (event_loop.c) as
+ *   lws adds, changes and drops them; the main loop hands each ready one
+ *   to websocket_service_fd()
+ * - The database-loading loop still uses websocket_add_fds() and
+ *   websocket_service_fds() with plain fd_sets
  * - lws calls our protocol callback for connect/receive/writeable/close
  * - The callback creates/destroys descriptors and routes data through
  *   the existing text queue system (save_command for input, queue_write
  *   for output)
+ * - A WebSocket descriptor's output ring keeps LWS_PRE bytes free in
+ *   front of its text, so queued output normally goes to lws_write()
+ *   where it lies.  Only a ring that has wrapped is copied, once, into
+ *   a buffer kept with the session.
+ * - permessage-deflate is offered to clients; lws compresses each
+ *   message after we hand it over
  */
 
-#ifdef USE_WEBSOCKET
-
 #include "config.h"
 #include "externs.h"
+#include "websocket.h"
+
+#ifdef USE_WEBSOCKET
+
 #include "io_internal.h"
 #include "net.h"
 #include "sock.h"
-#include "websocket.h"
+#include "event_loop.h"
 #include "mariadb_lockout.h"
 
 #include <libwebsockets.h>
 #include <string.h>
 #include <errno.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 
 /* ============================================================================
  * LWS FD TRACKING FOR FOREIGN LOOP
  * ============================================================================
  * lws notifies us about its file descriptors via callback. We maintain a
- * table of these fds so websocket_add_fds() can include them in the game's
- * select() call, and websocket_service_fds() can dispatch ready events.
+ * table of these fds (mirrored into the event loop) so ready events can be
+ * handed back to lws with the events it asked for.
  */
 
 #define MAX_LWS_FDS 64
@@ -58,8 +70,17 @@ static struct lws_context *ws_context = NULL;
 /* Per-connection user data stored by lws */
 struct ws_session {
     struct descriptor_data *d;  /* Back-pointer to our descriptor */
+    unsigned char *tx;          /* LWS_PRE + tx_size, for wrapped output */
+    size_t tx_size;
 };
 
+/* A coalescing buffer larger than this is released after use */
+#define WS_TX_KEEP 8192
+
+/* Output statistics for @info compression */
+static unsigned long ws_direct_writes = 0;
+static unsigned long ws_coalesced_writes = 0;
+
 /* Forward declarations */
 static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
                        void *user, void *in, size_t len);
@@ -76,6 +97,18 @@ static struct lws_protocols ws_protocols[] = {
     { NULL, NULL, 0, 0, 0, NULL, 0 }  /* terminator */
 };
 
+#ifndef LWS_WITHOUT_EXTENSIONS
+/* Extensions offered to clients */
+static const struct lws_extension ws_extensions[] = {
+    {
+        "permessage-deflate",
+        lws_extension_callback_pm_deflate,
+        "permessage-deflate; client_no_context_takeover; client_max_window_bits"
+    },
+    { NULL, NULL, NULL }  /* terminator */
+};
+#endif
+
 
 /* ============================================================================
  * INITIALIZATION AND SHUTDOWN
@@ -111,6 +144,9 @@ int websocket_init(int port)
     vhost_info.port = port;
     vhost_info.protocols = ws_protocols;
     vhost_info.options = 0;
+#ifndef LWS_WITHOUT_EXTENSIONS
+    vhost_info.extensions = ws_extensions;
+#endif
 
     if (!lws_create_vhost(ws_context, &vhost_info)) {
         log_error("websocket_init: Failed to create lws vhost");
@@ -193,6 +229,39 @@ void websocket_service_fds(fd_set *read_set, fd_set *write_set)
     }
 }
 
+/* Dispatch one lws fd reported ready by the event loop */
+void websocket_service_fd(int fd, int ready)
+{
+    int i;
+    struct lws_pollfd pfd;
+
+    if (!ws_context) {
+        return;
+    }
+
+    for (i = 0; i < lws_pollfd_count; i++) {
+        if (lws_pollfds[i].fd == fd) {
+            pfd = lws_pollfds[i];
+            pfd.revents = 0;
+            if (ready & EV_READ) {
+                pfd.revents |= POLLIN;
+            }
+            if (ready & EV_WRITE) {
+                pfd.revents |= POLLOUT;
+            }
+            lws_service_fd(ws_context, &pfd);
+            return;
+        }
+    }
+}
+
+/* Event loop interest matching an lws poll mask */
+static int lws_ev_mask(int events)
+{
+    return ((events & POLLIN) ? EV_READ : 0) |
+           ((events & POLLOUT) ? EV_WRITE : 0);
+}
+
 /* Handle lws internal timers (ping/pong keepalives, etc.)
  * lws 4.x asserts that pollfd != NULL in lws_service_fd(), so we use
  * lws_service_tsi() with a 0ms timeout to process pending internal work
@@ -231,68 +300,96 @@ void websocket_close_connection(struct descriptor_data *d)
     }
 }
 
+/* Copy wrapped output into the session's buffer, after LWS_PRE bytes of
+ * headroom; returns the payload, or NULL if it could not be allocated */
+static unsigned char *ws_coalesce(struct ws_session *session,
+                                  struct iovec *iov, int n, int total_len)
+{
+    size_t size;
+    int offset, i;
+
+    if (session->tx_size < (size_t)total_len) {
+        for (size = session->tx_size ? session->tx_size : 1024;
+             size < (size_t)total_len; size <<= 1)
+            ;
+        if (session->tx) {
+            SMART_FREE(session->tx);
+        }
+        session->tx = (unsigned char *)safe_malloc(LWS_PRE + size,
+                                                   __FILE__, __LINE__);
+        if (!session->tx) {
+            session->tx_size = 0;
+            return NULL;
+        }
+        session->tx_size = size;
+    }
+
+    offset = LWS_PRE;
+    for (i = 0; i < n; i++) {
+        memcpy(session->tx + offset, iov[i].iov_base, iov[i].iov_len);
+        offset += (int)iov[i].iov_len;
+    }
+    return session->tx + LWS_PRE;
+}
+
 /* Write queued output to a WebSocket connection.
  * Called from process_output() when d->cstatus & C_WEBSOCKET.
  * Returns 1 on success, 0 on error (connection should be closed). */
 int websocket_write_output(struct descriptor_data *d)
 {
-    struct text_block *cur;
-    unsigned char *buf;
-    int total_len, offset;
+    struct ws_session *session;
+    struct iovec iov[2];
+    unsigned char *payload;
+    int total_len, n, written;
 
     if (!d || !d->wsi) {
         return 0;
     }
 
-    /* Calculate total output size */
-    total_len = 0;
-    for (cur = d->output.head; cur; cur = cur->nxt) {
-        total_len += cur->nchars;
-    }
-
+    total_len = d->output_size;
     if (total_len == 0) {
         return 1;
     }
-
-    /* Allocate buffer with LWS_PRE padding */
-    buf = (unsigned char *)safe_malloc(
-        (size_t)(LWS_PRE + total_len), __FILE__, __LINE__);
-    if (!buf) {
-        log_error("websocket_write_output: allocation failed");
-        return 0;
-    }
-
-    /* Copy all queued text blocks into the buffer */
-    offset = LWS_PRE;
-    for (cur = d->output.head; cur; cur = cur->nxt) {
-        memcpy(buf + offset, cur->start, (size_t)cur->nchars);
-        offset += cur->nchars;
+    session = (struct ws_session *)lws_wsi_user((struct lws *)d->wsi);
+
+    /* The ring keeps LWS_PRE bytes free in front of its text, so unless
+     * it has wrapped, lws can build the frame header in place */
+    n = output_peek(d, iov);
+    if (n == 1 && (char *)iov[0].iov_base - d->output.buf >= LWS_PRE) {
+        payload = (unsigned char *)iov[0].iov_base;
+        ws_direct_writes++;
+    } else {
+        payload = session ? ws_coalesce(session, iov, n, total_len) : NULL;
+        if (!payload) {
+            log_error("websocket_write_output: allocation failed");
+            return 0;
+        }
+        ws_coalesced_writes++;
     }
 
     /* Send via lws */
-    int written = lws_write((struct lws *)d->wsi,
-                            buf + LWS_PRE, (size_t)total_len,
-                            LWS_WRITE_TEXT);
-
-    SMART_FREE(buf);
+    written = lws_write((struct lws *)d->wsi, payload, (size_t)total_len,
+                        LWS_WRITE_TEXT);
+
+    /* A burst should not pin a big buffer to an idle connection */
+    if (session && session->tx_size > WS_TX_KEEP) {
+        SMART_FREE(session->tx);
+        session->tx = NULL;
+        session->tx_size = 0;
+    }
 
     if (written < 0) {
         return 0;  /* Error — caller will shutdownsock */
     }
 
-    /* Free all consumed text blocks */
-    while (d->output.head) {
-        cur = d->output.head;
-        d->output_size -= cur->nchars;
-        d->output.head = cur->nxt;
-        free_text_block(cur);
-    }
-    d->output.tail = &d->output.head;
+    /* The whole message was handed to lws */
+    output_consume(d, total_len);
 
     return 1;
 }
 
 
+
 /* ============================================================================
  * LWS PROTOCOL CALLBACK
  * ============================================================================
@@ -317,6 +414,7 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
             lws_pollfds[lws_pollfd_count].events = (short)pa->events;
             lws_pollfds[lws_pollfd_count].revents = 0;
             lws_pollfd_count++;
+            ev_add(pa->fd, EV_LWS, NULL, lws_ev_mask(pa->events));
         } else {
             log_error("websocket: MAX_LWS_FDS exceeded");
         }
@@ -327,6 +425,7 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
     {
         struct lws_pollargs *pa = (struct lws_pollargs *)in;
         int i;
+        ev_del(pa->fd);
         for (i = 0; i < lws_pollfd_count; i++) {
             if (lws_pollfds[i].fd == pa->fd) {
                 /* Swap with last entry */
@@ -345,6 +444,7 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
         for (i = 0; i < lws_pollfd_count; i++) {
             if (lws_pollfds[i].fd == pa->fd) {
                 lws_pollfds[i].events = (short)pa->events;
+                ev_mod(pa->fd, lws_ev_mask(pa->events));
                 break;
             }
         }
@@ -406,12 +506,18 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
         d->output_prefix = NULL;
         d->output_suffix = NULL;
         d->output_size = 0;
-        d->output.head = NULL;
-        d->output.tail = &d->output.head;
+        d->output.buf = NULL;
+        d->output.size = 0;
+        d->output.start = 0;
+        d->output.headroom = LWS_PRE;
         d->input.head = NULL;
         d->input.tail = &d->input.head;
         d->raw_input = NULL;
         d->raw_input_at = NULL;
+        d->ev_mask = 0;
+        d->indexed = NOTHING;
+        d->pnext = NULL;
+        d->pprev = NULL;
         d->quota = command_burst_size;
         d->last_time = now;
         d->connected_at = now;
@@ -419,6 +525,8 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
         d->pueblo = 0;
         d->emergency_bypass = 0;
         d->wsi = wsi;
+        d->telnet = 0;
+        d->mccp = NULL;
         d->charname = NULL;
         memset(d->user, 0, sizeof(d->user));
         strncpy(d->addr, addr_str, sizeof(d->addr) - 1);
@@ -439,6 +547,8 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
 
         /* Store back-pointer in session */
         session->d = d;
+        session->tx = NULL;
+        session->tx_size = 0;
 
         log_io(tprintf("|G+WS CONNECT|: concid: %ld host: %s fd: %d",
                        d->concid, addr_str, fd));
@@ -447,7 +557,7 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
         if (lockout_check_ip(d->address.sin_addr)) {
             send_message_text(d, welcome_lockout_msg, 0);
             /* Flush output before closing */
-            if (d->output.head) {
+            if (d->output_size) {
                 lws_callback_on_writable(wsi);
             }
             /* Will be cleaned up on next callback */
@@ -458,7 +568,7 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
         welcome_user(d);
 
         /* Trigger initial output flush */
-        if (d->output.head) {
+        if (d->output_size) {
             lws_callback_on_writable(wsi);
         }
 
@@ -525,7 +635,7 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
     {
         struct descriptor_data *d = session ? session->d : NULL;
 
-        if (!d || !d->output.head) {
+        if (!d || !d->output_size) {
             break;
         }
 
@@ -534,7 +644,7 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
         }
 
         /* If more data remains, request another write callback */
-        if (d->output.head) {
+        if (d->output_size) {
             lws_callback_on_writable(wsi);
         }
 
@@ -561,6 +671,11 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
             shutdownsock(d);
             session->d = NULL;
         }
+        if (session && session->tx) {
+            SMART_FREE(session->tx);
+            session->tx = NULL;
+            session->tx_size = 0;
+        }
         break;
     }
 
@@ -572,3 +687,19 @@ static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
 }
 
 #endif /* USE_WEBSOCKET */
+
+/* WebSocket lines for @info compression */
+void websocket_info(dbref player)
+{
+#ifdef USE_WEBSOCKET
+    notify(player, tprintf("WebSocket writes: %lu in place, %lu coalesced",
+                           ws_direct_writes, ws_coalesced_writes));
+#ifndef LWS_WITHOUT_EXTENSIONS
+    notify(player, "WebSocket deflate: offered (permessage-deflate)");
+#else
+    notify(player, "WebSocket deflate: unavailable (lws built without extensions)");
+#endif
+#else
+    notify(player, "WebSocket: unavailable (built without libwebsockets)");
+#endif
+}
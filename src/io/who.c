@@ -391,8 +391,8 @@ void dump_users(dbref w, char *arg1, char *arg2, struct descriptor_data *k)
 
       if (w_blocked || d_blocked)
       {
-        int w_can_see = could_doit(real_owner(w), real_owner(d->player), A_BLACKLIST);
-        int d_can_see = could_doit(real_owner(d->player), real_owner(w), A_BLACKLIST);
+        int w_can_see = blacklist_check(real_owner(w), real_owner(d->player));
+        int d_can_see = blacklist_check(real_owner(d->player), real_owner(w));
 
         if (!w_can_see || !d_can_see)
           continue;
@@ -457,8 +457,8 @@ void dump_users(dbref w, char *arg1, char *arg2, struct descriptor_data *k)
 
           if (w_blocked || d_blocked)
           {
-            int w_can_see = could_doit(real_owner(w), real_owner(d->player), A_BLACKLIST);
-            int d_can_see = could_doit(real_owner(d->player), real_owner(w), A_BLACKLIST);
+            int w_can_see = blacklist_check(real_owner(w), real_owner(d->player));
+            int d_can_see = blacklist_check(real_owner(d->player), real_owner(w));
 
             if (!w_can_see || !d_can_see)
             {
@@ -798,8 +798,8 @@ void dump_users(dbref w, char *arg1, char *arg2, struct descriptor_data *k)
 
         if (!w_blocked && !m_blocked)
         {
-          int w_can_see = could_doit(real_owner(w), real_owner(messenger), A_BLACKLIST);
-          int m_can_see = could_doit(real_owner(messenger), real_owner(w), A_BLACKLIST);
+          int w_can_see = blacklist_check(real_owner(w), real_owner(messenger));
+          int m_can_see = blacklist_check(real_owner(messenger), real_owner(w));
 
           if (w_can_see && m_can_see)
           {
@@ -2060,13 +2060,8 @@ void do_su(dbref player, char *arg1, char *arg2, dbref cause)
     int counter = 0;
     struct descriptor_data *sd;
 
-    for (sd = descriptor_list; sd; sd = sd->next)
-    {
-      if (sd->state == CONNECTED && sd->player == player)
-      {
-        counter++;
-      }
-    }
+    for (sd = player_descriptors(player); sd; sd = sd->pnext)
+      counter++;
 
     if (counter > 1)
     {
@@ -2112,16 +2107,14 @@ void do_su(dbref player, char *arg1, char *arg2, dbref cause)
 
   announce_disconnect(d->player);
   d->player = thing;
+  descriptor_index(d);
   if (Guest(player))
   {
     struct descriptor_data *sd;
     int count = 0;
 
-    for (sd = descriptor_list; sd; sd = sd->next)
-    {
-      if (sd->state == CONNECTED && sd->player == player)
-	++count;
-    }
+    for (sd = player_descriptors(player); sd; sd = sd->pnext)
+      ++count;
     if (count == 0)
       destroy_guest(player);
   }
@@ -2139,21 +2132,18 @@ struct descriptor_data *find_least_idle(dbref player)
 
   sd = NULL;
 
-  for (d = descriptor_list; d; d = d->next)
+  for (d = player_descriptors(player); d; d = d->pnext)
   {
-    if (d->state == CONNECTED && d->player == player)
+    if (d->last_time > last)
     {
-      if (d->last_time > last)
-      {
-        sd = d;
-        last = d->last_time;
-        dup = 0;
-      } 
-      else if (d->last_time == last)
-      {
-        dup = last;
-        sd = NULL;
-      }
+      sd = d;
+      last = d->last_time;
+      dup = 0;
+    } 
+    else if (d->last_time == last)
+    {
+      dup = last;
+      sd = NULL;
     }
   }
   if (dup != 0)
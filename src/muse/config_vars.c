@@ -92,6 +92,14 @@ int announce_cost = 0;
 int queue_cost = 0;
 int queue_loss = 0;
 int max_queue = 0;
+int queue_budget_msec = 0;
+int queue_fair = 0;
+int queue_quantum_usec = 0;
+int dns_cache_ttl = 0;
+int ident_lookups = 0;
+int mccp_compression = 0;
+int queue_owner_cmds = 0;
+int max_pids = 0;
 int channel_name_limit = 0;
 int player_name_limit = 0;
 int player_reference_limit = 0;
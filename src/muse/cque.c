@@ -20,14 +20,19 @@
  * - All functions now use ANSI C prototypes
  * - Reorganized with clear === section markers
  * - Added comprehensive inline documentation
- * - Improved queue consistency checking
  * - Better error handling and logging
  *
  * QUEUE ARCHITECTURE:
  * - Priority-based command queue (lower pri = higher priority)
- * - Wait queue integrated into main queue
- * - PID system for tracking individual commands
- * - Per-player queue limits to prevent runaway objects
+ * - Runnable commands in a binary min-heap on (pri, wait, queue order)
+ * - @wait commands on a hierarchical timer wheel until they come due,
+ *   timed in milliseconds off the monotonic clock (10ms resolution)
+ * - PID -> entry table so @halt <pid> needs no queue walk
+ * - Main loop drains runnable commands within queue_budget_msec per pass
+ * - Optional per-owner fair queuing (queue_fair) with deficit round robin
+ * - PID system for tracking individual commands (bitmap, max_pids wide)
+ * - Per-player queue limits to prevent runaway objects, counted in db[].queue
+ * - Each entry is one allocation holding command and env strings
  *
  * SECURITY NOTES:
  * - All dbrefs validated with valid_player() or GoodObject()
@@ -39,6 +44,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <sys/time.h>
 #ifdef XENIX
 #include <sys/signal.h>
 #else
@@ -68,35 +74,104 @@ typedef struct bque BQUE;
 /*
  * Queue Entry Structure
  * 
- * Represents a single command waiting to be executed.
- * Queue is maintained as a doubly-linked list sorted by priority and wait time.
+ * Represents a single command waiting to be executed.  An entry lives in
+ * exactly one of two places: the ready heap once its wait time has passed,
+ * or a timer-wheel slot while it is still waiting.  Every entry is also on
+ * the all-entries list so @ps and @halt can walk the queue.
  */
 struct bque
 {
-  BQUE *next;               /* Next entry in queue */
-  BQUE *prev;               /* Previous entry in queue */
+  BQUE *next;               /* Next entry in timer-wheel slot */
+  BQUE **pprev;             /* Link pointing at us in slot, NULL if not waiting */
+  BQUE *all_next;           /* Next entry in all-entries list */
+  BQUE **all_pprev;         /* Link pointing at us in all-entries list */
   dbref player;             /* Player who will execute command */
   dbref cause;              /* Player causing command (for %n substitution) */
-  char *env[10];            /* Environment variables from wild match */
+  char *env[10];            /* Wild match variables, packed after command */
   int pri;                  /* Priority of command (lower = higher priority) */
-  time_t wait;              /* Timestamp - execute when now >= wait */
+  long wait;                /* Monotonic msec - execute once reached */
   int pid;                  /* Process ID for this command */
+  int heap;                 /* Index in ready heap, -1 if not ready */
+  dbref owner;              /* Owner charged under fair queuing */
+  struct owner_queue *oq;   /* Owner sub-queue holding us, if any */
+  unsigned long seq;        /* Queueing order, keeps equal keys FIFO */
 };
 
 /* ============================================================================
  * QUEUE GLOBALS
  * ============================================================================ */
 
-static BQUE *qfirst = NULL;   /* Head of command queue */
-static BQUE *qlast = NULL;    /* Tail of command queue */
+#define DEFAULT_PIDS 32768     /* PID space when max_pids is unset */
+#define MAX_PID_SPACE (1 << 22) /* Upper bound on max_pids */
+
+/*
+ * Timer wheel geometry: WHEEL_LEVELS levels of WHEEL_SIZE slots, each level
+ * WHEEL_SIZE times coarser than the one below.  The wheel turns in ticks of
+ * WHEEL_TICK_MSEC; four levels of 64 cover 2^24 ticks (about 46 hours) and
+ * anything further out waits on wheel_far.
+ */
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    4
+#define WHEEL_TICK_MSEC 10
+
+/* Binary min-heap of runnable entries */
+struct ready_heap
+{
+  BQUE **v;                 /* Entries, v[0] runs first */
+  int count;                /* Entries in the heap */
+  int alloc;                /* Capacity of v */
+};
+
+/* Per-owner sub-queue used when queue_fair is set */
+struct owner_queue
+{
+  dbref owner;              /* Owner whose commands these are */
+  struct ready_heap heap;   /* Owner's runnable entries */
+  struct owner_queue *hnext; /* Next in owner_hash chain */
+  struct owner_queue *next; /* Round-robin ring, while active */
+  struct owner_queue *prev;
+  int active;               /* On the ring (has runnable entries) */
+  int granted;              /* Quantum already granted this turn */
+  long deficit;             /* Remaining credit, usec (or commands) */
+  int tick_cmds;            /* Commands run this tick */
+  unsigned long cmds;       /* Commands run since sub-queue was created */
+  long usec;                /* Run time since sub-queue was created */
+};
+
+#define OWNER_HASH_SIZE 256
+
+static struct ready_heap ready;  /* Runnable entries, when not fair */
+static int fair_mode = 0;        /* queue_fair as last applied */
+static struct owner_queue *owner_hash[OWNER_HASH_SIZE]; /* Owner sub-queues */
+static struct owner_queue *owner_ring = NULL; /* Round-robin cursor */
+static int owner_active = 0;     /* Owners on the ring */
+
+static BQUE *wheel[WHEEL_LEVELS][WHEEL_SIZE]; /* Waiting entries by due time */
+static BQUE *wheel_far = NULL;  /* Entries due beyond the top level */
+static long wheel_time = 0;     /* Tick; everything due by it is ready */
+
+static BQUE *qall = NULL;       /* All queued entries, unordered */
+static int queue_count = 0;     /* Entries in qall */
+static unsigned long queue_seq = 0; /* Next insertion sequence number */
+
+static BQUE **by_pid = NULL;    /* PID -> entry, for @halt <pid> */
+static int pid_space = 0;       /* PIDs currently allocatable */
+
+/* Queue runner statistics, reported by @cmdav */
+unsigned long queue_passes = 0;      /* Passes that ran at least one command */
+unsigned long queue_budget_hits = 0; /* Passes stopped by the budget */
+int queue_pass_cmds = 0;             /* Commands run by the last pass */
+int queue_pass_peak = 0;             /* Most commands run in one pass */
+long queue_pass_usec = 0;            /* Wall-clock time of the last pass */
 
 /* ============================================================================
  * FORWARD DECLARATIONS
  * ============================================================================ */
 
-static void big_que(dbref player, char *command, dbref cause, int pri, time_t wait);
+static void big_que(dbref player, char *command, dbref cause, int pri, long wait);
 static int add_to(dbref player, int am);
-static BQUE *find_wait(BQUE *queue);
 
 void do_halt_player(dbref player, char *ncom);
 void do_halt_process(dbref player, int pid);
@@ -177,15 +252,15 @@ void parse_que(dbref player, char *command, dbref cause)
 /*
  * add_to - Adjust player's queue count
  * 
- * Updates A_QUEUE attribute to track number of commands in queue.
+ * Keeps the owner's count of queued commands in db[].queue; atr_get()
+ * renders it when softcode reads the Queue attribute.
  * Returns new queue count.
  * 
  * SECURITY: Uses player's owner for accounting to prevent quota bypassing
  */
 static int add_to(dbref player, int am)
 {
-  long num;
-  char buff[200];
+  int num;
 
   if (!GoodObject(player)) {
     return 0;
@@ -197,17 +272,605 @@ static int add_to(dbref player, int am)
     return 0;
   }
 
-  num = atol(atr_get(player, A_QUEUE));
-  num += am;
-  
-  if (num > 0) {
-    snprintf(buff, sizeof(buff), "%ld", num);
+  num = db[player].queue + am;
+  db[player].queue = (num > 0) ? num : 0;
+  return (num);
+}
+
+/* ============================================================================
+ * SCHEDULER
+ * ============================================================================
+ *
+ * Runnable entries sit in a binary min-heap ordered by (pri, wait, seq),
+ * which is exactly the order the old sorted list ran them in.  Entries
+ * still waiting sit on a hierarchical timer wheel and are moved to the
+ * heap as wheel_time catches up with the monotonic clock.  Insert, run
+ * and remove are all O(log n); advancing the wheel is amortised O(1) per
+ * tick plus the entries that come due.
+ */
+
+/*
+ * entry_before - Heap ordering: priority, then due time, then FIFO
+ */
+static int entry_before(BQUE *a, BQUE *b)
+{
+  if (a->pri != b->pri) {
+    return a->pri < b->pri;
+  }
+  if (a->wait != b->wait) {
+    return a->wait < b->wait;
+  }
+  return a->seq < b->seq;
+}
+
+/*
+ * heap_place - Store entry at heap index i
+ */
+static void heap_place(struct ready_heap *h, int i, BQUE *e)
+{
+  h->v[i] = e;
+  e->heap = i;
+}
+
+static void heap_sift_up(struct ready_heap *h, int i)
+{
+  BQUE *e = h->v[i];
+
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+
+    if (!entry_before(e, h->v[parent])) {
+      break;
+    }
+    heap_place(h, i, h->v[parent]);
+    i = parent;
+  }
+  heap_place(h, i, e);
+}
+
+static void heap_sift_down(struct ready_heap *h, int i)
+{
+  BQUE *e = h->v[i];
+
+  for (;;) {
+    int child = 2 * i + 1;
+
+    if (child >= h->count) {
+      break;
+    }
+    if (child + 1 < h->count && entry_before(h->v[child + 1], h->v[child])) {
+      child++;
+    }
+    if (!entry_before(h->v[child], e)) {
+      break;
+    }
+    heap_place(h, i, h->v[child]);
+    i = child;
+  }
+  heap_place(h, i, e);
+}
+
+/*
+ * heap_push - Add an entry to a heap
+ */
+static void heap_push(struct ready_heap *h, BQUE *e)
+{
+  if (h->count == h->alloc) {
+    BQUE **grown;
+    int alloc = h->alloc ? h->alloc * 2 : 16;
+
+    SAFE_MALLOC(grown, BQUE *, (size_t)alloc);
+    if (h->v) {
+      memcpy(grown, h->v, sizeof(BQUE *) * (size_t)h->count);
+      SMART_FREE(h->v);
+    }
+    h->v = grown;
+    h->alloc = alloc;
+  }
+
+  heap_place(h, h->count, e);
+  heap_sift_up(h, h->count++);
+}
+
+/*
+ * heap_remove - Take an entry out of a heap from any position
+ */
+static void heap_remove(struct ready_heap *h, BQUE *e)
+{
+  int i = e->heap;
+  BQUE *last = h->v[--h->count];
+
+  e->heap = -1;
+  if (last == e) {
+    return;
+  }
+
+  heap_place(h, i, last);
+  heap_sift_up(h, i);
+  if (last->heap == i) {
+    heap_sift_down(h, i);
+  }
+}
+
+/* ============================================================================
+ * FAIR QUEUING
+ * ============================================================================
+ *
+ * With queue_fair set, runnable entries go to a heap per owner instead of
+ * the single ready heap, and owners with work are served by deficit round
+ * robin.  Each turn an owner is granted queue_quantum_usec of credit and
+ * runs commands, in its own (pri, wait, seq) order, until the measured
+ * run time has used the credit up.  A quantum of zero or less charges one
+ * unit per command, which is plain round robin.  queue_owner_cmds caps how
+ * many commands one owner may run per second; an owner at the cap is
+ * skipped until the next tick.  Priority therefore only orders commands
+ * within an owner, never across owners.
+ */
+
+/*
+ * owner_find - Owner sub-queue for 'owner', created on demand
+ */
+static struct owner_queue *owner_find(dbref owner, int create)
+{
+  struct owner_queue *oq;
+  unsigned int h = (unsigned int)owner % OWNER_HASH_SIZE;
+
+  for (oq = owner_hash[h]; oq; oq = oq->hnext) {
+    if (oq->owner == owner) {
+      return oq;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+
+  SAFE_MALLOC(oq, struct owner_queue, 1);
+  memset(oq, 0, sizeof(*oq));
+  oq->owner = owner;
+  oq->hnext = owner_hash[h];
+  owner_hash[h] = oq;
+  return oq;
+}
+
+/*
+ * owner_activate / owner_deactivate - Maintain the round-robin ring of
+ * owners that have runnable entries
+ */
+static void owner_activate(struct owner_queue *oq)
+{
+  if (owner_ring) {
+    /* Join just behind the cursor so we wait one full round */
+    oq->next = owner_ring;
+    oq->prev = owner_ring->prev;
+    oq->prev->next = oq;
+    owner_ring->prev = oq;
   } else {
-    buff[0] = '\0';
+    oq->next = oq->prev = oq;
+    owner_ring = oq;
   }
-  
-  atr_add(player, A_QUEUE, buff);
-  return (num);
+  oq->active = 1;
+  owner_active++;
+}
+
+static void owner_deactivate(struct owner_queue *oq)
+{
+  if (oq->next == oq) {
+    owner_ring = NULL;
+  } else {
+    oq->prev->next = oq->next;
+    oq->next->prev = oq->prev;
+    if (owner_ring == oq) {
+      owner_ring = oq->next;
+    }
+  }
+  oq->next = oq->prev = NULL;
+  oq->active = 0;
+  oq->granted = 0;
+  owner_active--;
+
+  /* Unused credit lapses; debt from an expensive command is kept */
+  if (oq->deficit > 0) {
+    oq->deficit = 0;
+  }
+}
+
+/*
+ * ready_push - Make an entry runnable under the current scheduling mode
+ */
+static void ready_push(BQUE *e)
+{
+  struct owner_queue *oq;
+
+  if (!fair_mode) {
+    e->oq = NULL;
+    heap_push(&ready, e);
+    return;
+  }
+
+  oq = owner_find(e->owner, 1);
+  e->oq = oq;
+  heap_push(&oq->heap, e);
+  if (!oq->active) {
+    owner_activate(oq);
+  }
+}
+
+/*
+ * ready_remove - Take a runnable entry off whichever heap holds it
+ */
+static void ready_remove(BQUE *e)
+{
+  struct owner_queue *oq = e->oq;
+
+  if (!oq) {
+    heap_remove(&ready, e);
+    return;
+  }
+
+  heap_remove(&oq->heap, e);
+  e->oq = NULL;
+  if (!oq->heap.count && oq->active) {
+    owner_deactivate(oq);
+  }
+}
+
+/*
+ * ready_rebuild - Re-file every runnable entry after queue_fair changes
+ */
+static void ready_rebuild(void)
+{
+  BQUE *e, *list = NULL;
+
+  for (e = qall; e; e = e->all_next) {
+    if (e->heap >= 0) {
+      ready_remove(e);
+      e->next = list;
+      list = e;
+    }
+  }
+
+  fair_mode = queue_fair ? 1 : 0;
+
+  while ((e = list) != NULL) {
+    list = e->next;
+    e->next = NULL;
+    ready_push(e);
+  }
+}
+
+/*
+ * fair_rounds - Round of the ring walk in which 'oq' first has credit
+ *
+ * Round 0 is the walk from the cursor to the end of the ring.  Each time
+ * the walk reaches an owner it is granted its quantum (the owner at the
+ * cursor only once per turn); it is served as soon as its credit is
+ * positive.
+ */
+static long fair_rounds(struct owner_queue *oq, long grant)
+{
+  long turns;
+
+  if (oq == owner_ring && oq->granted) {
+    if (oq->deficit > 0) {
+      return 0;
+    }
+    return -oq->deficit / grant + 1;
+  }
+
+  turns = oq->deficit > 0 ? 1 : -oq->deficit / grant + 1;
+  return turns - 1;
+}
+
+/*
+ * fair_pick - Owner the round robin serves next, or NULL
+ *
+ * Works out which owner the ring walk would stop at without granting
+ * anything, so the queue can be polled freely.  Owners at their
+ * per-tick command cap are passed over; if every owner is capped there
+ * is nothing runnable until the next tick.  'round' gets the round the
+ * walk stops in and 'pos' the owner's place on the ring.
+ */
+static struct owner_queue *fair_pick(long grant, long *round, int *pos)
+{
+  struct owner_queue *oq, *best = NULL;
+  long r, best_round = 0;
+  int i, best_pos = 0;
+
+  for (oq = owner_ring, i = 0; oq && i < owner_active; oq = oq->next, i++) {
+    if (queue_owner_cmds > 0 && oq->tick_cmds >= queue_owner_cmds) {
+      continue;
+    }
+    r = fair_rounds(oq, grant);
+    if (!best || r < best_round) {
+      best = oq;
+      best_round = r;
+      best_pos = i;
+    }
+  }
+
+  *round = best_round;
+  *pos = best_pos;
+  return best;
+}
+
+/*
+ * fair_next - Entry the round robin serves next, or NULL
+ */
+static BQUE *fair_next(void)
+{
+  struct owner_queue *oq;
+  long round;
+  int pos;
+
+  oq = fair_pick(queue_quantum_usec > 0 ? queue_quantum_usec : 1, &round, &pos);
+  return oq ? oq->heap.v[0] : NULL;
+}
+
+/*
+ * fair_take - Give the next owner its turn
+ *
+ * Called by do_top() for the command it is about to run.  Applies the
+ * grants of the ring walk fair_pick() worked out: every uncapped owner
+ * the walk passes gets its quantum each time it is reached, and the
+ * cursor stops at the owner being served.
+ */
+static void fair_take(void)
+{
+  struct owner_queue *oq, *serve;
+  long grant = queue_quantum_usec > 0 ? queue_quantum_usec : 1;
+  long round, visits;
+  int i, pos;
+
+  if (!(serve = fair_pick(grant, &round, &pos))) {
+    return;
+  }
+
+  for (oq = owner_ring, i = 0; i < owner_active; oq = oq->next, i++) {
+    if (queue_owner_cmds > 0 && oq->tick_cmds >= queue_owner_cmds) {
+      oq->granted = 0;
+      continue;
+    }
+    visits = i <= pos ? round + 1 : round;
+    if (i == 0 && oq->granted) {
+      visits--;
+    }
+    oq->deficit += visits * grant;
+    oq->granted = 0;
+  }
+
+  serve->granted = 1;
+  owner_ring = serve;
+}
+
+/*
+ * fair_charge - Bill an owner for a command it just ran
+ */
+static void fair_charge(struct owner_queue *oq, long usec)
+{
+  oq->deficit -= queue_quantum_usec > 0 ? (usec > 0 ? usec : 1) : 1;
+  oq->tick_cmds++;
+  oq->cmds++;
+  oq->usec += usec;
+}
+
+/*
+ * fair_tick - Start a new per-owner budget period
+ *
+ * Resets every owner's command count and drops sub-queues that have
+ * gone idle.
+ */
+static void fair_tick(void)
+{
+  struct owner_queue *oq, **link;
+  int h;
+
+  for (h = 0; h < OWNER_HASH_SIZE; h++) {
+    for (link = &owner_hash[h]; (oq = *link) != NULL;) {
+      oq->tick_cmds = 0;
+      if (!oq->active && !oq->heap.count) {
+        *link = oq->hnext;
+        if (oq->heap.v) {
+          SMART_FREE(oq->heap.v);
+        }
+        SMART_FREE(oq);
+      } else {
+        link = &oq->hnext;
+      }
+    }
+  }
+}
+
+/*
+ * slot_push / slot_unlink - Timer-wheel slot list maintenance
+ */
+static void slot_push(BQUE **slot, BQUE *e)
+{
+  e->next = *slot;
+  if (e->next) {
+    e->next->pprev = &e->next;
+  }
+  e->pprev = slot;
+  *slot = e;
+}
+
+static void slot_unlink(BQUE *e)
+{
+  *e->pprev = e->next;
+  if (e->next) {
+    e->next->pprev = e->pprev;
+  }
+  e->next = NULL;
+  e->pprev = NULL;
+}
+
+/*
+ * wheel_insert - File an entry by due time
+ *
+ * Entries already due go straight to the ready heap.  Otherwise the entry
+ * goes on the finest level whose span covers its distance from wheel_time,
+ * in the slot its due time maps to on that level.
+ */
+static void wheel_insert(BQUE *e)
+{
+  long due, delta;
+  int level;
+
+  /* Round up: an entry may run late by under a tick, never early */
+  due = (e->wait + WHEEL_TICK_MSEC - 1) / WHEEL_TICK_MSEC;
+  if (due <= wheel_time) {
+    ready_push(e);
+    return;
+  }
+
+  delta = due - wheel_time;
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    if (delta < (1L << (WHEEL_BITS * (level + 1)))) {
+      slot_push(&wheel[level][(due >> (WHEEL_BITS * level)) & WHEEL_MASK], e);
+      return;
+    }
+  }
+  slot_push(&wheel_far, e);
+}
+
+/*
+ * wheel_refile - Re-insert every entry on a slot against the current time
+ *
+ * The slot is detached first: an entry may legitimately land back on it.
+ */
+static void wheel_refile(BQUE **slot)
+{
+  BQUE *e = *slot, *next;
+
+  *slot = NULL;
+  for (; e; e = next) {
+    next = e->next;
+    e->next = NULL;
+    e->pprev = NULL;
+    wheel_insert(e);
+  }
+}
+
+/*
+ * wheel_advance - Move wheel_time up to 'to', readying what comes due
+ *
+ * Steps one tick at a time, cascading coarser slots down whenever the
+ * finer levels wrap.  A long gap (first call, or a stall of more than
+ * WHEEL_SIZE^2 ticks) is handled by refiling every waiting entry in one
+ * pass instead.
+ */
+static void wheel_advance(long to)
+{
+  int level, slot;
+
+  if (to <= wheel_time) {
+    return;
+  }
+
+  if (to - wheel_time > WHEEL_SIZE * WHEEL_SIZE) {
+    wheel_time = to;
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+      for (slot = 0; slot < WHEEL_SIZE; slot++) {
+        wheel_refile(&wheel[level][slot]);
+      }
+    }
+    wheel_refile(&wheel_far);
+    return;
+  }
+
+  while (wheel_time < to) {
+    wheel_time++;
+
+    for (level = 1; level <= WHEEL_LEVELS; level++) {
+      if (wheel_time & ((1L << (WHEEL_BITS * level)) - 1)) {
+        break;
+      }
+      if (level == WHEEL_LEVELS) {
+        wheel_refile(&wheel_far);
+      } else {
+        wheel_refile(&wheel[level][(wheel_time >> (WHEEL_BITS * level)) & WHEEL_MASK]);
+      }
+    }
+
+    wheel_refile(&wheel[0][wheel_time & WHEEL_MASK]);
+  }
+}
+
+/*
+ * queue_next - Best runnable entry, or NULL if nothing is due yet
+ */
+static BQUE *queue_next(void)
+{
+  wheel_advance(timer_msec() / WHEEL_TICK_MSEC);
+  if (fair_mode != (queue_fair ? 1 : 0)) {
+    ready_rebuild();
+  }
+  if (fair_mode) {
+    return fair_next();
+  }
+  return ready.count ? ready.v[0] : NULL;
+}
+
+/*
+ * queue_link - Schedule a freshly built entry
+ */
+static void queue_link(BQUE *e)
+{
+  e->seq = queue_seq++;
+  e->heap = -1;
+  e->oq = NULL;
+  e->next = NULL;
+  e->pprev = NULL;
+
+  e->all_next = qall;
+  if (qall) {
+    qall->all_pprev = &e->all_next;
+  }
+  e->all_pprev = &qall;
+  qall = e;
+  queue_count++;
+
+  if (e->pid >= 0 && e->pid < pid_space) {
+    by_pid[e->pid] = e;
+  }
+
+  wheel_advance(timer_msec() / WHEEL_TICK_MSEC);
+  wheel_insert(e);
+}
+
+/*
+ * queue_unlink - Take an entry off the heap or wheel and the entry list
+ *
+ * The PID stays mapped until queue_free() so a running command still
+ * answers to @halt <pid>.
+ */
+static void queue_unlink(BQUE *e)
+{
+  if (e->heap >= 0) {
+    ready_remove(e);
+  } else if (e->pprev) {
+    slot_unlink(e);
+  }
+
+  *e->all_pprev = e->all_next;
+  if (e->all_next) {
+    e->all_next->all_pprev = e->all_pprev;
+  }
+  e->all_next = NULL;
+  e->all_pprev = NULL;
+  queue_count--;
+}
+
+/*
+ * queue_free - Release an unlinked entry and its PID
+ */
+static void queue_free(BQUE *e)
+{
+  if (e->pid >= 0 && e->pid < pid_space && by_pid[e->pid] == e) {
+    by_pid[e->pid] = NULL;
+  }
+  free_pid(e->pid);
+
+  SMART_FREE(e);
 }
 
 /* ============================================================================
@@ -221,8 +884,8 @@ static int add_to(dbref player, int am)
  * 1. Validates player can execute commands (not HAVEN)
  * 2. Charges queue cost
  * 3. Checks for runaway objects (queue limit)
- * 4. Allocates queue entry
- * 5. Inserts into sorted queue based on priority and wait time
+ * 4. Allocates queue entry, command and env strings in one block
+ * 5. Schedules it on the ready heap, or the timer wheel if it must wait
  * 
  * SECURITY CRITICAL:
  * - Validates player with GoodObject()
@@ -230,10 +893,12 @@ static int add_to(dbref player, int am)
  * - Sets HAVEN on runaway objects to prevent further damage
  * - Tracks memory allocations
  */
-static void big_que(dbref player, char *command, dbref cause, int pri, time_t wait)
+static void big_que(dbref player, char *command, dbref cause, int pri, long wait)
 {
-  int a, set;
-  BQUE *tmp, *dah;
+  int a;
+  BQUE *tmp;
+  char *mem;
+  size_t cmd_len, size, env_len[10];
 
   /* Validate player */
   if (!GoodObject(player)) {
@@ -273,8 +938,16 @@ static void big_que(dbref player, char *command, dbref cause, int pri, time_t wa
     return;
   }
 
-  /* Allocate queue entry - string data follows structure */
-  SAFE_MALLOC(tmp, BQUE, sizeof(BQUE) + strlen(command) + 1);
+  /* One allocation: the entry, then the command, then the env strings */
+  cmd_len = strlen(command) + 1;
+  size = sizeof(BQUE) + cmd_len;
+  for (a = 0; a < 10; a++) {
+    env_len[a] = wptr[a] ? strlen(wptr[a]) + 1 : 0;
+    size += env_len[a];
+  }
+
+  SAFE_MALLOC(mem, char, size);
+  tmp = (BQUE *)mem;
 
   if (tmp == NULL) {
     add_to(player, -1); /* Rollback accounting */
@@ -290,116 +963,29 @@ static void big_que(dbref player, char *command, dbref cause, int pri, time_t wa
   }
 
   /* Initialize queue entry */
-  {
-    size_t cmd_len = strlen(command) + 1;
-    strncpy(Astr(tmp), command, cmd_len - 1);
-    Astr(tmp)[cmd_len - 1] = '\0';
-  }
+  mem = Astr(tmp);
+  memcpy(mem, command, cmd_len);
+  mem += cmd_len;
   tmp->player = player;
-  tmp->next = NULL;
-  tmp->prev = NULL;
+  tmp->owner = db[player].owner;
   tmp->cause = cause;
   tmp->pri = pri;
-  tmp->wait = now + wait;
+  tmp->wait = timer_msec() + wait;
   tmp->pid = get_pid();
 
   /* Copy environment variables */
   for (a = 0; a < 10; a++) {
-    if (!wptr[a]) {
+    if (!env_len[a]) {
       tmp->env[a] = NULL;
     } else {
-      char *p;
-      size_t env_len = strlen(wptr[a]) + 1;
-      
-      SAFE_MALLOC(p, char, env_len);
-      tmp->env[a] = p;
-      
-      if (p != NULL) {
-        strncpy(p, wptr[a], env_len);
-        p[env_len - 1] = '\0';
-      } else {
-        /* Out of memory - halt and cleanup */
-        do_halt_player(player, "");
-        log_io(tprintf("QUEUE: halted: %s (lack of memory).",
-                       GoodObject(player) ? unparse_object(db[player].owner, player) : "#-1"));
-        
-        /* Free already-allocated env vars */
-        for (int j = 0; j < a; j++) {
-          if (tmp->env[j]) {
-            SMART_FREE(tmp->env[j]);
-          }
-        }
-        SMART_FREE(tmp);
-        return;
-      }
+      tmp->env[a] = mem;
+      memcpy(mem, wptr[a], env_len[a]);
+      mem += env_len[a];
     }
   }
 
-  /* ===== Insert into sorted queue ===== */
-  
-  if (qfirst) {
-    BQUE *my_qlast = NULL; /* Track last processed node for repair */
-    int flag = 0;
-
-    for (dah = qfirst, set = 0; (flag != 1) && (set != 1); dah = dah->next) {
-      /* Queue consistency check and repair */
-      if ((dah != qfirst) && (!dah->prev)) {
-        log_error("QUEUE: Broken queue detected - repairing prev pointer");
-        if (my_qlast) {
-          dah->prev = my_qlast;
-        } else {
-          qfirst = dah;
-        }
-      }
-
-      /* Insert based on priority and wait time */
-      if ((tmp->pri < dah->pri) || 
-          ((tmp->pri == dah->pri) && (tmp->wait < dah->wait))) {
-        
-        if (dah == qfirst) {
-          /* Insert at head */
-          tmp->next = qfirst;
-          qfirst->prev = tmp;
-          qfirst = tmp;
-          set = 1;
-        } else {
-          /* Insert in middle */
-          if (dah->prev) {
-            dah->prev->next = tmp;
-            tmp->prev = dah->prev;
-          }
-          tmp->next = dah;
-          dah->prev = tmp;
-          set = 1;
-        }
-      }
-
-      /* End of queue - append */
-      if (dah->next == NULL && set == 0) {
-        dah->next = tmp;
-        tmp->prev = dah;
-        qlast = tmp;
-        set = 1;
-      }
-      
-      my_qlast = dah;
-    }
-
-    /* Fallback - append to end if not inserted */
-    if (set == 0) {
-      if (qlast) {
-        tmp->prev = qlast;
-        qlast->next = tmp;
-        qlast = tmp;
-      } else {
-        /* Queue was broken - reset */
-        qfirst = qlast = tmp;
-      }
-    }
-  } else {
-    /* Empty queue - first entry */
-    qlast = qfirst = tmp;
-  }
+  /* Runnable now goes on the heap, @wait onto the timer wheel */
+  queue_link(tmp);
 
   /* Process high-priority commands immediately */
   do_jobs(-20);
@@ -418,35 +1004,156 @@ static void big_que(dbref player, char *command, dbref cause, int pri, time_t wa
  */
 void do_jobs(int pri)
 {
-  while (qfirst && (qfirst->pri <= pri) && do_top());
+  BQUE *top;
+
+  while ((top = queue_next()) && (top->pri <= pri) && do_top());
 }
 
 /*
  * test_top - Check if queue has entries ready to execute
  * 
- * Returns 1 if queue is not empty, 0 otherwise
+ * Returns 1 if a command is runnable now, 0 otherwise.  The server
+ * polls select() while this is true so ready work never sits idle.
  */
 int test_top(void)
 {
-  return (qfirst ? 1 : 0);
+  return (queue_next() ? 1 : 0);
+}
+
+/*
+ * test_wait - Check if queue holds any entries at all
+ * 
+ * Returns 1 if anything is queued, runnable or still waiting.
+ */
+int test_wait(void)
+{
+  return (queue_count ? 1 : 0);
+}
+
+/*
+ * queue_next_wake - When the timer wheel next needs to turn
+ * 
+ * Returns the monotonic msec at which the earliest waiting entry comes
+ * due, or at which a coarser wheel slot cascades (the entries it holds
+ * are refiled then and the caller asks again), or -1 if nothing waits.
+ * Runnable entries are not counted; test_top() covers those.
+ */
+long queue_next_wake(void)
+{
+  long best = -1, tick, base;
+  int level, k, shift;
+
+  if (!queue_count) {
+    return -1;
+  }
+  wheel_advance(timer_msec() / WHEEL_TICK_MSEC);
+
+  /* Level 0 slots map straight to their tick */
+  for (k = 1; k < WHEEL_SIZE; k++) {
+    if (wheel[0][(wheel_time + k) & WHEEL_MASK]) {
+      best = wheel_time + k;
+      break;
+    }
+  }
+
+  /* Coarser levels come due when wheel_time reaches their slot */
+  for (level = 1; level < WHEEL_LEVELS; level++) {
+    shift = WHEEL_BITS * level;
+    base = wheel_time >> shift;
+    for (k = 1; k <= WHEEL_SIZE; k++) {
+      if (wheel[level][(base + k) & WHEEL_MASK]) {
+        tick = (base + k) << shift;
+        if (best < 0 || tick < best) {
+          best = tick;
+        }
+        break;
+      }
+    }
+  }
+
+  if (wheel_far) {
+    shift = WHEEL_BITS * WHEEL_LEVELS;
+    tick = ((wheel_time >> shift) + 1) << shift;
+    if (best < 0 || tick < best) {
+      best = tick;
+    }
+  }
+
+  return best < 0 ? -1 : best * WHEEL_TICK_MSEC;
+}
+
+/*
+ * queue_run - Drain runnable commands within the time budget
+ * 
+ * Runs ready commands back to back until none are left or
+ * queue_budget_msec of wall-clock time has been used, whichever comes
+ * first.  A budget of zero or less runs a single command per pass.
+ * Passes that run anything update the queue_pass_* statistics shown
+ * by @cmdav.
+ * 
+ * Returns: number of commands executed
+ */
+int queue_run(void)
+{
+  struct timeval start, end;
+  long budget = (long)queue_budget_msec * 1000L;
+  long used;
+  int ran = 0;
+
+  if (!queue_next()) {
+    return 0;
+  }
+
+  gettimeofday(&start, NULL);
+  for (;;) {
+    if (!do_top()) {
+      break;
+    }
+    ran++;
+    clear_stack();
+
+    gettimeofday(&end, NULL);
+    used = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_usec - start.tv_usec);
+    if (used >= budget) {
+      if (queue_next()) {
+        queue_budget_hits++;
+      }
+      break;
+    }
+  }
+
+  gettimeofday(&end, NULL);
+  queue_passes++;
+  queue_pass_cmds = ran;
+  queue_pass_usec = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_usec - start.tv_usec);
+  if (ran > queue_pass_peak) {
+    queue_pass_peak = ran;
+  }
+
+  return ran;
 }
 
 /*
  * do_second - Called every second to process time-based queue entries
  * 
- * Executes one command from the queue
+ * Starts a new per-owner budget period for fair queuing.  The main
+ * loop drains the queue every iteration; this per-tick pass only
+ * catches anything that came due in between.
  */
 void do_second(void)
 {
-  do_top();
+  fair_tick();
+  queue_run();
   return;
 }
 
 /*
  * do_top - Execute one command from the queue
  * 
- * Finds first command ready to execute (wait time passed),
- * executes it, and removes it from queue.
+ * Takes the best runnable command (lowest priority, then earliest
+ * due time, then first queued) off the ready heap and executes it.
+ * Under fair queuing the round robin picks the owner first and the
+ * command's run time is charged to that owner.
  * 
  * SECURITY:
  * - Validates player with valid_player()
@@ -459,19 +1166,23 @@ void do_second(void)
  */
 int do_top(void)
 {
-  int b = 0;
   BQUE *tmp;
   dbref player;
+  struct owner_queue *oq;
+  struct timeval start, end;
 
-  tmp = qfirst;
-
-  /* Find first command ready to execute */
-  while ((tmp) && (tmp->wait > now)) {
-    tmp = tmp->next;
+  if (!(tmp = queue_next())) {
+    return 0;
   }
 
-  if (!tmp) {
-    return 0;
+  /* Unlink before running: the command may queue or halt other entries */
+  oq = tmp->oq;
+  if (oq) {
+    fair_take();
+  }
+  queue_unlink(tmp);
+  if (oq) {
+    gettimeofday(&start, NULL);
   }
 
   /* Validate player and execute command */
@@ -509,53 +1220,12 @@ int do_top(void)
     }
   }
 
-  /* ===== Remove from queue ===== */
-
-  if ((tmp == qfirst) && (tmp == qlast)) {
-    /* Only entry in queue */
-    qfirst = qlast = NULL;
-  } else {
-    if (tmp == qfirst) {
-      /* Remove from head */
-      qfirst = qfirst->next;
-      if (qfirst) {
-        qfirst->prev = NULL;
-      }
-      tmp->next = NULL;
-    } else if (tmp == qlast) {
-      /* Remove from tail */
-      qlast = qlast->prev;
-      tmp->prev = NULL;
-      if (qlast) {
-        qlast->next = NULL;
-      }
-    } else {
-      /* Remove from middle */
-      if (tmp->prev) {
-        tmp->prev->next = tmp->next;
-      }
-      if (tmp->next) {
-        tmp->next->prev = tmp->prev;
-      }
-      tmp->next = tmp->prev = NULL;
-    }
-  }
-
-  /* Free resources */
-  free_pid(tmp->pid);
+  queue_free(tmp);
 
-  for (b = 0; b < 10; b++) {
-    if (tmp->env[b]) {
-      SMART_FREE(tmp->env[b]);
-      tmp->env[b] = NULL;
-    }
-  }
-  
-  SMART_FREE(tmp);
-
-  /* Consistency check */
-  if (qfirst == NULL) {
-    qlast = NULL;
+  if (oq) {
+    gettimeofday(&end, NULL);
+    fair_charge(oq, (end.tv_sec - start.tv_sec) * 1000000L +
+                    (end.tv_usec - start.tv_usec));
   }
 
   return 1;
@@ -572,11 +1242,11 @@ int do_top(void)
  * 
  * PARAMETERS:
  *   player - Object executing command
- *   wait - Seconds to wait before execution
+ *   wait - Milliseconds to wait before execution
  *   command - Command string to execute
  *   cause - Object that caused this command
  */
-void wait_que(dbref player, int wait, char *command, dbref cause)
+void wait_que(dbref player, long wait, char *command, dbref cause)
 {
   int pri;
   char *p;
@@ -609,32 +1279,71 @@ void wait_que(dbref player, int wait, char *command, dbref cause)
   big_que(player, command, cause, pri, wait);
 }
 
+/* ============================================================================
+ * QUEUE DISPLAY
+ * ============================================================================ */
+
 /*
- * find_wait - Find first entry in queue with future wait time
- * 
- * Used by old queue display code (now deprecated)
+ * queue_order - qsort comparator giving @ps its run order
  */
-static BQUE *find_wait(BQUE *queue)
+static int queue_order(const void *a, const void *b)
 {
-  BQUE *tmp;
+  BQUE *x = *(BQUE * const *)a;
+  BQUE *y = *(BQUE * const *)b;
 
-  for (tmp = queue; tmp != NULL; tmp = tmp->next) {
-    if (now < tmp->wait) {
-      break;
+  if (entry_before(x, y)) {
+    return -1;
+  }
+  return entry_before(y, x) ? 1 : 0;
+}
+
+/*
+ * queue_shares - Show fair-queuing state for each visible owner
+ *
+ * Ready is the owner's runnable backlog, Tick the commands it has run
+ * this second, Credit its remaining round-robin credit, and Share its
+ * slice of the run time of the owners listed.
+ */
+static void queue_shares(dbref player, int can_see)
+{
+  struct owner_queue *oq;
+  long total = 0;
+  int h;
+  char name[30];
+
+  for (h = 0; h < OWNER_HASH_SIZE; h++) {
+    for (oq = owner_hash[h]; oq; oq = oq->hnext) {
+      if (oq->owner == db[player].owner || can_see) {
+        total += oq->usec;
+      }
     }
   }
 
-  return tmp;
-}
+  notify(player, tprintf("Fair queuing: quantum %d usec, %d cmds/sec per owner",
+                         queue_quantum_usec, queue_owner_cmds));
+  notify(player, "Owner                  Ready  Tick  Credit   Cmds   CPU ms Share");
 
-/* ============================================================================
- * QUEUE DISPLAY
- * ============================================================================ */
+  for (h = 0; h < OWNER_HASH_SIZE; h++) {
+    for (oq = owner_hash[h]; oq; oq = oq->hnext) {
+      if (oq->owner != db[player].owner && !can_see) {
+        continue;
+      }
+
+      snprintf(name, sizeof(name), "#%" DBREF_FMT " %s", oq->owner,
+               GoodObject(oq->owner) ? db[oq->owner].name : "INVALID");
+      notify(player, tprintf("%-22.22s %5d %5d %7ld %6lu %8ld %4ld%%",
+                             name, oq->heap.count, oq->tick_cmds,
+                             oq->deficit, oq->cmds, oq->usec / 1000,
+                             total ? (oq->usec * 100) / total : 0L));
+    }
+  }
+}
 
 /*
  * do_queue - Display queue contents
  * 
- * Shows all queued commands visible to player.
+ * Shows all queued commands visible to player, in the order they will
+ * run: priority, then due time, then queueing order.
  * Players see their own commands.
  * Players with POW_QUEUE see all commands.
  * 
@@ -642,41 +1351,62 @@ static BQUE *find_wait(BQUE *queue)
  */
 void do_queue(dbref player)
 {
-  BQUE *tmp;
+  BQUE *tmp, **list;
   int can_see = power(player, POW_QUEUE);
+  int n = 0, i;
+  long left, t = timer_msec();
   char mytmp[30];
 
   if (!GoodObject(player)) {
     return;
   }
 
-  if (qfirst) {
-    notify(player, "PID   Player               Pr Wait  Command");
-    
-    for (tmp = qfirst; tmp != NULL; tmp = tmp->next) {
-      if (!GoodObject(tmp->player)) {
-        continue;
-      }
-      
-      if ((db[tmp->player].owner == db[player].owner) || can_see) {
-        /* Format player name with truncation */
-        snprintf(mytmp, sizeof(mytmp), "[#%" DBREF_FMT " %-20.20s",
-                 tmp->player,
-                 GoodObject(tmp->player) ? db[tmp->player].name : "INVALID");
-        mytmp[sizeof(mytmp) - 1] = '\0';
-        
-        if (strlen(mytmp) > 18) {
-          mytmp[19] = '\0';
-        }
-        strncat(mytmp, "]", sizeof(mytmp) - strlen(mytmp) - 1);
-        
-        notify(player, tprintf("%5d %s %2d %5ld %s", 
-                               tmp->pid, mytmp, tmp->pri, 
-                               (long)(tmp->wait - now), Astr(tmp)));
-      }
-    }
-  } else {
+  if (!queue_count) {
     notify(player, "@ps: No processes in the queue at this time.");
+    return;
+  }
+
+  SAFE_MALLOC(list, BQUE *, (size_t)queue_count);
+  for (tmp = qall; tmp != NULL; tmp = tmp->all_next) {
+    if (!GoodObject(tmp->player)) {
+      continue;
+    }
+    if ((db[tmp->player].owner == db[player].owner) || can_see) {
+      list[n++] = tmp;
+    }
+  }
+  qsort(list, (size_t)n, sizeof(BQUE *), queue_order);
+
+  notify(player, "PID   Player               Pr Wait  Command");
+
+  for (i = 0; i < n; i++) {
+    tmp = list[i];
+
+    /* Format player name with truncation */
+    snprintf(mytmp, sizeof(mytmp), "[#%" DBREF_FMT " %-20.20s",
+             tmp->player, db[tmp->player].name);
+    mytmp[sizeof(mytmp) - 1] = '\0';
+
+    if (strlen(mytmp) > 18) {
+      mytmp[19] = '\0';
+    }
+    strncat(mytmp, "]", sizeof(mytmp) - strlen(mytmp) - 1);
+
+    /* Whole seconds still to wait, rounded up */
+    left = tmp->wait - t;
+    if (left > 0) {
+      left += 999;
+    }
+
+    notify(player, tprintf("%5d %s %2d %5ld %s", 
+                           tmp->pid, mytmp, tmp->pri, 
+                           left / 1000, Astr(tmp)));
+  }
+
+  SMART_FREE(list);
+
+  if (fair_mode) {
+    queue_shares(player, can_see);
   }
 }
 
@@ -734,8 +1464,7 @@ void do_halt(dbref player, char *arg1, char *arg2)
  */
 void do_haltall(dbref player)
 {
-  BQUE *i, *next;
-  int a;
+  BQUE *i;
 
   if (!GoodObject(player)) {
     return;
@@ -750,37 +1479,18 @@ void do_haltall(dbref player)
     return;
   }
 
-  if (!qlast || !qfirst) {
-    qfirst = qlast = NULL;
-    log_error("broken queue detected during haltall");
-    return;
-  }
-
   /* Free all queue entries */
-  while (qfirst) {
-    next = qfirst->next;
-    i = qfirst;
-    
-    /* Free environment variables */
-    for (a = 0; a < 10; a++) {
-      if (qfirst->env[a]) {
-        SMART_FREE(qfirst->env[a]);
-        qfirst->env[a] = NULL;
-      }
-    }
-    
+  while ((i = qall) != NULL) {
+    queue_unlink(i);
+
     /* Refund queue cost */
-    if (GoodObject(qfirst->player)) {
-      giveto(qfirst->player, queue_cost);
+    if (GoodObject(i->player)) {
+      giveto(i->player, queue_cost);
     }
-    
-    free_pid(qfirst->pid);
-    qfirst = next;
-    SMART_FREE(i);
+
+    queue_free(i);
   }
 
-  qfirst = NULL;
-  qlast = NULL;
   notify(player, "@halt: Everything halted.");
 }
 
@@ -799,64 +1509,27 @@ void do_halt_process(dbref player, int pid)
     return;
   }
 
-  for (point = qfirst; point; point = point->next) {
-    if (point->pid == pid) {
-      if (!GoodObject(point->player)) {
-        notify(player, "@halt: Invalid process (bad player reference).");
-        return;
-      }
+  point = (pid >= 0 && pid < pid_space) ? by_pid[pid] : NULL;
+  if (!point) {
+    notify(player, "@halt: Sorry. That process ID wasn't found.");
+    return;
+  }
 
-      /* Check permissions */
-      if ((point->player == player) || 
-          (real_owner(point->player) == real_owner(player)) || 
-          (power(player, POW_SECURITY))) {
-        
-        int a;
-
-        /* Remove from queue */
-        if (point == qfirst) {
-          qfirst = point->next;
-          if (qfirst == NULL) {
-            qlast = NULL;
-          } else {
-            qfirst->prev = NULL;
-          }
-        } else if (point == qlast) {
-          qlast = qlast->prev;
-          if (qlast) {
-            qlast->next = NULL;
-          }
-        } else {
-          if (point->next) {
-            point->next->prev = point->prev;
-          }
-          if (point->prev) {
-            point->prev->next = point->next;
-          }
-        }
+  if (!GoodObject(point->player)) {
+    notify(player, "@halt: Invalid process (bad player reference).");
+    return;
+  }
 
-        /* Free resources */
-        for (a = 0; a < 10; a++) {
-          if (point->env[a]) {
-            SMART_FREE(point->env[a]);
-            point->env[a] = NULL;
-          }
-        }
-        
-        point->player = NOTHING;
-        free_pid(point->pid);
-        SMART_FREE(point);
-        
-        notify(player, tprintf("@halt: Terminated process %d", pid));
-        return;
-      } else {
-        notify(player, "@halt: Sorry. You don't control that process.");
-        return;
-      }
-    }
+  /* Check permissions */
+  if ((point->player == player) || 
+      (real_owner(point->player) == real_owner(player)) || 
+      (power(player, POW_SECURITY))) {
+    queue_unlink(point);
+    queue_free(point);
+    notify(player, tprintf("@halt: Terminated process %d", pid));
+  } else {
+    notify(player, "@halt: Sorry. You don't control that process.");
   }
-  
-  notify(player, "@halt: Sorry. That process ID wasn't found.");
 }
 
 /*
@@ -871,7 +1544,7 @@ void do_halt_process(dbref player, int pid)
  */
 void do_halt_player(dbref player, char *ncom)
 {
-  BQUE *trail = NULL, *point, *next;
+  BQUE *point, *next;
   int num = 0;
 
   if (!GoodObject(player)) {
@@ -889,62 +1562,27 @@ void do_halt_player(dbref player, char *ncom)
   }
 
   /* Remove matching entries from queue */
-  for (point = qfirst; point; point = next) {
+  for (point = qall; point; point = next) {
+    next = point->all_next;
+
     if (!GoodObject(point->player)) {
-      next = point->next;
       continue;
     }
 
     if ((point->player == player) || (real_owner(point->player) == player)) {
-      int a;
-
       num--;
-      
+
       /* Refund cost */
       giveto(point->player, queue_cost);
-      next = point->next;
-
-      /* Remove from queue */
-      if (point == qfirst) {
-        qfirst = point->next;
-        if (qfirst == NULL) {
-          qlast = NULL;
-        } else {
-          qfirst->prev = NULL;
-        }
-      } else if (point == qlast) {
-        qlast = qlast->prev;
-        if (qlast) {
-          qlast->next = NULL;
-        }
-      } else {
-        if (point->next) {
-          point->next->prev = point->prev;
-        }
-        if (point->prev) {
-          point->prev->next = point->next;
-        }
-      }
 
-      /* Free resources */
-      for (a = 0; a < 10; a++) {
-        if (point->env[a]) {
-          SMART_FREE(point->env[a]);
-          point->env[a] = NULL;
-        }
-      }
-      
-      point->player = NOTHING;
-      free_pid(point->pid);
-      SMART_FREE(point);
-    } else {
-      next = (trail = point)->next;
+      queue_unlink(point);
+      queue_free(point);
     }
   }
 
   /* Update queue accounting */
   if (db[player].owner == player) {
-    atr_add(player, A_QUEUE, "");
+    db[player].queue = 0;
   } else {
     add_to(player, num);
   }
@@ -960,7 +1598,56 @@ void do_halt_player(dbref player, char *ncom)
  * ============================================================================
  */
 
-static char pid_list[32768]; /* Bitmap of allocated PIDs */
+/*
+ * PIDs come from a bitmap, one bit per PID, scanned a word at a time
+ * with count-trailing-zeros.  Allocation resumes just past the last PID
+ * handed out, so a freed PID is not reused until the space wraps.  The
+ * space is max_pids (default 32768) and grows, never shrinks, when that
+ * is raised at runtime.
+ */
+
+#define PID_WORD_BITS ((int)(sizeof(unsigned long) * 8))
+
+static unsigned long *pid_bits = NULL; /* Allocated-PID bitmap */
+static int pid_next = 0;               /* Where the next search starts */
+
+/*
+ * pid_space_sync - Grow the PID bitmap and PID table to max_pids
+ */
+static void pid_space_sync(void)
+{
+  int want = max_pids > 0 ? max_pids : DEFAULT_PIDS;
+  int words, old_words;
+  unsigned long *bits;
+  BQUE **table;
+
+  if (want > MAX_PID_SPACE) {
+    want = MAX_PID_SPACE;
+  }
+  want = (want + PID_WORD_BITS - 1) / PID_WORD_BITS * PID_WORD_BITS;
+  if (want <= pid_space) {
+    return;
+  }
+
+  words = want / PID_WORD_BITS;
+  old_words = pid_space / PID_WORD_BITS;
+
+  SAFE_MALLOC(bits, unsigned long, (size_t)words);
+  SAFE_MALLOC(table, BQUE *, (size_t)want);
+  memset(bits, 0, sizeof(unsigned long) * (size_t)words);
+  memset(table, 0, sizeof(BQUE *) * (size_t)want);
+
+  if (pid_bits) {
+    memcpy(bits, pid_bits, sizeof(unsigned long) * (size_t)old_words);
+    memcpy(table, by_pid, sizeof(BQUE *) * (size_t)pid_space);
+    SMART_FREE(pid_bits);
+    SMART_FREE(by_pid);
+  }
+
+  pid_bits = bits;
+  by_pid = table;
+  pid_space = want;
+}
 
 /*
  * init_pid - Initialize PID allocation system
@@ -969,61 +1656,57 @@ static char pid_list[32768]; /* Bitmap of allocated PIDs */
  */
 void init_pid(void)
 {
-  int x;
-
-  for (x = 0; x < 32768; x++) {
-    pid_list[x] = '\0';
-  }
-  return;
+  pid_space_sync();
+  memset(pid_bits, 0, sizeof(unsigned long) * (size_t)(pid_space / PID_WORD_BITS));
+  pid_next = 0;
 }
 
 /*
  * get_pid - Allocate a new PID
  * 
- * Returns: PID number (0-32767) or -1 if none available
- * 
- * ALGORITHM: Simple linear search for first '\0' byte
+ * Returns: lowest free PID at or after the last one handed out,
+ * wrapping around, or -1 if none available
  */
 int get_pid(void)
 {
-  static char *p = NULL; /* Next PID to try */
+  int words, w, n;
+  unsigned long word;
 
-  if (p == NULL) {
-    init_pid();
-    p = pid_list;
+  pid_space_sync();
+  if (pid_next >= pid_space) {
+    pid_next = 0;
   }
 
-  /* Find next free PID */
-  while (*p != '\0') {
-    p++;
-    
-    /* Wrap around if needed */
-    if ((p - pid_list) >= 32768) {
-      p = pid_list;
-      
-      /* Check if we wrapped back to start with no free PIDs */
-      if (*p != '\0') {
-        log_error("OUT OF PIDS! Critical queue error.");
-        return -1;
-      }
+  words = pid_space / PID_WORD_BITS;
+  w = pid_next / PID_WORD_BITS;
+
+  /* Bits below pid_next in the first word count as taken on this pass */
+  word = pid_bits[w] | ((1UL << (pid_next % PID_WORD_BITS)) - 1);
+
+  for (n = 0; n <= words; n++) {
+    if (~word) {
+      int pid = w * PID_WORD_BITS + __builtin_ctzl(~word);
+
+      pid_bits[w] |= 1UL << (pid % PID_WORD_BITS);
+      pid_next = pid + 1;
+      return pid;
+    }
+    if (++w == words) {
+      w = 0;
     }
+    word = pid_bits[w];
   }
 
-  /* Mark as allocated */
-  *p = ' ';
-  
-  return (p - pid_list);
+  log_error("OUT OF PIDS! Critical queue error.");
+  return -1;
 }
 
 /*
  * free_pid - Free a PID for reuse
- * 
- * PARAMETERS:
- *   pid - PID to free (0-32767)
  */
 void free_pid(int pid)
 {
-  if (pid >= 0 && pid < 32768) {
-    pid_list[pid] = '\0';
+  if (pid >= 0 && pid < pid_space) {
+    pid_bits[pid / PID_WORD_BITS] &= ~(1UL << (pid % PID_WORD_BITS));
   }
 }
@@ -817,7 +817,7 @@ void do_editfile(dbref player, char *fname)
   }
 
   /* Find player's descriptor */
-  for (dsc = descriptor_list; dsc && (dsc->state != CONNECTED || dsc->player != player); dsc = dsc->next);
+  dsc = player_descriptors(player);
   
   if (dsc == NULL) {
     notify(player, "But you don't seem to be connected!");
@@ -107,6 +107,9 @@ int unsafe = 0;
 static int atr_match(dbref thing, dbref player, int type, char *str);
 static void no_dbdump(void);
 static int list_check(dbref thing, dbref player, int type, char *str);
+static struct cmd_index *cmd_index_get(dbref thing);
+static int cmd_index_listener(dbref thing);
+static int room_hearer(dbref thing);
 static void notify_internal(dbref player, const char *msg, int color);
 static void snotify(dbref player, char *msg);
 static void notify_except(dbref first, dbref exception, char *msg);
@@ -294,8 +297,8 @@ static void notify_nopup(dbref player, char *msg)
     return;
   }
   
-  /* Check if this is a puppet (not self-owned) */
-  if (db[player].owner != player) {
+  /* Check if this is a puppet (not self-owned) that listens at all */
+  if ((db[player].owner != player) && cmd_index_listener(player)) {
     /* Safe string copy with explicit size limit */
     strncpy(buff, msg, sizeof(buff) - 1);
     buff[sizeof(buff) - 1] = '\0';
@@ -342,6 +345,8 @@ void notify_all(char *arg, dbref exception, int nowall)
 {
   struct descriptor_data *d;
   char *buf;
+  char *shared[RENDER_CLASSES];
+  int cls;
   
   /* Prevent NULL pointer dereference */
   if (!arg) {
@@ -354,6 +359,8 @@ void notify_all(char *arg, dbref exception, int nowall)
     return;
   }
 
+  memset(shared, 0, sizeof(shared));
+
   /* Iterate through all connected descriptors */
   for (d = descriptor_list; d; d = d->next) {
     /* Skip non-connected descriptors */
@@ -371,20 +378,15 @@ void notify_all(char *arg, dbref exception, int nowall)
       continue;
     }
     
-    /* Handle color output based on player preferences */
-    if (db[d->player].flags & PLAYER_NOBEEP) {
-      if (db[d->player].flags & PLAYER_ANSI) {
-        queue_string(d, parse_color_nobeep(buf, d->pueblo));
-      } else {
-        queue_string(d, strip_color_nobeep(buf));
-      }
+    /* Everyone of the same class gets the same rendering */
+    cls = notify_class(d->player, d->pueblo);
+    if (shared[cls]) {
+      render_cache_hits++;
     } else {
-      if (db[d->player].flags & PLAYER_ANSI) {
-        queue_string(d, parse_color(buf, d->pueblo));
-      } else {
-        queue_string(d, strip_color(buf));
-      }
+      shared[cls] = color_string(buf, color_mode(d->player, d->pueblo));
+      render_cache_misses++;
     }
+    queue_string(d, shared[cls]);
   }
 }
 
@@ -448,9 +450,9 @@ static void notify_internal(dbref player, const char *msg, int color)
     raw_notify_noc(player, (char *)msg);
   }
   
-  /* Handle puppet echo to owner */
+  /* Handle puppet echo to owner (only worth formatting if they're on) */
   if ((db[player].flags & PUPPET) && (db[player].owner != player)) {
-    if (GoodObject(db[player].owner)) {
+    if (GoodObject(db[player].owner) && player_descriptors(db[player].owner)) {
       snprintf(buff, sizeof(buff), "%s> %s", db[player].name, msg);
       
       if (color) {
@@ -490,6 +492,29 @@ static void snotify(dbref player, char *msg)
   }
 }
 
+/**
+ * room_hearer - Can a message to thing, as room contents, have any effect?
+ *
+ * Players receive it, PUPPETs echo it to their owner, the @as target is
+ * redirected, and objects with LISTEN or ! patterns react to it.  Anything
+ * else would only pay for formatting and pattern matching that cannot
+ * produce output, so room-wide notifications skip it.  The listener bit
+ * comes from the object's command index, so this is O(1) once built.
+ *
+ * @param thing The object to test
+ * @return 1 if thing should be notified, 0 if it cannot hear
+ */
+static int room_hearer(dbref thing)
+{
+  extern dbref as_from;
+
+  if ((Typeof(thing) == TYPE_PLAYER) || (db[thing].flags & PUPPET) ||
+      (thing == as_from)) {
+    return 1;
+  }
+  return cmd_index_listener(thing);
+}
+
 /**
  * notify_except - Notify all in a list except one object
  * 
@@ -504,7 +529,7 @@ static void notify_except(dbref first, dbref exception, char *msg)
   }
   
   DOLIST(first, first) {
-    if (first != exception && GoodObject(first)) {
+    if (first != exception && GoodObject(first) && room_hearer(first)) {
       snotify(first, msg);
     }
   }
@@ -526,7 +551,8 @@ static void notify_except2(dbref first, dbref exception1,
   }
   
   DOLIST(first, first) {
-    if ((first != exception1) && (first != exception2) && GoodObject(first)) {
+    if ((first != exception1) && (first != exception2) &&
+        GoodObject(first) && room_hearer(first)) {
       snotify(first, msg);
     }
   }
@@ -546,8 +572,12 @@ static void notify_except2(dbref first, dbref exception1,
  */
 void notify_in(dbref room, dbref exception, char *msg)
 {
+  struct render_cache rc;
   dbref z;
 
+  /* Everyone here hears the same text; render it once per class */
+  render_begin(&rc, msg, 1);
+
   /* Notify zone objects */
   DOZONE(z, room) {
     if (GoodObject(z)) {
@@ -555,12 +585,9 @@ void notify_in(dbref room, dbref exception, char *msg)
     }
   }
   
-  if (room == NOTHING) {
-    return;
-  }
-  
   /* Validate room object */
-  if (!GoodObject(room)) {
+  if (room == NOTHING || !GoodObject(room)) {
+    render_end(&rc);
     return;
   }
   
@@ -572,6 +599,8 @@ void notify_in(dbref room, dbref exception, char *msg)
   /* Notify contents and exits */
   notify_except(db[room].contents, exception, msg);
   notify_except(db[room].exits, exception, msg);
+
+  render_end(&rc);
 }
 
 /**
@@ -584,8 +613,12 @@ void notify_in(dbref room, dbref exception, char *msg)
  */
 void notify_in2(dbref room, dbref exception1, dbref exception2, char *msg)
 {
+  struct render_cache rc;
   dbref z;
 
+  /* Everyone here hears the same text; render it once per class */
+  render_begin(&rc, msg, 1);
+
   /* Notify zone objects */
   DOZONE(z, room) {
     if (GoodObject(z)) {
@@ -593,12 +626,9 @@ void notify_in2(dbref room, dbref exception1, dbref exception2, char *msg)
     }
   }
   
-  if (room == NOTHING) {
-    return;
-  }
-  
   /* Validate room object */
-  if (!GoodObject(room)) {
+  if (room == NOTHING || !GoodObject(room)) {
+    render_end(&rc);
     return;
   }
   
@@ -610,6 +640,8 @@ void notify_in2(dbref room, dbref exception1, dbref exception2, char *msg)
   /* Notify contents and exits */
   notify_except2(db[room].contents, exception1, exception2, msg);
   notify_except2(db[room].exits, exception1, exception2, msg);
+
+  render_end(&rc);
 }
 
 /* ============================================================================
@@ -1647,6 +1679,237 @@ void process_command(dbref player, char *command, dbref cause)
  * See zones.h for declarations
  * ============================================================================ */
 
+/* ============================================================================
+ * COMMAND PATTERN INDEX
+ * ============================================================================
+ * Every $command, !listen and ^incoming pattern an object can see (its own
+ * attributes plus inherited ones) is split once into pattern, optional
+ * /lock/ and action, and kept in a single allocation hung off the object.
+ * atr_match() then walks that array instead of rebuilding all_attributes()
+ * and re-parsing every value on every command typed in the room.
+ *
+ * The index is stamped with db[].cmd_gen.  db_io.c bumps that on the
+ * object and its descendants whenever a pattern value changes or an
+ * attribute appears or disappears (atr_commands_changed()), or its
+ * parents change (atr_inherit_changed()), so a stale index is simply
+ * rebuilt on next use.
+ *
+ * Matching may run softcode (locks, U-fail messages) that edits the very
+ * object being matched, so an index in use is pinned; if it is replaced
+ * meanwhile it is freed when the last user lets go.
+ */
+
+#define CMD_HAVEN 0x01          /* Attribute is AF_HAVEN: match stops here */
+
+struct cmd_entry {
+  char type;                    /* '$', '!' or '^' */
+  char lead;                    /* Upper-cased literal first char, or 0 */
+  unsigned char flags;          /* CMD_* bits */
+  char *pattern;                /* Wildcard pattern (after the type char) */
+  struct wild_prog *prog;       /* pattern, compiled */
+  char *lock;                   /* /lock/ text, or NULL */
+  char *action;                 /* Text to queue on a match */
+};
+
+struct cmd_index {
+  unsigned int gen;             /* db[].cmd_gen this was built against */
+  unsigned int busy;            /* atr_match() calls using it */
+  int orphaned;                 /* Replaced while busy: free on release */
+  int commer;                   /* Any $ value (see Commer()) */
+  int listener;                 /* Listen or ! on a non-lock attribute */
+  size_t count;                 /* Entries in ent[] */
+  struct cmd_entry ent[];       /* Followed by the copied strings */
+};
+
+unsigned long cmd_index_builds = 0;
+
+/**
+ * cmd_entry_parse - Split a copied "Xpattern:[/lock/]action" value in place
+ *
+ * Same parse atr_match() always did, except an unterminated [ in the lock
+ * no longer runs off the end of the string.
+ *
+ * @return 1 if the value is a usable pattern, 0 otherwise
+ */
+static int cmd_entry_parse(struct cmd_entry *e, char *buff)
+{
+  char *s, *p;
+
+  for (s = buff + 1; *s && (*s != ':'); s++);
+  if (!*s) {
+    return 0;
+  }
+  *s++ = '\0';
+
+  e->lock = NULL;
+  if (*s == '/') {
+    p = ++s;
+    while (*s && (*s != '/')) {
+      if (*s == '[') {
+        while (*s && (*s != ']')) s++;
+        if (!*s) break;
+      }
+      s++;
+    }
+    if (!*s) {
+      return 0;
+    }
+    *s++ = '\0';
+    e->lock = p;
+  }
+
+  e->type = buff[0];
+  e->pattern = buff + 1;
+  e->action = s;
+
+  /* wild_match() compares literals case-insensitively; > and < are
+   * comparisons and ? also matches end of string, so those get no lead. */
+  switch (*e->pattern) {
+    case '*': case '?': case '>': case '<': case '\0':
+      e->lead = 0;
+      break;
+    default:
+      e->lead = to_upper(*e->pattern);
+      break;
+  }
+  return 1;
+}
+
+/**
+ * cmd_index_build - Compile thing's visible pattern attributes
+ *
+ * Entries keep all_attributes() order, which decides which HAVEN
+ * attribute or action wins when several patterns match.
+ */
+static struct cmd_index *cmd_index_build(dbref thing)
+{
+  struct all_atr_list *list, *ptr;
+  struct cmd_index *ci;
+  size_t nent = 0, nbytes = 0, len;
+  char *temp, *strings;
+
+  list = all_attributes(thing);
+  for (ptr = list; ptr; ptr = ptr->next) {
+    if (ptr->type && !(ptr->type->flags & AF_LOCK) &&
+        (*ptr->value == '$' || *ptr->value == '!' || *ptr->value == '^')) {
+      len = strlen(ptr->value);
+      nbytes += ((len < MAX_COMMAND_BUFFER) ? len : MAX_COMMAND_BUFFER - 1) + 1;
+      nent++;
+    }
+  }
+
+  SAFE_MALLOC(temp, char, sizeof(struct cmd_index) +
+              nent * sizeof(struct cmd_entry) + nbytes);
+  ci = (struct cmd_index *)temp;
+  ci->gen = db[thing].cmd_gen;
+  ci->busy = 0;
+  ci->orphaned = 0;
+  ci->commer = 0;
+  ci->listener = 0;
+  ci->count = 0;
+  strings = (char *)&ci->ent[nent];
+
+  for (ptr = list; ptr; ptr = ptr->next) {
+    if (!ptr->type) {
+      continue;
+    }
+    if (*ptr->value == '$') {
+      ci->commer = 1;
+    }
+    if (ptr->type == A_LISTEN ||
+        ((*ptr->value == '!') && !(ptr->type->flags & AF_LOCK))) {
+      ci->listener = 1;
+    }
+    if ((ptr->type->flags & AF_LOCK) ||
+        (*ptr->value != '$' && *ptr->value != '!' && *ptr->value != '^')) {
+      continue;
+    }
+
+    len = strlen(ptr->value);
+    if (len >= MAX_COMMAND_BUFFER) {
+      len = MAX_COMMAND_BUFFER - 1;
+    }
+    memcpy(strings, ptr->value, len);
+    strings[len] = '\0';
+
+    if (cmd_entry_parse(&ci->ent[ci->count], strings)) {
+      ci->ent[ci->count].flags =
+        (ptr->type->flags & AF_HAVEN) ? CMD_HAVEN : 0;
+      ci->ent[ci->count].prog = wild_compile(ci->ent[ci->count].pattern);
+      ci->count++;
+    }
+    strings += len + 1;
+  }
+
+  cmd_index_builds++;
+  return ci;
+}
+
+/**
+ * cmd_index_destroy - Free an index and its compiled patterns
+ */
+static void cmd_index_destroy(struct cmd_index *ci)
+{
+  size_t i;
+
+  for (i = 0; i < ci->count; i++) {
+    wild_free(ci->ent[i].prog);
+  }
+  SAFE_FREE(ci);
+}
+
+/**
+ * cmd_index_free - Release thing's command index
+ *
+ * Called when the object's attributes are freed.  An index pinned by an
+ * atr_match() in progress is released when that match finishes.
+ *
+ * @param thing Object whose index to drop
+ */
+void cmd_index_free(dbref thing)
+{
+  struct cmd_index *ci;
+
+  if (!GoodObject(thing) || !(ci = db[thing].cmd_index)) {
+    return;
+  }
+  db[thing].cmd_index = NULL;
+  if (ci->busy) {
+    ci->orphaned = 1;
+  } else {
+    cmd_index_destroy(ci);
+  }
+}
+
+/**
+ * cmd_index_get - Current command index for thing, rebuilt if stale
+ */
+static struct cmd_index *cmd_index_get(dbref thing)
+{
+  struct cmd_index *ci = db[thing].cmd_index;
+
+  if (ci && ci->gen == db[thing].cmd_gen) {
+    return ci;
+  }
+  cmd_index_free(thing);
+  return (db[thing].cmd_index = cmd_index_build(thing));
+}
+
+/**
+ * cmd_index_listener - Does thing have a LISTEN or ! pattern to react with?
+ */
+static int cmd_index_listener(dbref thing)
+{
+  return cmd_index_get(thing)->listener;
+}
+
+static void cmd_index_release(struct cmd_index *ci)
+{
+  if (--ci->busy == 0 && ci->orphaned) {
+    cmd_index_destroy(ci);
+  }
+}
+
 /* ============================================================================
  * LIST CHECKING FUNCTIONS
  * ============================================================================ */
@@ -1709,70 +1972,54 @@ static int list_check(dbref thing, dbref player, int type, char *str)
  */
 static int atr_match(dbref thing, dbref player, int type, char *str)
 {
-  struct all_atr_list *ptr;
+  struct cmd_index *ci;
+  struct cmd_entry *e;
+  size_t i;
+  char lead;
   int match = 0;
 
   /* Validate objects */
-  if (!GoodObject(thing) || !GoodObject(player)) {
+  if (!GoodObject(thing) || !GoodObject(player) || !str) {
     return 0;
   }
 
-  /* Iterate through all attributes */
-  for (ptr = all_attributes(thing); ptr; ptr = ptr->next) {
-    if ((ptr->type != 0) && 
-        !(ptr->type->flags & AF_LOCK) &&
-        (*ptr->value == type)) {
-      
-      char buff[MAX_COMMAND_BUFFER];
-      char *s, *p;
+  ci = cmd_index_get(thing);
+  ci->busy++;
+  lead = to_upper(*str);
 
-      /* Safe string copy */
-      strncpy(buff, ptr->value, sizeof(buff) - 1);
-      buff[sizeof(buff) - 1] = '\0';
-      
-      /* Search for first unescaped : */
-      for (s = buff + 1; *s && (*s != ':'); s++);
-      if (!*s) continue;
-      *s++ = '\0';
-      
-      /* Check for lock */
-      if (*s == '/') {
-        p = ++s;
-        while (*s && (*s != '/')) {
-          if (*s == '[') {
-            while (*s && (*s != ']')) s++;
-          }
-          s++;
-        }
-        if (!*s) continue;
-        *s++ = '\0';
-        
-        /* Evaluate lock */
-        if (!eval_boolexp(player, thing, p, get_zone_first(player))) {
-          continue;
-        }
+  for (i = 0; i < ci->count; i++) {
+    e = &ci->ent[i];
+    if (e->type != type || (e->lead && e->lead != lead)) {
+      continue;
+    }
+
+    /* Evaluate lock */
+    if (e->lock &&
+        !eval_boolexp(player, thing, e->lock, get_zone_first(player))) {
+      continue;
+    }
+
+    /* Check wildcard match */
+    if (wild_exec(e->prog, str)) {
+      /* Check for HAVEN attribute (stops matching) */
+      if (e->flags & CMD_HAVEN) {
+        match = 0;
+        break;
       }
-      
-      /* Check wildcard match */
-      if (wild_match(buff + 1, str)) {
-        /* Check for HAVEN attribute (stops matching) */
-        if (ptr->type->flags & AF_HAVEN) {
-          return 0;
-        }
-        
-        match = 1;
-        
-        /* Check ULOCK */
-        if (!eval_boolexp(player, thing, atr_get(thing, A_ULOCK),
-                         get_zone_first(player))) {
-          did_it(player, thing, A_UFAIL, NULL, A_OUFAIL, NULL, A_AUFAIL);
-        } else {
-          parse_que(thing, s, player);
-        }
+
+      match = 1;
+
+      /* Check ULOCK */
+      if (!eval_boolexp(player, thing, atr_get(thing, A_ULOCK),
+                       get_zone_first(player))) {
+        did_it(player, thing, A_UFAIL, NULL, A_OUFAIL, NULL, A_AUFAIL);
+      } else {
+        parse_que(thing, e->action, player);
       }
     }
   }
-  
+
+  cmd_index_release(ci);
   return match;
 }
 
@@ -1830,10 +2077,6 @@ int Live_Puppet(dbref thing)
  */
 int Listener(dbref thing)
 {
-  struct all_atr_list *ptr;
-  ATTR *type;
-  char *s;
-
   if (!GoodObject(thing)) {
     return 0;
   }
@@ -1844,17 +2087,7 @@ int Listener(dbref thing)
   }
 
   /* Check for LISTEN or ! attributes */
-  for (ptr = all_attributes(thing); ptr; ptr = ptr->next) {
-    type = ptr->type;
-    s = ptr->value;
-    
-    if (!type) continue;
-    
-    if (type == A_LISTEN) return 1;
-    if ((*s == '!') && !(type->flags & AF_LOCK)) return 1;
-  }
-  
-  return 0;
+  return cmd_index_listener(thing);
 }
 
 /**
@@ -1865,24 +2098,12 @@ int Listener(dbref thing)
  */
 int Commer(dbref thing)
 {
-  struct all_atr_list *ptr;
-  ATTR *type;
-  char *s;
-
   if (!GoodObject(thing)) {
     return 0;
   }
 
   /* Check for $ attributes */
-  for (ptr = all_attributes(thing); ptr; ptr = ptr->next) {
-    type = ptr->type;
-    s = ptr->value;
-    
-    if (!type) continue;
-    if (*s == '$') return 1;
-  }
-  
-  return 0;
+  return cmd_index_get(thing)->commer;
 }
 
 /**
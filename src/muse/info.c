@@ -68,7 +68,7 @@ void do_info(dbref player, char *arg1)
 {
     if (!arg1 || !*arg1) {
         notify(player, "Usage: @info <type>");
-        notify(player, "Available types: config, db, funcs, memory, mail"
+        notify(player, "Available types: config, db, funcs, memory, mail, timers, resolver, compression"
 #ifdef USE_PROC
                ", pid, cpu"
 #endif
@@ -91,6 +91,15 @@ void do_info(dbref player, char *arg1)
     else if (!string_compare(arg1, "mail")) {
         info_mail(player);
     }
+    else if (!string_compare(arg1, "timers")) {
+        info_timers(player);
+    }
+    else if (!string_compare(arg1, "resolver")) {
+        info_resolver(player);
+    }
+    else if (!string_compare(arg1, "compression")) {
+        info_mccp(player);
+    }
 #ifdef USE_PROC
     else if (!string_compare(arg1, "pid")) {
         info_pid(player);
@@ -118,12 +127,34 @@ static void info_mem(dbref player)
     notify(player, "=== Memory Statistics ===");
 
     /* Stack information */
-    notify(player, tprintf("Stack Size/Blocks: %zu/%zu",
-                          stack_size, number_stack_blocks));
+    notify(player, tprintf("Stack Size/Blocks/Chunks: %zu/%zu/%zu",
+                          stack_size, number_stack_blocks, number_stack_chunks));
+
+    /* Inheritance resolution cache */
+    notify(player, tprintf("Inherit Cache Hits/Misses: %lu/%lu",
+                          inh_cache_hits, inh_cache_misses));
+
+    /* Compiled $/!/^ pattern indexes */
+    notify(player, tprintf("Command Index Builds: %lu", cmd_index_builds));
+
+    /* Compiled lock cache */
+    notify(player, tprintf("Lock Cache Hits/Misses: %lu/%lu",
+                          lock_cache_hits, lock_cache_misses));
+    notify(player, tprintf("Blacklist Set Builds: %lu", blacklist_builds));
+
+    /* Compiled user-defined function bodies */
+    notify(player, tprintf("Softcode Cache Hits/Misses: %lu/%lu",
+                          softcode_cache_hits, softcode_cache_misses));
+
+    /* Broadcast renders shared between recipients of one message */
+    notify(player, tprintf("Render Cache Hits/Misses: %lu/%lu",
+                          render_cache_hits, render_cache_misses));
 
     /* Text block information */
     notify(player, tprintf("Text Block Size/Count: %zu/%zu",
                           text_block_size, text_block_num));
+    notify(player, tprintf("Output Ring Size/Count: %zu/%zu",
+                          output_ring_size, output_ring_num));
 
 #ifdef __GLIBC__
     /* Use mallinfo2 on newer glibc, mallinfo on older */
@@ -951,4 +982,10 @@ void do_cmdav(dbref player)
                 (pcmds + qcmds) / len);
         notify(player, buf);
     }
+
+    notify(player, tprintf("Queue pass: %d cmds in %ld.%03ld ms (budget %d ms, peak %d cmds, %lu of %lu passes hit budget)",
+                           queue_pass_cmds,
+                           queue_pass_usec / 1000, queue_pass_usec % 1000,
+                           queue_budget_msec, queue_pass_peak,
+                           queue_budget_hits, queue_passes));
 }
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <limits.h>
 
 #include "config.h"
 #include "db.h"
@@ -1759,15 +1760,17 @@ static void cmd_upfront(dbref player, char *arg1, char *arg2)
 /**
  * cmd_wait - Wrapper for @wait command
  *
- * Core: wait_que(player, (int)strtol(arg1, NULL, 10), arg2, cause)
- * Note: arg1 is converted to int, requires cause parameter
+ * Core: wait_que(player, milliseconds, arg2, cause)
+ * Note: arg1 is seconds and may be fractional ("@wait 0.25=..."),
+ *       requires cause parameter
  */
 static void cmd_wait(dbref player, char *arg1, char *arg2)
 {
     char arg2_copy[MAX_COMMAND_BUFFER];
     char *argv_array[MAX_PACKED_ARGS];
     dbref cause = NOTHING;
-    int delay;
+    double secs;
+    long delay;
 
     if (arg2 && *arg2) {
         strncpy(arg2_copy, arg2, sizeof(arg2_copy) - 1);
@@ -1775,8 +1778,14 @@ static void cmd_wait(dbref player, char *arg1, char *arg2)
         unpack_argv(arg2_copy, &cause, argv_array);
     }
 
-    delay = (int)strtol(arg1, NULL, 10);
-    extern void wait_que(dbref, int, char *, dbref);
+    secs = strtod(arg1, NULL);
+    if (!(secs > 0.0)) {
+        delay = 0;
+    } else if (secs > (double)INT_MAX) {
+        delay = (long)INT_MAX * 1000L;
+    } else {
+        delay = (long)(secs * 1000.0 + 0.5);
+    }
     wait_que(player, delay, argv_array[0] ? argv_array[0] : "", cause);
 }
 
@@ -195,24 +195,20 @@ int is_connected(dbref viewer, dbref target)
     }
 
     /* Verify descriptor actually exists */
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == who) {
-            /* Found connected descriptor */
-
-            /* If no viewer specified, just return connected status */
-            if (viewer == NOTHING) {
-                return 1;  /* Raw connection check */
-            }
-
-            /* Check if viewer can see this connected player */
-            /* Handle hiding with A_LHIDE attribute */
-            if (*atr_get(who, A_LHIDE) && !controls(viewer, who, POW_WHO)) {
-                /* Player is hiding - check if viewer can see them */
-                return could_doit(viewer, who, A_LHIDE);
-            }
+    if ((d = player_descriptors(who)) != NULL) {
+        /* If no viewer specified, just return connected status */
+        if (viewer == NOTHING) {
+            return 1;  /* Raw connection check */
+        }
 
-            return 1;  /* Connected and visible */
+        /* Check if viewer can see this connected player */
+        /* Handle hiding with A_LHIDE attribute */
+        if (*atr_get(who, A_LHIDE) && !controls(viewer, who, POW_WHO)) {
+            /* Player is hiding - check if viewer can see them */
+            return could_doit(viewer, who, A_LHIDE);
         }
+
+        return 1;  /* Connected and visible */
     }
 
     /* Flag was wrong, clear it */
@@ -243,10 +239,8 @@ time_t get_idle_time(dbref player)
         return -1;
     }
     
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == player) {
-            return now - d->last_time;
-        }
+    if ((d = player_descriptors(player)) != NULL) {
+        return now - d->last_time;
     }
     
     return -1;
@@ -265,10 +259,8 @@ time_t get_conn_time(dbref player)
         return -1;
     }
     
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == player) {
-            return now - d->connected_at;
-        }
+    if ((d = player_descriptors(player)) != NULL) {
+        return now - d->connected_at;
     }
     
     return -1;
@@ -287,10 +279,8 @@ struct descriptor_data *get_descriptor(dbref player)
         return NULL;
     }
     
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == player) {
-            return d;
-        }
+    if ((d = player_descriptors(player)) != NULL) {
+        return d;
     }
     
     return NULL;
@@ -1660,6 +1660,27 @@ static void sstrcat(char *old, char *string, const char *app)
  */
 void pronoun_substitute(char *result, dbref player, char *str, dbref privs)
 {
+  pronoun_substitute_compiled(result, player, str, privs, NULL);
+}
+
+/**
+ * Substitute pronouns and variables, using a compiled form of the string
+ *
+ * Same as pronoun_substitute(); sc, if not NULL, must be softcode_get()'s
+ * compilation of str.  Literal runs and [expressions] it has compiled are
+ * run from that; anything else is interpreted as usual.
+ *
+ * @param result Output buffer (PRONOUN_BUF_SIZE)
+ * @param player Player whose pronouns to use
+ * @param str Input string with substitutions
+ * @param privs Object whose privileges to use for evaluation
+ * @param sc Compiled str, or NULL
+ */
+void pronoun_substitute_compiled(char *result, dbref player, char *str,
+                                 dbref privs, struct softcode *sc)
+{
+  const char *lit;
+  size_t litlen, n;
   char c;
   char *s, *p;
   char *ores;
@@ -1726,7 +1747,11 @@ void pronoun_substitute(char *result, dbref player, char *str, dbref privs)
       /* Function evaluation */
       char buff[PRONOUN_BUF_SIZE];
       str++;
-      museexec(&str, buff, privs, player, 0);
+      if (sc) {
+        softcode_bracket(sc, &str, buff, privs, player);
+      } else {
+        museexec(&str, buff, privs, player, 0);
+      }
       if ((strlen(buff) + (size_t)(result - ores)) <= SSTRCAT_MAX_LEN) {
         size_t remaining = PRONOUN_BUF_SIZE - (size_t)(result - ores);
         strncpy(result, buff, remaining - 1);
@@ -1836,6 +1861,14 @@ void pronoun_substitute(char *result, dbref player, char *str, dbref privs)
 
       result += strlen(result);
       if (*str) str++;
+    } else if (sc && (n = softcode_literal(sc, str, &lit, &litlen)) != 0) {
+      /* Compiled run of regular characters */
+      if (litlen > (size_t)(PRONOUN_BUF_SIZE - 1 - (result - ores))) {
+        litlen = (size_t)(PRONOUN_BUF_SIZE - 1 - (result - ores));
+      }
+      memcpy(result, lit, litlen);
+      result += litlen;
+      str += n;
     } else {
       /* Regular character */
       if ((result - ores) <= (PRONOUN_BUF_SIZE - 2)) {
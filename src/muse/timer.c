@@ -21,8 +21,12 @@
  * - Proper signal handler declarations
  * - Consistent function prototypes
  *
+ * SCHEDULING:
+ * - SIGALRM/alarm(1) replaced by a table of jobs on CLOCK_MONOTONIC,
+ *   each with its own period, cost budget and run-time statistics
+ * - The main loop wakes through a timerfd (Linux) or a bounded timeout
+ *
  * SECURITY NOTES:
- * - Signal handlers are async-signal-safe
  * - Command buffer operations are bounded
  */
 
@@ -33,11 +37,16 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <fcntl.h>
-
-#ifdef XENIX
-#include <sys/signal.h>
-#else
-#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifdef __linux__
+#define HAVE_TIMERFD
+#include <stdint.h>
+#include <sys/timerfd.h>
 #endif
 
 #include "db.h"
@@ -52,7 +61,6 @@
  * GLOBAL STATE
  * ============================================================================ */
 
-static int alarm_triggered = 0;
 extern char ccom[1024];  /* Current command name for logging */
 
 /* ============================================================================
@@ -60,6 +68,15 @@ extern char ccom[1024];  /* Current command name for logging */
  * ============================================================================ */
 void trig_idle_boot(void);
 
+static void job_second(void);
+static void job_dbck(void);
+static void job_dump(void);
+static void job_bytes(void);
+static void job_newday(void);
+static void job_garbage(void);
+#ifdef PURGE_OLDMAIL
+static void job_oldmail(void);
+#endif
 
 /* ============================================================================
  * @ATIME TRIGGER SYSTEM
@@ -89,32 +106,190 @@ void trig_atime(void)
 }
 
 /* ============================================================================
- * SIGNAL HANDLING
+ * JOB TABLE
+ * ============================================================================
+ *
+ * Every periodic chore the server runs is a job with its own period and
+ * cost budget, scheduled off CLOCK_MONOTONIC so wall-clock jumps neither
+ * stall nor stampede it.  A job's next run is counted from when it was
+ * due, not from when it finished, so long passes don't make the schedule
+ * drift; a job that falls a whole period behind skips ahead rather than
+ * running back to back.  One-shot jobs run once and go idle until
+ * timer_once() arms them again.
+ *
+ * Due jobs run in table order, which is the order dispatch() used to run
+ * them in.  Run times are kept per job for @info timers; a run over the
+ * job's budget is counted as an overrun.
+ */
+
+#define TIMER_ONESHOT 1  /* Run once, then idle until re-armed */
+
+struct timer_job {
+  const char *name;
+  void (*fn)(void);
+  int period_msec;       /* Fixed period, or 0 to use *period_sec */
+  int *period_sec;       /* Config variable holding the period */
+  int budget_msec;       /* Expected cost of one run */
+  int flags;
+  long next;             /* Monotonic msec when due, -1 if idle */
+  unsigned long runs;
+  unsigned long overruns;
+  long last_usec;
+  long max_usec;
+  double total_usec;
+};
+
+static struct timer_job timer_jobs[] = {
+  { "queue",    job_second,    1000,   NULL,             20,   0, 0, 0, 0, 0, 0, 0 },
+#ifdef RESOCK
+  { "resock",   resock,        300000, NULL,             50,   0, 0, 0, 0, 0, 0, 0 },
+#endif
+  { "dbck",     job_dbck,      0,      &fixup_interval,  2000, 0, 0, 0, 0, 0, 0, 0 },
+  { "dump",     job_dump,      0,      &dump_interval,   500,  0, 0, 0, 0, 0, 0, 0 },
+  { "bytes",    job_bytes,     1000,   NULL,             10,   0, 0, 0, 0, 0, 0, 0 },
+#ifdef PURGE_OLDMAIL
+  { "oldmail",  job_oldmail,   0,      &old_mail_interval, 500, 0, 0, 0, 0, 0, 0, 0 },
+#endif
+  { "atime",    trig_atime,    300000, NULL,             200,  0, 0, 0, 0, 0, 0, 0 },
+  { "newday",   job_newday,    0,      NULL,             50,   TIMER_ONESHOT, 0, 0, 0, 0, 0, 0 },
+  { "auth",     mariadb_auth_cleanup_expired, 300000, NULL, 100, 0, 0, 0, 0, 0, 0, 0 },
+  { "idleboot", trig_idle_boot, 1000,  NULL,             10,   0, 0, 0, 0, 0, 0, 0 },
+  { "garbage",  job_garbage,   1000,   NULL,             10,   0, 0, 0, 0, 0, 0, 0 },
+  { "topology", run_topology,  1000,   NULL,             10,   0, 0, 0, 0, 0, 0, 0 },
+};
+
+#define NUM_TIMER_JOBS ((int)(sizeof(timer_jobs) / sizeof(timer_jobs[0])))
+
+static long timer_due = -1;   /* Earliest job due time, -1 if none */
+
+#ifdef HAVE_TIMERFD
+static int tfd = -1;          /* timerfd woken at the next deadline */
+static long tfd_armed = -1;   /* Deadline it is armed for */
+#endif
+
+/* ============================================================================
+ * CLOCK
  * ============================================================================ */
 
 /**
- * SIGALRM handler - sets flag when alarm fires
- * 
- * This function is called by the system when SIGALRM fires (every second).
- * It sets a flag that the main timer dispatch loop checks.
- * 
- * SAFETY: This is an async-signal-safe function. It only sets a flag
- * and does not perform any complex operations.
+ * Monotonic clock in milliseconds
  * 
- * @param i Signal number (unused, required by signal handler signature)
- * @return void for void_signal_type systems, 0 otherwise
+ * Used for job scheduling and @wait due times.  Unaffected by changes to
+ * the wall clock.
  */
-static signal_type alarm_handler(int i)
+long timer_msec(void)
 {
-  (void)i;  /* Unused parameter */
-  alarm_triggered = 1;
-  signal(SIGALRM, alarm_handler);
-  
-#ifdef void_signal_type
-  return;
-#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/* Monotonic clock in microseconds, for run-time accounting */
+static long timer_usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long)ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+/* ============================================================================
+ * SCHEDULING
+ * ============================================================================ */
+
+/* Current period of a job in msec, 0 if the job is disabled */
+static long job_period(struct timer_job *j)
+{
+  if (j->period_msec > 0) {
+    return j->period_msec;
+  }
+  if (j->period_sec && *j->period_sec > 0) {
+    return (long)*j->period_sec * 1000L;
+  }
   return 0;
-#endif
+}
+
+/* Recompute timer_due from the table */
+static void timer_recalc(void)
+{
+  int i;
+
+  timer_due = -1;
+  for (i = 0; i < NUM_TIMER_JOBS; i++) {
+    if (timer_jobs[i].next >= 0 &&
+        (timer_due < 0 || timer_jobs[i].next < timer_due)) {
+      timer_due = timer_jobs[i].next;
+    }
+  }
+}
+
+/* Find a job by name */
+static struct timer_job *timer_find(const char *name)
+{
+  int i;
+
+  for (i = 0; i < NUM_TIMER_JOBS; i++) {
+    if (!strcmp(timer_jobs[i].name, name)) {
+      return &timer_jobs[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Arm a one-shot job to run after delay_msec
+ * 
+ * @param name Job name from the job table
+ * @param delay_msec Delay from now; the job runs on the first dispatch()
+ *                   at or after it
+ */
+void timer_once(const char *name, long delay_msec)
+{
+  struct timer_job *j = timer_find(name);
+
+  if (!j || !(j->flags & TIMER_ONESHOT)) {
+    log_error(tprintf("timer_once: no one-shot job '%s'", name));
+    return;
+  }
+
+  j->next = timer_msec() + (delay_msec > 0 ? delay_msec : 0);
+  timer_recalc();
+}
+
+/* Run one job and account for it */
+static void timer_run(struct timer_job *j, long t)
+{
+  long start, used, period;
+
+  if (j->flags & TIMER_ONESHOT) {
+    j->next = -1;
+  } else {
+    period = job_period(j);
+    if (!period) {
+      /* Disabled (interval config unset); look again in a second */
+      j->next = t + 1000;
+      return;
+    }
+    j->next += period;
+    if (j->next <= t) {
+      j->next = t + period;
+    }
+  }
+
+  start = timer_usec();
+  j->fn();
+  used = timer_usec() - start;
+
+  j->runs++;
+  j->last_usec = used;
+  j->total_usec += (double)used;
+  if (used > j->max_usec) {
+    j->max_usec = used;
+  }
+  if (used > (long)j->budget_msec * 1000L) {
+    j->overruns++;
+  }
 }
 
 /* ============================================================================
@@ -124,14 +299,114 @@ static signal_type alarm_handler(int i)
 /**
  * Initialize the timer system
  * 
- * Sets up the SIGALRM handler and starts the 1-second alarm timer.
+ * Schedules every periodic job one period from now, arms the day-change
+ * check and, where available, opens the timerfd the main loop waits on.
  * This should be called once during server startup.
  */
 void init_timer(void)
 {
-  signal(SIGALRM, alarm_handler);
-  signal(SIGHUP, alarm_handler);
-  alarm(1);
+  long t = timer_msec();
+  long period;
+  int i;
+
+  for (i = 0; i < NUM_TIMER_JOBS; i++) {
+    if (timer_jobs[i].flags & TIMER_ONESHOT) {
+      timer_jobs[i].next = -1;
+      continue;
+    }
+    period = job_period(&timer_jobs[i]);
+    timer_jobs[i].next = t + (period ? period : 1000);
+  }
+  timer_once("newday", 60000);
+
+#ifdef HAVE_TIMERFD
+  if (tfd < 0) {
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) {
+      log_error(tprintf("timerfd_create failed: %s", strerror(errno)));
+    }
+  }
+#endif
+}
+
+/**
+ * File descriptor that becomes readable at the next timer deadline
+ * 
+ * @return timerfd, or -1 if the main loop must bound its own timeout
+ */
+int timer_fd(void)
+{
+#ifdef HAVE_TIMERFD
+  return tfd;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * Consume a timerfd expiry once the main loop has seen it readable
+ */
+void timer_fired(void)
+{
+#ifdef HAVE_TIMERFD
+  uint64_t expirations;
+
+  if (tfd >= 0 && read(tfd, &expirations, sizeof(expirations)) < 0 &&
+      errno != EAGAIN) {
+    log_error(tprintf("timerfd read: %s", strerror(errno)));
+  }
+  tfd_armed = -1;
+#endif
+}
+
+/**
+ * Arrange to wake at the next job or @wait deadline
+ * 
+ * With a timerfd the fd is (re)armed for the deadline and timeout is
+ * left alone; otherwise timeout is shortened to reach it.
+ * 
+ * @param timeout Main loop wait timeout
+ */
+void timer_arm(struct timeval *timeout)
+{
+  long deadline = timer_due, wake = queue_next_wake(), left;
+
+  if (wake >= 0 && (deadline < 0 || wake < deadline)) {
+    deadline = wake;
+  }
+  if (deadline < 0) {
+    return;
+  }
+
+#ifdef HAVE_TIMERFD
+  if (tfd >= 0) {
+    struct itimerspec its;
+
+    if (deadline == tfd_armed) {
+      return;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline / 1000L;
+    its.it_value.tv_nsec = (deadline % 1000L) * 1000000L;
+    if (!its.it_value.tv_sec && !its.it_value.tv_nsec) {
+      its.it_value.tv_nsec = 1;  /* all-zero would disarm */
+    }
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+      tfd_armed = deadline;
+      return;
+    }
+    log_error(tprintf("timerfd_settime: %s", strerror(errno)));
+  }
+#endif
+
+  left = deadline - timer_msec();
+  if (left < 0) {
+    left = 0;
+  }
+  if (left < (long)timeout->tv_sec * 1000L + timeout->tv_usec / 1000L) {
+    timeout->tv_sec = left / 1000L;
+    timeout->tv_usec = (left % 1000L) * 1000L;
+  }
 }
 
 /* ============================================================================
@@ -141,133 +416,175 @@ void init_timer(void)
 /**
  * Main timer dispatch function - called from main event loop
  * 
- * This function is called frequently from the main server loop.
- * When the alarm flag is set (once per second), it performs
- * various periodic maintenance tasks at different intervals.
+ * This function is called on every pass of the main server loop and
+ * runs whichever jobs have come due, in table order.  Passes with
+ * nothing due cost one clock read.
  * 
- * TIMING INTERVALS:
- * - Every second: Queue processing (do_second)
- * - Every 60 seconds: New day check, idle boot checks
- * - Every 300 seconds (5 min): Resock, @atime triggers
+ * TIMING INTERVALS (see timer_jobs):
+ * - Every second: Queue tick (do_second), byte accounting, idle boot,
+ *   incremental garbage collection, topology
+ * - Every 300 seconds (5 min): Resock, @atime triggers, auth token cleanup
  * - fixup_interval: Database consistency checks (dbck)
  * - dump_interval: Database dumps
  * - old_mail_interval: Stale mail deletion (if enabled)
- * 
- * SAFETY: All string operations use bounded functions
+ * - At each local midnight: New day check (one-shot, re-armed)
  */
 void dispatch(void)
 {
-  static int ticks = 0;
+  long t;
+  int i;
 
-  /* Only act when alarm has triggered */
-  if (!alarm_triggered) {
+  if (timer_due < 0) {
+    return;
+  }
+  t = timer_msec();
+  if (t < timer_due) {
     return;
   }
 
-  alarm_triggered = 0;
-  ticks++;
+  for (i = 0; i < NUM_TIMER_JOBS; i++) {
+    if (timer_jobs[i].next >= 0 && timer_jobs[i].next <= t) {
+      timer_run(&timer_jobs[i], t);
+    }
+  }
 
-  /* === EVERY SECOND === */
+  timer_recalc();
+}
+
+/* ============================================================================
+ * JOBS
+ * ============================================================================ */
+
+/* Queue tick: fair-queuing accounting and a queue pass */
+static void job_second(void)
+{
   do_second();
+}
 
-#ifdef RESOCK
-  /* === EVERY 5 MINUTES === */
-  /* Re-establish socket connections if needed */
-  if (!(ticks % 300)) {
-    resock();
-  }
-#endif
+/* Database consistency check */
+static void job_dbck(void)
+{
+  log_command("Dbcking...");
+  
+  strncpy(ccom, "dbck", sizeof(ccom) - 1);
+  ccom[sizeof(ccom) - 1] = '\0';
+  
+  do_dbck(root);
+  log_command("...Done.");
+}
 
-  /* === FIXUP INTERVAL === */
-  /* Database consistency check */
-  if (!(ticks % fixup_interval)) {
-    log_command("Dbcking...");
-    
-    strncpy(ccom, "dbck", sizeof(ccom) - 1);
-    ccom[sizeof(ccom) - 1] = '\0';
-    
-    do_dbck(root);
-    log_command("...Done.");
-  }
+/* Periodic database save */
+static void job_dump(void)
+{
+  log_command("Dumping.");
+  
+  strncpy(ccom, "dump", sizeof(ccom) - 1);
+  ccom[sizeof(ccom) - 1] = '\0';
+  
+  fork_and_dump();
+}
 
-  /* === DUMP INTERVAL === */
-  /* Periodic database save */
-  if (!(ticks % dump_interval)) {
-    log_command("Dumping.");
-    
-    strncpy(ccom, "dump", sizeof(ccom) - 1);
-    ccom[sizeof(ccom) - 1] = '\0';
-    
-    fork_and_dump();
-  }
+/* Byte usage tracking, spread across ticks */
+static void job_bytes(void)
+{
+  dbref i;
 
-  /* === UPDATE BYTES === */
-  /* Update byte usage tracking (spread across multiple ticks) */
-  {
-    int i;
-    for (i = 0; i < ((db_top / 300) + 1); i++) {
-      update_bytes();
-    }
+  for (i = db_top / 300; i >= 0; i--) {
+    update_bytes();
   }
+}
 
 #ifdef PURGE_OLDMAIL
-  /* === OLD MAIL INTERVAL === */
-  /* Delete stale mail periodically */
-  {
-    static int mticks = -1;
+/* Delete stale mail */
+static void job_oldmail(void)
+{
+  log_command("Deleting old mail.\n");
   
-    if (mticks == -1) {
-      mticks = old_mail_interval;
-    }
+  strncpy(ccom, "mail", sizeof(ccom) - 1);
+  ccom[sizeof(ccom) - 1] = '\0';
   
-    if (!mticks--) {
-      log_command("Deleting old mail.\n");
-      mticks = old_mail_interval;
-      
-      strncpy(ccom, "mail", sizeof(ccom) - 1);
-      ccom[sizeof(ccom) - 1] = '\0';
-      
-      clear_old_mail();
-      next_mail_clear = now + old_mail_interval;
-    }
-  }
+  clear_old_mail();
+  next_mail_clear = now + old_mail_interval;
+}
 #endif /* PURGE_OLDMAIL */
 
-  /* === EVERY 5 MINUTES === */
-  /* Trigger @atime attributes */
-  if (!(ticks % 300)) {
-    trig_atime();
-  }
+/*
+ * Day-change check for login statistics.  Runs just after local midnight
+ * and re-arms itself for the next one; the delay is capped at an hour so
+ * DST shifts and wall-clock corrections are caught promptly.
+ */
+static void job_newday(void)
+{
+  time_t tt = time(NULL);
+  struct tm *tm;
+  long delay = 3600L;
 
-  /* === EVERY MINUTE === */
-  /* Check for new day (for daily maintenance) */
-  if (!(ticks % 60)) {
-    check_newday();
-  }
+  check_newday();
 
-  /* === EVERY 5 MINUTES === */
-  /* Clean up expired auth tokens and email verification tokens */
-  if (!(ticks % 300)) {
-    mariadb_auth_cleanup_expired();
+  tm = localtime(&tt);
+  if (tm) {
+    delay = 86400L - (tm->tm_hour * 3600L + tm->tm_min * 60L + tm->tm_sec) + 1;
+    if (delay > 3600L) {
+      delay = 3600L;
+    }
   }
+  timer_once("newday", delay * 1000L);
+}
 
-  /* Boot idle guests and unconnected descriptors */
-  trig_idle_boot();
-
-  /* === EVERY TICK === */
-  /* Incremental garbage collection */
+/* Incremental garbage collection */
+static void job_garbage(void)
+{
   strncpy(ccom, "garbage", sizeof(ccom) - 1);
   ccom[sizeof(ccom) - 1] = '\0';
   do_incremental();
-
-  /* Topology processing */
-  run_topology();
-
-  /* Reset alarm for next second */
-  alarm(1);
 }
 
+/* ============================================================================
+ * @INFO TIMERS
+ * ============================================================================ */
+
+/**
+ * Display per-job schedule and run-time statistics
+ * @param player Player to send info to
+ */
+void info_timers(dbref player)
+{
+  struct timer_job *j;
+  long t = timer_msec(), period;
+  int i;
+
+  notify(player, tprintf("Timer wakeup: %s",
+                         timer_fd() >= 0 ? "timerfd (CLOCK_MONOTONIC)"
+                                         : "loop timeout (CLOCK_MONOTONIC)"));
+  notify(player, "Job       Period   Next     Runs  Avg(ms)  Max(ms) Last(ms) Budget Over");
+
+  for (i = 0; i < NUM_TIMER_JOBS; i++) {
+    char pbuf[24], nbuf[24];
+
+    j = &timer_jobs[i];
+    period = job_period(j);
+    if (j->flags & TIMER_ONESHOT) {
+      strcpy(pbuf, "once");
+    } else if (period) {
+      snprintf(pbuf, sizeof(pbuf), "%lds", period / 1000L);
+    } else {
+      strcpy(pbuf, "off");
+    }
+    if (j->next < 0 || (!period && !(j->flags & TIMER_ONESHOT))) {
+      strcpy(nbuf, "-");
+    } else {
+      snprintf(nbuf, sizeof(nbuf), "%lds",
+               j->next > t ? (j->next - t + 999) / 1000L : 0L);
+    }
 
+    notify(player, tprintf("%-9s %-8s %-8s %5lu %8.2f %8.2f %8.2f %6d %4lu",
+                           j->name, pbuf, nbuf, j->runs,
+                           j->runs ? j->total_usec / (double)j->runs / 1000.0 : 0.0,
+                           (double)j->max_usec / 1000.0,
+                           (double)j->last_usec / 1000.0,
+                           j->budget_msec, j->overruns));
+  }
+}
 
 void trig_idle_boot(void)
 { 
@@ -24,7 +24,7 @@
  * - Removed implicit int returns
  *
  * SECURITY NOTES:
- * - Recursion depth limited to prevent stack overflow
+ * - Matching is iterative; no recursion to overflow
  * - Buffer operations are bounded
  * - Invalid patterns detected and rejected
  *
@@ -33,6 +33,8 @@
  * - * matches zero or more characters
  * - ? matches exactly one character (including none at end)
  * - Case-insensitive matching
+ * - Patterns are compiled once (wild_compile) and matched in
+ *   O(pattern * data) time (wild_exec); see COMPILED PATTERNS below
  */
 
 /* ============================================================================
@@ -40,6 +42,8 @@
  * ============================================================================ */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include "config.h"
 #include "externs.h"
@@ -65,117 +69,279 @@ int wlen[10];
 char wbuff[2000];
 
 /* ============================================================================
- * CONSTANTS
- * ============================================================================ */
+ * COMPILED PATTERNS
+ * ============================================================================
+ * A pattern is compiled once into a token array.  Each token knows which
+ * capture group (if any) it opens or closes, so matching never has to work
+ * out the capture bookkeeping again.
+ *
+ * Matching is a depth-first search in exactly the order the old recursive
+ * wild() used ('*' tries to match zero characters first, then grows one
+ * character at a time), so captures come out the same.  It is iterative,
+ * and it remembers every (star, position) it has already tried: a state
+ * that was tried before cannot succeed this time either, because success
+ * ends the search.  So each star tries each data position at most once,
+ * and the search costs O(pattern * data) time rather than exponential.
+ */
 
-#define MAX_WILD_RECURSION 100  /* Maximum recursion depth for wild() */
+#define WILD_LIT   0            /* Literal character (stored upper-cased) */
+#define WILD_ONE   1            /* '?': one character, or none at the end */
+#define WILD_STAR  2            /* '*': zero or more characters */
+#define WILD_END   3            /* End of pattern: data must end too */
 
-/* ============================================================================
- * WILDCARD MATCHING (INTERNAL)
- * ============================================================================ */
+#define WILD_GLOB  0            /* Normal wildcard pattern */
+#define WILD_GT    1            /* ">x": true if data < x */
+#define WILD_LT    2            /* "<x": true if data > x */
+
+struct wild_tok {
+  char c;                       /* Upper-cased literal (WILD_LIT) */
+  unsigned char kind;           /* WILD_* token kind */
+  signed char open;             /* Capture group whose start is here, or -1 */
+  signed char close;            /* Capture group whose end is here, or -1 */
+  int star;                     /* Index among stars (WILD_STAR) */
+};
+
+struct wild_prog {
+  int mode;                     /* WILD_GLOB, WILD_GT or WILD_LT */
+  int never;                    /* Contains "**": can never match */
+  int nstars;                   /* Number of WILD_STAR tokens */
+  char *operand;                /* Comparison text for WILD_GT/WILD_LT */
+  struct wild_tok tok[];        /* Ends with a WILD_END token */
+};
+
+/* Scratch space for wild_exec(): backtrack stack and tried-state bitmap.
+ * Matching never calls out of this file, so one copy is enough. */
+struct wild_alt {
+  size_t t;                     /* Token index (a star) */
+  size_t j;                     /* Data position to resume at */
+};
+
+static size_t wild_prog_size(const char *s);
+static struct wild_prog *wild_compile_into(const char *s, char *mem);
+
+static struct wild_alt *wild_stack = NULL;
+static size_t wild_stack_size = 0;
+static unsigned char *wild_seen = NULL;
+static size_t wild_seen_size = 0;
+
+/* wild_match() compiles into this instead of allocating every call */
+static char *wild_scratch = NULL;
+static size_t wild_scratch_size = 0;
 
 /**
- * Internal recursive wildcard matching function
- * 
- * This function performs the actual wildcard matching with tracking
- * of matched regions for later extraction.
- * 
- * ALGORITHM:
- * - '?' matches any single character (or end of string)
- * - '*' matches zero or more characters
- * - Other characters must match exactly (case-insensitive)
- * 
- * SECURITY: Includes recursion depth limiting to prevent stack overflow
- * 
- * @param s Pattern string (with wildcards)
- * @param d Data string (to match against)
- * @param p Current wildcard index (0-9)
- * @param os In wildcard state (1) or normal state (0)
- * @return 1 if match, 0 if no match
+ * Compile a wildcard pattern
+ *
+ * Understands the same syntax as wild_match(), including the leading
+ * '>' and '<' comparison modes.  The pattern text is not kept; the
+ * result can outlive it.
+ *
+ * @param s Pattern string
+ * @return Compiled pattern (free with wild_free()), or NULL if s is NULL
  */
-static int wild(char *s, char *d, int p, int os)
+struct wild_prog *wild_compile(const char *s)
 {
-  static int recursion_depth = 0;
+  char *temp;
 
-  if (!s || !d) {
+  if (!s) {
+    return NULL;
+  }
+
+  SAFE_MALLOC(temp, char, wild_prog_size(s));
+  return temp ? wild_compile_into(s, temp) : NULL;
+}
+
+/**
+ * Bytes needed to compile s
+ */
+static size_t wild_prog_size(const char *s)
+{
+  size_t len = strlen(s);
+  size_t ntok = (*s == '>' || *s == '<') ? 1 : len + 1;
+
+  return sizeof(struct wild_prog) + ntok * sizeof(struct wild_tok) + len + 1;
+}
+
+/**
+ * Compile s into mem, which holds at least wild_prog_size(s) bytes
+ */
+static struct wild_prog *wild_compile_into(const char *s, char *mem)
+{
+  struct wild_prog *wp = (struct wild_prog *)mem;
+  size_t len, i, ntok;
+  int group = 0, in_wild = 0;
+
+  len = strlen(s);
+  ntok = (*s == '>' || *s == '<') ? 1 : len + 1;
+  wp->never = 0;
+  wp->nstars = 0;
+  wp->operand = (char *)&wp->tok[ntok];
+  memcpy(wp->operand, s, len + 1);
+
+  if (*s == '>' || *s == '<') {
+    wp->mode = (*s == '>') ? WILD_GT : WILD_LT;
+    wp->operand++;
+    wp->tok[0].kind = WILD_END;
+    wp->tok[0].open = wp->tok[0].close = -1;
+    return wp;
+  }
+  wp->mode = WILD_GLOB;
+
+  for (i = 0; i <= len; i++) {
+    struct wild_tok *t = &wp->tok[i];
+
+    t->open = t->close = -1;
+    t->star = 0;
+    t->c = 0;
+    switch (s[i]) {
+      case '?':
+      case '*':
+        if (s[i] == '*') {
+          t->kind = WILD_STAR;
+          t->star = wp->nstars++;
+          if (s[i + 1] == '*') {
+            wp->never = 1;
+          }
+        } else {
+          t->kind = WILD_ONE;
+        }
+        /* A run of wildcards is one capture group */
+        if (!in_wild && group < 10) {
+          t->open = (signed char)group;
+        }
+        in_wild = 1;
+        break;
+
+      default:
+        t->kind = s[i] ? WILD_LIT : WILD_END;
+        t->c = to_upper(s[i]);
+        if (in_wild && group < 10) {
+          t->close = (signed char)group++;
+        }
+        in_wild = 0;
+        break;
+    }
+  }
+
+  return wp;
+}
+
+/**
+ * Free a compiled pattern
+ *
+ * @param wp Pattern from wild_compile() (NULL is ignored)
+ */
+void wild_free(struct wild_prog *wp)
+{
+  if (wp) {
+    SAFE_FREE(wp);
+  }
+}
+
+/**
+ * Make sure the scratch space can hold a search over n data positions
+ */
+static int wild_reserve(const struct wild_prog *wp, size_t n)
+{
+  size_t states = (size_t)wp->nstars * (n + 1);
+  size_t bytes = (states + 7) / 8;
+
+  if (states > wild_stack_size) {
+    if (wild_stack) {
+      SAFE_FREE(wild_stack);
+    }
+    SAFE_MALLOC(wild_stack, struct wild_alt, states);
+    wild_stack_size = wild_stack ? states : 0;
+  }
+  if (bytes > wild_seen_size) {
+    if (wild_seen) {
+      SAFE_FREE(wild_seen);
+    }
+    SAFE_MALLOC(wild_seen, unsigned char, bytes);
+    wild_seen_size = wild_seen ? bytes : 0;
+  }
+  if (!wild_stack || !wild_seen) {
     return 0;
   }
+  memset(wild_seen, 0, bytes);
+  return 1;
+}
+
+/**
+ * Run a compiled glob over d, recording captures in wptr[]/wlen[]
+ *
+ * @return 1 if match, 0 if no match
+ */
+static int wild_glob(const struct wild_prog *wp, char *d)
+{
+  const struct wild_tok *t;
+  size_t n = strlen(d), ti = 0, j = 0, sp = 0, bit;
+  int resumed = 0;
 
-  /* Check recursion depth */
-  if (recursion_depth > MAX_WILD_RECURSION) {
+  if (wp->never) {
+    return 0;
+  }
+  if (wp->nstars && !wild_reserve(wp, n)) {
     return 0;
   }
 
-  recursion_depth++;
+  for (;;) {
+    t = &wp->tok[ti];
 
-  switch (*s) {
-    case '?':
-      /* Match any single character (or end of string) */
-      
-      /* Record start of wildcard match if transitioning from normal state */
-      if (!os && (p < 10)) {
-        wptr[p] = d;
-      }
-      
-      /* Continue matching: advance pattern, advance data if not at end */
-      {
-        int result = wild(s + 1, (*d) ? d + 1 : d, p, 1);
-        recursion_depth--;
-        return result;
-      }
+    switch (t->kind) {
+      case WILD_ONE:
+        if (t->open >= 0) {
+          wptr[t->open] = d + j;
+        }
+        ti++;
+        if (d[j]) {
+          j++;
+        }
+        continue;
 
-    case '*':
-      /* Match zero or more characters */
-      
-      /* Reject ** patterns as invalid */
-      if (s[1] == '*') {
-        recursion_depth--;
-        return 0;
-      }
-      
-      /* Record start of wildcard match if transitioning from normal state */
-      if (!os && (p < 10)) {
-        wptr[p] = d;
-      }
-      
-      /* Try two possibilities:
-       * 1. Match zero characters (advance pattern only)
-       * 2. Match one or more characters (advance data, keep pattern)
-       */
-      {
-        int result = (wild(s + 1, d, p, 1) || 
-                     ((*d) ? wild(s, d + 1, p, 1) : 0));
-        recursion_depth--;
-        return result;
-      }
+      case WILD_STAR:
+        bit = (size_t)t->star * (n + 1) + j;
+        if (wild_seen[bit / 8] & (1 << (bit % 8))) {
+          resumed = 0;
+          break;                /* Tried before: it failed then */
+        }
+        wild_seen[bit / 8] |= (unsigned char)(1 << (bit % 8));
+        /* A resumed star is mid-group: its start is already recorded */
+        if (t->open >= 0 && !resumed) {
+          wptr[t->open] = d + j;
+        }
+        resumed = 0;
+        /* Zero characters first; one more character is the fallback */
+        if (d[j]) {
+          wild_stack[sp].t = ti;
+          wild_stack[sp].j = j + 1;
+          sp++;
+        }
+        ti++;
+        continue;
 
-    default:
-      /* Regular character - must match exactly */
-      
-      /* If exiting wildcard state, record length of match */
-      if (os && (p < 10)) {
-        wlen[p] = d - wptr[p];
-        p++;
-      }
-      
-      /* Check if characters match (case-insensitive) */
-      if (to_upper(*s) != to_upper(*d)) {
-        recursion_depth--;
-        return 0;
-      }
-      
-      /* If at end of pattern, we have a match */
-      if (!*s) {
-        recursion_depth--;
-        return 1;
-      }
-      
-      /* Continue matching */
-      {
-        int result = wild(s + 1, d + 1, p, 0);
-        recursion_depth--;
-        return result;
-      }
+      default:
+        if (t->close >= 0) {
+          wlen[t->close] = (int)(d + j - wptr[t->close]);
+        }
+        if (t->c != to_upper(d[j])) {
+          break;
+        }
+        if (t->kind == WILD_END) {
+          return 1;
+        }
+        ti++;
+        j++;
+        continue;
+    }
+
+    /* Dead end: resume at the most recent untried star extension */
+    if (!sp) {
+      return 0;
+    }
+    sp--;
+    ti = wild_stack[sp].t;
+    j = wild_stack[sp].j;
+    resumed = 1;
   }
 }
 
@@ -184,35 +350,22 @@ static int wild(char *s, char *d, int p, int os)
  * ============================================================================ */
 
 /**
- * Perform wildcard matching with special comparison modes
- * 
- * This function supports three matching modes:
- * 
- * 1. Pattern starting with '>':
- *    Numeric comparison: true if data < pattern (as numbers)
- *    String comparison: true if data < pattern (lexicographically)
- * 
- * 2. Pattern starting with '<':
- *    Numeric comparison: true if data > pattern (as numbers)
- *    String comparison: true if data > pattern (lexicographically)
- * 
- * 3. Normal wildcard matching:
- *    Uses wild() function with * and ? wildcards
- *    Captured wildcard matches stored in wptr/wlen/wbuff arrays
- * 
- * SECURITY: Includes recursion depth limiting
- * MEMORY: Captured matches stored in global buffers
- * 
- * @param s Pattern string (may start with < or >)
- * @param d Data string to match against
+ * Match data against a compiled pattern
+ *
+ * Same modes and captures as wild_match(); use this when one pattern is
+ * tried against many strings.
+ *
+ * @param wp Pattern from wild_compile()
+ * @param d  Data string to match against
  * @return 1 if match, 0 if no match
  */
-long wild_match(char *s, char *d)
+long wild_exec(const struct wild_prog *wp, char *d)
 {
   int a, b;
   char *e, *f;
+  const char *s;
 
-  if (!s || !d) {
+  if (!wp || !d) {
     return 0;
   }
 
@@ -221,11 +374,9 @@ long wild_match(char *s, char *d)
     wptr[a] = NULL;
   }
 
-  switch (*s) {
-    case '>':
-      /* Greater-than comparison */
-      s++;
-      
+  s = wp->operand;
+  switch (wp->mode) {
+    case WILD_GT:
       /* Numeric comparison if pattern starts with digit or minus */
       if (isdigit((unsigned char)s[0]) || (*s == '-')) {
         return (atol(s) < atol(d));
@@ -234,10 +385,7 @@ long wild_match(char *s, char *d)
         return (strcmp(s, d) < 0);
       }
 
-    case '<':
-      /* Less-than comparison */
-      s++;
-      
+    case WILD_LT:
       /* Numeric comparison if pattern starts with digit or minus */
       if (isdigit((unsigned char)s[0]) || (*s == '-')) {
         return (long)(atol(s) > atol(d));
@@ -248,7 +396,7 @@ long wild_match(char *s, char *d)
 
     default:
       /* Normal wildcard matching */
-      if (wild(s, d, 0, 0)) {
+      if (wild_glob(wp, d)) {
         /* Match successful - copy captured strings to buffer */
         f = wbuff;
         
@@ -281,4 +429,49 @@ long wild_match(char *s, char *d)
   }
 }
 
+/**
+ * Perform wildcard matching with special comparison modes
+ * 
+ * This function supports three matching modes:
+ * 
+ * 1. Pattern starting with '>':
+ *    Numeric comparison: true if data < pattern (as numbers)
+ *    String comparison: true if data < pattern (lexicographically)
+ * 
+ * 2. Pattern starting with '<':
+ *    Numeric comparison: true if data > pattern (as numbers)
+ *    String comparison: true if data > pattern (lexicographically)
+ * 
+ * 3. Normal wildcard matching:
+ *    * and ? wildcards, case-insensitive
+ *    Captured wildcard matches stored in wptr/wlen/wbuff arrays
+ * 
+ * MEMORY: Captured matches stored in global buffers
+ * 
+ * @param s Pattern string (may start with < or >)
+ * @param d Data string to match against
+ * @return 1 if match, 0 if no match
+ */
+long wild_match(char *s, char *d)
+{
+  size_t need;
+
+  if (!s || !d) {
+    return 0;
+  }
+
+  need = wild_prog_size(s);
+  if (need > wild_scratch_size) {
+    if (wild_scratch) {
+      SAFE_FREE(wild_scratch);
+    }
+    SAFE_MALLOC(wild_scratch, char, need);
+    wild_scratch_size = wild_scratch ? need : 0;
+    if (!wild_scratch) {
+      return 0;
+    }
+  }
+  return wild_exec(wild_compile_into(s, wild_scratch), d);
+}
+
 /* End of wild.c */
@@ -771,7 +771,7 @@ static void fun_remove(char *buff, char *args[10], dbref privs, dbref doer, int
 
 static void fun_match(char *buff, char *args[10], dbref privs, dbref doer, int nargs)
 {
-    const char *pattern = args[1];
+    struct wild_prog *pattern = wild_compile(args[1]);
     char *s = args[0];
     int word_count = 1;
     char *word;
@@ -794,13 +794,14 @@ static void fun_match(char *buff, char *args[10], dbref privs, dbref doer, int n
         if (*s) *s++ = '\0';
         
         /* Check if word matches pattern */
-        if (*word && wild_match((char *)pattern, word)) {
+        if (*word && wild_exec(pattern, word)) {
             snprintf(buff, EVAL_BUFFER_SIZE, "%d", word_count);
             
             /* Restore pronoun pointers */
             for (a = 0; a < 10; a++) {
                 wptr[a] = ptrsrv[a];
             }
+            wild_free(pattern);
             return;
         }
         
@@ -813,6 +814,7 @@ static void fun_match(char *buff, char *args[10], dbref privs, dbref doer, int n
     for (a = 0; a < 10; a++) {
         wptr[a] = ptrsrv[a];
     }
+    wild_free(pattern);
 }
 
 static void fun_wmatch(char *buff, char *args[10], dbref privs, dbref doer, int nargs)
@@ -2766,13 +2768,11 @@ static void fun_idle(char *buff, char *args[10], dbref privs, dbref doer, int na
     
     safe_str_copy(buff, "#-1", EVAL_BUFFER_SIZE);
     
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == who) {
-            if (controls(privs, d->player, POW_WHO) ||
-                could_doit(privs, d->player, A_LHIDE)) {
-                snprintf(buff, EVAL_BUFFER_SIZE, "%ld", now - d->last_time);
-                return;
-            }
+    for (d = player_descriptors(who); d; d = d->pnext) {
+        if (controls(privs, d->player, POW_WHO) ||
+            could_doit(privs, d->player, A_LHIDE)) {
+            snprintf(buff, EVAL_BUFFER_SIZE, "%ld", now - d->last_time);
+            return;
         }
     }
 }
@@ -2800,13 +2800,11 @@ static void fun_onfor(char *buff, char *args[10], dbref privs, dbref doer, int n
     
     safe_str_copy(buff, "#-1", EVAL_BUFFER_SIZE);
     
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == who) {
-            if (controls(privs, d->player, POW_WHO) ||
-                could_doit(privs, d->player, A_LHIDE)) {
-                snprintf(buff, EVAL_BUFFER_SIZE, "%ld", now - d->connected_at);
-                return;
-            }
+    for (d = player_descriptors(who); d; d = d->pnext) {
+        if (controls(privs, d->player, POW_WHO) ||
+            could_doit(privs, d->player, A_LHIDE)) {
+            snprintf(buff, EVAL_BUFFER_SIZE, "%ld", now - d->connected_at);
+            return;
         }
     }
 }
@@ -2834,13 +2832,11 @@ static void fun_port(char *buff, char *args[10], dbref privs, dbref doer, int na
     
     safe_str_copy(buff, "#-1", EVAL_BUFFER_SIZE);
     
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == who) {
-            if (controls(privs, d->player, POW_WHO) ||
-                could_doit(privs, d->player, A_LHIDE)) {
-                snprintf(buff, EVAL_BUFFER_SIZE, "%d", ntohs(d->address.sin_port));
-                return;
-            }
+    for (d = player_descriptors(who); d; d = d->pnext) {
+        if (controls(privs, d->player, POW_WHO) ||
+            could_doit(privs, d->player, A_LHIDE)) {
+            snprintf(buff, EVAL_BUFFER_SIZE, "%d", ntohs(d->address.sin_port));
+            return;
         }
     }
 }
@@ -2868,12 +2864,10 @@ static void fun_host(char *buff, char *args[10], dbref privs, dbref doer, int na
     
     safe_str_copy(buff, "#-1", EVAL_BUFFER_SIZE);
     
-    for (d = descriptor_list; d; d = d->next) {
-        if (d->state == CONNECTED && d->player == who) {
-            if (controls(privs, d->player, POW_WHO)) {
-                snprintf(buff, EVAL_BUFFER_SIZE, "%s@%s", d->user, d->addr);
-                return;
-            }
+    for (d = player_descriptors(who); d; d = d->pnext) {
+        if (controls(privs, d->player, POW_WHO)) {
+            snprintf(buff, EVAL_BUFFER_SIZE, "%s@%s", d->user, d->addr);
+            return;
         }
     }
 }
@@ -3096,19 +3090,383 @@ static const FUN_ENTRY *lookup_function(const char *name)
     return NULL;
 }
 
+/* ============================================================================
+ * COMPILED SOFTCODE
+ * ============================================================================
+ * User-defined function bodies are compiled once into a table of the
+ * museexec() calls they make, so a function called in a loop does not
+ * re-scan its text, copy names and arguments character by character, or
+ * binary-search the function table on every call.
+ *
+ * Each compiled expression (struct sc_expr) records what one museexec()
+ * call starting at a given offset of the text would do: return literal
+ * text, or call a function whose arguments are further expressions.  The
+ * parse is purely textual, except in two places: a name that is not a
+ * built-in is compiled as a user-defined call (if no such function exists,
+ * do_fun() copies it literally and stops somewhere else), and a recursion
+ * limit error returns without moving on.  So every compiled piece is used
+ * only if evaluation has actually arrived at its offset; otherwise the
+ * ordinary interpreter carries on from wherever it is.
+ *
+ * Compiled bodies are cached by text, so editing the attribute simply
+ * stops finding the old entry, and identical bodies share one.
+ */
+
+#define SOFTCODE_CACHE_SIZE 512     /* power of two */
+
+enum sc_kind {
+    SC_TEXT,                /* Literal result; returned at a delimiter */
+    SC_EOS,                 /* Literal result; ran off the end of the text */
+    SC_CALL                 /* name(args) */
+};
+
+struct sc_expr {            /* One museexec() call */
+    int start;              /* Offset museexec() is entered at */
+    int next;               /* Offset it leaves *str at (calls: if udef) */
+    enum sc_kind kind;
+    size_t text;            /* Result (SC_TEXT/SC_EOS) or name (pool) */
+    const FUN_ENTRY *fp;    /* SC_CALL: built-in, or NULL for user-defined */
+    int body;               /* SC_CALL: offset just past '(' */
+    int first_arg;          /* SC_CALL: argument expressions in args[] */
+    int nargs;
+};
+
+enum sc_step_kind {
+    SC_LITERAL,             /* Run of regular characters */
+    SC_BRACKET              /* [expression] */
+};
+
+struct sc_step {            /* Top level of the text (pronoun_substitute) */
+    enum sc_step_kind kind;
+    int length;             /* SC_LITERAL: source characters consumed */
+    size_t text;            /* SC_LITERAL: output (pool) */
+    size_t textlen;
+    int expr;               /* SC_BRACKET: expression after the '[' */
+};
+
+struct softcode {
+    unsigned long hash;
+    size_t len;
+    char *text;             /* NUL-terminated source */
+    unsigned int busy;      /* Evaluations in progress */
+    int orphaned;           /* Evicted while busy: free on release */
+    struct sc_expr *exprs;
+    int *args;
+    struct sc_step *steps;
+    short *step_at;         /* Source offset -> step index, or -1 */
+    char *pool;
+};
+
+struct sc_build {           /* Compiler state; counts when exprs is NULL */
+    char *text;
+    struct sc_expr *exprs;
+    int *args;
+    struct sc_step *steps;
+    short *step_at;
+    char *pool;
+    int nexprs, nargs, nsteps;
+    size_t npool;
+};
+
+enum { SCAN_END, SCAN_EOS, SCAN_CALL };
+
+static struct softcode *softcode_cache[SOFTCODE_CACHE_SIZE];
+unsigned long softcode_cache_hits = 0;
+unsigned long softcode_cache_misses = 0;
+
+static char *museexec_scan(char *s, char *buff, int coma, int *kind);
+static void softcode_expr(struct softcode *sc, int n, char **str, char *buff,
+                          dbref privs, dbref doer);
+
+static size_t sc_string(struct sc_build *b, const char *s, size_t len)
+{
+    size_t off = b->npool;
+
+    if (b->pool) {
+        memcpy(b->pool + off, s, len);
+        b->pool[off + len] = '\0';
+    }
+    b->npool += len + 1;
+    return off;
+}
+
+/**
+ * Compile the museexec() call entered at offset pos
+ * Sets *next to the offset evaluation is expected to continue from.
+ */
+static int sc_compile_expr(struct sc_build *b, int pos, int coma, int *next)
+{
+    static char scratch[EVAL_BUFFER_SIZE];
+    char func_name[MAX_FUNC_NAME_LEN];
+    int local[10];
+    int n = b->nexprs++;
+    int kind, body, p, a, i;
+    size_t text;
+    const FUN_ENTRY *fp = NULL;
+
+    p = (int)(museexec_scan(b->text + pos, scratch, coma, &kind) - b->text);
+    text = sc_string(b, scratch, strlen(scratch));
+    body = p;
+
+    if (kind == SCAN_CALL && *scratch) {
+        /* Same parse as do_fun(), assuming a user-defined name exists */
+        safe_str_copy(func_name, scratch, sizeof(func_name));
+        fp = lookup_function(func_name);
+
+        for (a = 0; (a < 10) && b->text[p] && (b->text[p] != ')'); a++) {
+            if (b->text[p] == ',') {
+                p++;
+            }
+            local[a] = sc_compile_expr(b, p, 1, &p);
+        }
+        if (b->text[p]) {
+            p++;
+        }
+
+        if (b->exprs) {
+            for (i = 0; i < a; i++) {
+                b->args[b->nargs + i] = local[i];
+            }
+        }
+        b->nargs += a;
+    } else {
+        a = 0;
+    }
+
+    if (b->exprs) {
+        struct sc_expr *e = &b->exprs[n];
+
+        e->start = pos;
+        e->next = p;
+        e->kind = (kind == SCAN_CALL) ? SC_CALL :
+                  (kind == SCAN_EOS) ? SC_EOS : SC_TEXT;
+        e->text = text;
+        e->fp = fp;
+        e->body = body;
+        e->nargs = a;
+        e->first_arg = b->nargs - a;
+    }
+
+    *next = p;
+    return n;
+}
+
+/**
+ * Compile the top level of the text, as pronoun_substitute() reads it
+ */
+static void sc_compile_text(struct sc_build *b)
+{
+    int p = 0, start, n;
+    size_t out;
+
+    while (b->text[p]) {
+        start = p;
+
+        if (b->text[p] == '[') {
+            /* [expression]: keyed by the offset museexec() starts at */
+            n = sc_compile_expr(b, p + 1, 0, &p);
+            if (b->text[p] == ']') {
+                p++;
+            }
+            if (b->steps) {
+                b->steps[b->nsteps].kind = SC_BRACKET;
+                b->steps[b->nsteps].expr = n;
+                b->step_at[start + 1] = (short)b->nsteps;
+            }
+            b->nsteps++;
+        } else if (b->text[p] == '%') {
+            /* Substitutions are left to pronoun_substitute(); skip the
+             * characters it consumes so the next step lines up. */
+            p++;
+            if (((b->text[p] == 'v') || (b->text[p] == 'V')) &&
+                (to_upper(b->text[p + 1]) >= 'A') &&
+                (to_upper(b->text[p + 1]) <= 'Z')) {
+                p++;
+            } else if (b->text[p] == '/') {
+                char *slash = strchr(b->text + p + 1, '/');
+
+                p = slash ? (int)(slash - b->text) : p + 1;
+            }
+            if (b->text[p]) {
+                p++;
+            }
+        } else {
+            /* Run of regular characters, with \ escapes resolved */
+            out = b->npool;
+            while (b->text[p] && (b->text[p] != '[') && (b->text[p] != '%')) {
+                if ((b->text[p] == '\\') && b->text[p + 1]) {
+                    p++;
+                }
+                if (b->pool) {
+                    b->pool[b->npool] = b->text[p];
+                }
+                b->npool++;
+                p++;
+            }
+            if (b->steps) {
+                b->pool[b->npool] = '\0';
+                b->steps[b->nsteps].kind = SC_LITERAL;
+                b->steps[b->nsteps].length = p - start;
+                b->steps[b->nsteps].text = out;
+                b->steps[b->nsteps].textlen = b->npool - out;
+                b->step_at[start] = (short)b->nsteps;
+            }
+            b->npool++;
+            b->nsteps++;
+        }
+    }
+}
+
+/**
+ * Compile text into a single allocation
+ * Runs the compiler twice: once to size everything, once to fill it in.
+ */
+static struct softcode *softcode_compile(const char *text, size_t len)
+{
+    struct sc_build b;
+    struct softcode *sc;
+    char *block;
+    size_t i, size;
+
+    memset(&b, 0, sizeof(b));
+    SAFE_MALLOC(b.text, char, len + 1);
+    memcpy(b.text, text, len);
+    b.text[len] = '\0';
+    sc_compile_text(&b);
+
+    size = sizeof(struct softcode) +
+           (size_t)b.nexprs * sizeof(struct sc_expr) +
+           (size_t)b.nsteps * sizeof(struct sc_step) +
+           (size_t)b.nargs * sizeof(int) +
+           (len + 1) * sizeof(short) + b.npool + len + 1;
+    SAFE_MALLOC(block, char, size);
+    sc = (struct softcode *)block;
+    sc->exprs = (struct sc_expr *)(sc + 1);
+    sc->steps = (struct sc_step *)(sc->exprs + b.nexprs);
+    sc->args = (int *)(sc->steps + b.nsteps);
+    sc->step_at = (short *)(sc->args + b.nargs);
+    sc->pool = (char *)(sc->step_at + len + 1);
+    sc->text = sc->pool + b.npool;
+    memcpy(sc->text, b.text, len + 1);
+    SAFE_FREE(b.text);
+    sc->len = len;
+    sc->hash = 0;
+    sc->busy = 0;
+    sc->orphaned = 0;
+    for (i = 0; i <= len; i++) {
+        sc->step_at[i] = -1;
+    }
+
+    b.text = sc->text;
+    b.exprs = sc->exprs;
+    b.steps = sc->steps;
+    b.args = sc->args;
+    b.step_at = sc->step_at;
+    b.pool = sc->pool;
+    b.nexprs = b.nargs = b.nsteps = 0;
+    b.npool = 0;
+    sc_compile_text(&b);
+
+    return sc;
+}
+
+/**
+ * Get the compiled form of the first len characters of text
+ * The result is pinned; release it with softcode_release().
+ */
+static struct softcode *softcode_get(const char *text, size_t len)
+{
+    struct softcode *sc, **slot;
+    unsigned long h = 2166136261UL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)text[i]) * 16777619UL;
+    }
+
+    slot = &softcode_cache[(h ^ (h >> 15)) & (SOFTCODE_CACHE_SIZE - 1)];
+    sc = *slot;
+    if (sc && sc->hash == h && sc->len == len && !memcmp(sc->text, text, len)) {
+        softcode_cache_hits++;
+        sc->busy++;
+        return sc;
+    }
+
+    softcode_cache_misses++;
+    if (sc) {
+        /* Evict; a body still being evaluated is freed when it finishes */
+        if (sc->busy) {
+            sc->orphaned = 1;
+        } else {
+            SAFE_FREE(sc);
+        }
+    }
+    sc = softcode_compile(text, len);
+    sc->hash = h;
+    *slot = sc;
+    sc->busy++;
+    return sc;
+}
+
+static void softcode_release(struct softcode *sc)
+{
+    if (sc->busy) {
+        sc->busy--;
+    }
+    if (!sc->busy && sc->orphaned) {
+        SAFE_FREE(sc);
+    }
+}
+
 /* ============================================================================
  * USER-DEFINED FUNCTION HANDLING
  * ============================================================================ */
 
+/**
+ * Evaluate a function's arguments, consuming the closing parenthesis
+ * Arguments compiled in call are used where evaluation lines up with them.
+ * Returns the number of arguments.
+ */
+static int fun_args(char **str, char *args[10], dbref privs, dbref doer,
+                    struct softcode *sc, const struct sc_expr *call)
+{
+    char obuff[EVAL_BUFFER_SIZE];
+    int a, n;
+    
+    for (a = 0; (a < 10) && **str && (**str != ')'); a++) {
+        if (**str == ',') {
+            (*str)++;
+        }
+        if (call && (a < call->nargs) &&
+            (*str == sc->text + sc->exprs[n = sc->args[call->first_arg + a]].start)) {
+            softcode_expr(sc, n, str, obuff, privs, doer);
+        } else {
+            museexec(str, obuff, privs, doer, 1);
+        }
+        {
+            size_t obuff_len = strlen(obuff) + 1;
+            args[a] = (char *)stack_em_fun(obuff_len);
+            memcpy(args[a], obuff, obuff_len - 1);
+            args[a][obuff_len - 1] = '\0';
+        }
+    }
+    
+    if (**str) {
+        (*str)++;
+    }
+    
+    return a;
+}
+
 /**
  * Try to execute a user-defined function
  * Returns 1 if function was found and executed, 0 otherwise
  */
-static int udef_fun(char **str, char *buff, dbref privs, dbref doer)
+static int udef_fun(char **str, char *buff, dbref privs, dbref doer,
+                    struct softcode *sc, const struct sc_expr *call)
 {
     ATTR *attr = NULL;
     dbref tmp, defed_on = NOTHING;
-    char obuff[EVAL_BUFFER_SIZE];
     char *args[10];
     char *s;
     int a;
@@ -3156,27 +3514,16 @@ static int udef_fun(char **str, char *buff, dbref privs, dbref doer)
     /* Execute user-defined function */
     {
         char result[EVAL_BUFFER_SIZE];
-        char ftext[EVAL_BUFFER_SIZE];
         char *saveptr[10];
+        struct softcode *body;
+        char *ftext;
+        size_t flen;
         
-        /* Initialize arguments */
+        /* Initialize and parse arguments */
         for (a = 0; a < 10; a++) {
             args[a] = "";
         }
-        
-        /* Parse arguments */
-        for (a = 0; (a < 10) && **str && (**str != ')'); a++) {
-            if (**str == ',') {
-                (*str)++;
-            }
-            museexec(str, obuff, privs, doer, 1);
-            {
-                size_t obuff_len = strlen(obuff) + 1;
-                args[a] = stack_em_fun(obuff_len);
-                strncpy(args[a], obuff, obuff_len - 1);
-                args[a][obuff_len - 1] = '\0';
-            }
-        }
+        fun_args(str, args, privs, doer, sc, call);
 
         /* Set pronoun pointers */
         for (a = 0; a < 10; a++) {
@@ -3184,13 +3531,15 @@ static int udef_fun(char **str, char *buff, dbref privs, dbref doer)
             wptr[a] = args[a];
         }
         
-        if (**str) {
-            (*str)++;
-        }
-        
-        /* Get and execute function text */
-        safe_str_copy(ftext, atr_get(defed_on, attr), sizeof(ftext));
-        pronoun_substitute(result, doer, ftext, privs);
+        /* Get and execute the (compiled) function text */
+        ftext = atr_get(defed_on, attr);
+        flen = strlen(ftext);
+        if (flen > EVAL_BUFFER_SIZE - 1) {
+            flen = EVAL_BUFFER_SIZE - 1;
+        }
+        body = softcode_get(ftext, flen);
+        pronoun_substitute_compiled(result, doer, body->text, privs, body);
+        softcode_release(body);
         
         /* Restore pronoun pointers */
         for (a = 0; a < 10; a++) {
@@ -3219,12 +3568,13 @@ static int udef_fun(char **str, char *buff, dbref privs, dbref doer)
 
 /**
  * Execute a function (built-in or user-defined)
+ * call, if not NULL, is the compiled form of this call in sc.
  */
-static void do_fun(char **str, char *buff, dbref privs, dbref doer)
+static void do_fun(char **str, char *buff, dbref privs, dbref doer,
+                   struct softcode *sc, const struct sc_expr *call)
 {
     const FUN_ENTRY *fp;
     char *args[10];
-    char obuff[EVAL_BUFFER_SIZE];
     char func_name[MAX_FUNC_NAME_LEN];
     int a;
     
@@ -3232,11 +3582,11 @@ static void do_fun(char **str, char *buff, dbref privs, dbref doer)
     safe_str_copy(func_name, buff, sizeof(func_name));
     
     /* Look up built-in function */
-    fp = lookup_function(func_name);
+    fp = call ? call->fp : lookup_function(func_name);
     
     /* Try user-defined if not built-in */
     if (!fp) {
-        if (udef_fun(str, buff, privs, doer)) {
+        if (udef_fun(str, buff, privs, doer, sc, call)) {
             return;
         }
         
@@ -3265,22 +3615,7 @@ static void do_fun(char **str, char *buff, dbref privs, dbref doer)
     }
     
     /* Parse arguments for built-in function */
-    for (a = 0; (a < 10) && **str && (**str != ')'); a++) {
-        if (**str == ',') {
-            (*str)++;
-        }
-        museexec(str, obuff, privs, doer, 1);
-        {
-            size_t obuff_len = strlen(obuff) + 1;
-            args[a] = (char *)stack_em_fun(obuff_len);
-            strncpy(args[a], obuff, obuff_len - 1);
-            args[a][obuff_len - 1] = '\0';
-        }
-    }
-    
-    if (**str) {
-        (*str)++;
-    }
+    a = fun_args(str, args, privs, doer, sc, call);
     
     /* Check argument count */
     if ((fp->nargs != -1) && (fp->nargs != a)) {
@@ -3357,43 +3692,23 @@ char *parse_up(char **str, int delimit)
 }
 
 /**
- * Main expression evaluation function
- * Recursively evaluates expressions with proper bracket handling
+ * Scan one expression without evaluating it
+ * Copies the literal text (or the function name) into buff.
  * 
- * @param str Pointer to string pointer (updated during parsing)
- * @param buff Output buffer for result
- * @param privs Object with privileges for evaluation
- * @param doer Object performing the action
- * @param coma Whether to stop at commas (1) or not (0)
+ * @param s Text to scan
+ * @param buff Output buffer (EVAL_BUFFER_SIZE)
+ * @param coma Whether to stop at commas and ')' (1) or not (0)
+ * @param kind Set to SCAN_END, SCAN_EOS (ran out of text) or SCAN_CALL
+ * @return Where scanning stopped (just past the '(' for SCAN_CALL)
  */
-void museexec(char **str, char *buff, dbref privs, dbref doer, int coma)
+static char *museexec_scan(char *s, char *buff, int coma, int *kind)
 {
-    char *s, *e = buff;
-    int recursion_limit = MAX_FUNC_RECURSION;
-    
-    /* Check for valid objects */
-    if (!GoodObject(privs)) {
-        safe_str_copy(buff, "#-1 BAD_PRIVILEGES", EVAL_BUFFER_SIZE);
-        return;
-    }
-    
-    /* Lower recursion limit for guests */
-    if (Typeof(privs) == TYPE_PLAYER && *db[privs].pows == CLASS_GUEST) {
-        recursion_limit = GUEST_FUNC_RECURSION;
-    }
-    
-    /* Track recursion depth */
-    lev += 10;
-    if (lev > recursion_limit) {
-        safe_str_copy(buff, "#-1 RECURSION_LIMIT", EVAL_BUFFER_SIZE);
-        lev -= 10;
-        return;
-    }
+    char *e = buff;
     
     *buff = '\0';
     
     /* Skip leading whitespace */
-    for (s = *str; *s && isspace(*s); s++);
+    for (; *s && isspace(*s); s++);
     
     /* Parse until terminator */
     for (; *s; s++) {
@@ -3409,22 +3724,15 @@ void museexec(char **str, char *buff, dbref privs, dbref doer, int coma)
                 /* Remove trailing whitespace */
                 while ((--e >= buff) && isspace(*e));
                 e[1] = '\0';
-                *str = s;
-                lev -= 10;
-                return;
+                *kind = SCAN_END;
+                return s;
                 
             case '(':  /* Function call */
                 /* Remove trailing whitespace from function name */
                 while ((--e >= buff) && isspace(*e));
                 e[1] = '\0';
-                *str = s + 1;
-                
-                /* Empty parens are quoted */
-                if (*buff) {
-                    do_fun(str, buff, privs, doer);
-                }
-                lev -= 10;
-                return;
+                *kind = SCAN_CALL;
+                return s + 1;
                 
             case '{':  /* Bracketed expression */
                 if (e == buff) {
@@ -3448,9 +3756,8 @@ void museexec(char **str, char *buff, dbref privs, dbref doer, int coma)
                     /* Remove trailing whitespace */
                     while ((--e >= buff) && isspace(*e));
                     e[1] = '\0';
-                    *str = s;
-                    lev -= 10;
-                    return;
+                    *kind = SCAN_END;
+                    return s;
                 } else {
                     /* Braces in middle of expression - copy with contents */
                     int deep = 1;
@@ -3481,8 +3788,150 @@ void museexec(char **str, char *buff, dbref privs, dbref doer, int coma)
     /* Remove trailing whitespace */
     while ((--e >= buff) && isspace(*e));
     e[1] = '\0';
-    *str = s;
-    lev -= 9;
+    *kind = SCAN_EOS;
+    return s;
+}
+
+/**
+ * Main expression evaluation function
+ * Recursively evaluates expressions with proper bracket handling
+ * 
+ * @param str Pointer to string pointer (updated during parsing)
+ * @param buff Output buffer for result
+ * @param privs Object with privileges for evaluation
+ * @param doer Object performing the action
+ * @param coma Whether to stop at commas (1) or not (0)
+ */
+void museexec(char **str, char *buff, dbref privs, dbref doer, int coma)
+{
+    int recursion_limit = MAX_FUNC_RECURSION;
+    int kind;
+    
+    /* Check for valid objects */
+    if (!GoodObject(privs)) {
+        safe_str_copy(buff, "#-1 BAD_PRIVILEGES", EVAL_BUFFER_SIZE);
+        return;
+    }
+    
+    /* Lower recursion limit for guests */
+    if (Typeof(privs) == TYPE_PLAYER && *db[privs].pows == CLASS_GUEST) {
+        recursion_limit = GUEST_FUNC_RECURSION;
+    }
+    
+    /* Track recursion depth */
+    lev += 10;
+    if (lev > recursion_limit) {
+        safe_str_copy(buff, "#-1 RECURSION_LIMIT", EVAL_BUFFER_SIZE);
+        lev -= 10;
+        return;
+    }
+    
+    *str = museexec_scan(*str, buff, coma, &kind);
+    
+    switch (kind) {
+        case SCAN_CALL:
+            /* Empty parens are quoted */
+            if (*buff) {
+                do_fun(str, buff, privs, doer, NULL, NULL);
+            }
+            lev -= 10;
+            break;
+            
+        case SCAN_END:
+            lev -= 10;
+            break;
+            
+        default:
+            lev -= 9;
+            break;
+    }
+}
+
+/**
+ * museexec() for a compiled expression
+ * Must be entered at the expression's own offset in sc->text.
+ */
+static void softcode_expr(struct softcode *sc, int n, char **str, char *buff,
+                          dbref privs, dbref doer)
+{
+    const struct sc_expr *e = &sc->exprs[n];
+    int recursion_limit = MAX_FUNC_RECURSION;
+    
+    /* Same checks as museexec() */
+    if (!GoodObject(privs)) {
+        safe_str_copy(buff, "#-1 BAD_PRIVILEGES", EVAL_BUFFER_SIZE);
+        return;
+    }
+    
+    if (Typeof(privs) == TYPE_PLAYER && *db[privs].pows == CLASS_GUEST) {
+        recursion_limit = GUEST_FUNC_RECURSION;
+    }
+    
+    lev += 10;
+    if (lev > recursion_limit) {
+        safe_str_copy(buff, "#-1 RECURSION_LIMIT", EVAL_BUFFER_SIZE);
+        lev -= 10;
+        return;
+    }
+    
+    strcpy(buff, sc->pool + e->text);
+    
+    switch (e->kind) {
+        case SC_CALL:
+            *str = sc->text + e->body;
+            if (*buff) {
+                do_fun(str, buff, privs, doer, sc, e);
+            }
+            lev -= 10;
+            break;
+            
+        case SC_TEXT:
+            *str = sc->text + e->next;
+            lev -= 10;
+            break;
+            
+        default:
+            *str = sc->text + e->next;
+            lev -= 9;
+            break;
+    }
+}
+
+/**
+ * museexec() for a [expression] in compiled text
+ * Called by pronoun_substitute_compiled() with *str just past the '['.
+ */
+void softcode_bracket(struct softcode *sc, char **str, char *buff,
+                      dbref privs, dbref doer)
+{
+    int k = sc->step_at[*str - sc->text];
+    
+    if ((k >= 0) && (sc->steps[k].kind == SC_BRACKET)) {
+        softcode_expr(sc, sc->steps[k].expr, str, buff, privs, doer);
+    } else {
+        museexec(str, buff, privs, doer, 0);
+    }
+}
+
+/**
+ * Look up a compiled run of regular characters starting at str
+ * 
+ * @param lit Set to the run's output (escapes already resolved)
+ * @param litlen Set to the output length
+ * @return Source characters the run covers, or 0 if none starts at str
+ */
+size_t softcode_literal(struct softcode *sc, const char *str,
+                        const char **lit, size_t *litlen)
+{
+    int k = sc->step_at[str - sc->text];
+    
+    if ((k < 0) || (sc->steps[k].kind != SC_LITERAL)) {
+        return 0;
+    }
+    
+    *lit = sc->pool + sc->steps[k].text;
+    *litlen = sc->steps[k].textlen;
+    return (size_t)sc->steps[k].length;
 }
 
 /* ============================================================================